@@ -0,0 +1,295 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <stdexcept>
+
+#include "QASMTransPrimitives.hpp"
+#include "nlomann/json.hpp"
+
+using namespace QASMTrans;
+using json = nlohmann::json;
+
+/***********************************************
+ * Synthetic workloads for qasmtrans_bench:
+ * parameterized circuits (as OpenQASM 2.0 text,
+ * so that parsing is part of the measurement)
+ * and device configurations in the format of
+ * data/devices. All generators are deterministic
+ * for a given seed.
+ ***********************************************/
+
+inline std::string qasm_header(IdxType n_qubits)
+{
+    std::stringstream ss;
+    ss << "OPENQASM 2.0;\ninclude \"qelib1.inc\";\nqreg q[" << n_qubits << "];\ncreg c[" << n_qubits << "];\n";
+    return ss.str();
+}
+
+inline std::string qasm_angle(ValType angle)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.12g", angle);
+    return buffer;
+}
+
+// Quantum Fourier transform: n H gates and n(n-1)/2 controlled phases
+inline std::string generate_qft(IdxType n_qubits)
+{
+    std::stringstream ss;
+    ss << qasm_header(n_qubits);
+    for (IdxType i = 0; i < n_qubits; i++)
+    {
+        ss << "h q[" << i << "];\n";
+        for (IdxType j = i + 1; j < n_qubits; j++)
+            ss << "cp(" << qasm_angle(PI / std::pow(2.0, double(j - i))) << ") q[" << j << "],q[" << i << "];\n";
+    }
+    for (IdxType i = 0; i < n_qubits / 2; i++)
+        ss << "swap q[" << i << "],q[" << n_qubits - 1 - i << "];\n";
+    return ss.str();
+}
+
+// n_gates gates drawn uniformly from h, t, sx, rz and cx (about half are cx
+// between random pairs), the worst case for routing
+inline std::string generate_random(IdxType n_qubits, IdxType n_gates, unsigned seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<IdxType> pick_qubit(0, n_qubits - 1);
+    std::uniform_real_distribution<ValType> pick_angle(-PI, PI);
+    std::stringstream ss;
+    ss << qasm_header(n_qubits);
+    for (IdxType g = 0; g < n_gates; g++)
+    {
+        IdxType q = pick_qubit(rng);
+        switch (rng() % 8)
+        {
+        case 0:
+            ss << "h q[" << q << "];\n";
+            break;
+        case 1:
+            ss << "t q[" << q << "];\n";
+            break;
+        case 2:
+            ss << "sx q[" << q << "];\n";
+            break;
+        case 3:
+            ss << "rz(" << qasm_angle(pick_angle(rng)) << ") q[" << q << "];\n";
+            break;
+        default:
+        {
+            IdxType t = pick_qubit(rng);
+            while (n_qubits > 1 && t == q)
+                t = pick_qubit(rng);
+            ss << "cx q[" << q << "],q[" << t << "];\n";
+        }
+        }
+    }
+    return ss.str();
+}
+
+// QAOA for MaxCut on a random 3-regular-like graph with p layers
+inline std::string generate_qaoa(IdxType n_qubits, IdxType p_layers, unsigned seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<ValType> pick_angle(0, PI);
+    // union of 3 random perfect matchings (plus a ring for odd n)
+    std::set<std::pair<IdxType, IdxType>> edges;
+    std::vector<IdxType> order(n_qubits);
+    for (IdxType i = 0; i < n_qubits; i++)
+        order[i] = i;
+    for (int m = 0; m < 3; m++)
+    {
+        std::shuffle(order.begin(), order.end(), rng);
+        for (IdxType i = 0; i + 1 < n_qubits; i += 2)
+            edges.insert(std::make_pair(std::min(order[i], order[i + 1]), std::max(order[i], order[i + 1])));
+    }
+    std::stringstream ss;
+    ss << qasm_header(n_qubits);
+    for (IdxType i = 0; i < n_qubits; i++)
+        ss << "h q[" << i << "];\n";
+    for (IdxType layer = 0; layer < p_layers; layer++)
+    {
+        std::string gamma = qasm_angle(pick_angle(rng));
+        std::string beta = qasm_angle(pick_angle(rng));
+        for (auto &e : edges)
+            ss << "rzz(" << gamma << ") q[" << e.first << "],q[" << e.second << "];\n";
+        for (IdxType i = 0; i < n_qubits; i++)
+            ss << "rx(" << beta << ") q[" << i << "];\n";
+    }
+    return ss.str();
+}
+
+// Bernstein-Vazirani with a random secret on n_qubits - 1 data qubits and
+// the last qubit as the oracle target
+inline std::string generate_bv(IdxType n_qubits, unsigned seed)
+{
+    std::mt19937_64 rng(seed);
+    IdxType target = n_qubits - 1;
+    std::stringstream ss;
+    ss << qasm_header(n_qubits);
+    ss << "x q[" << target << "];\n";
+    for (IdxType i = 0; i < n_qubits; i++)
+        ss << "h q[" << i << "];\n";
+    for (IdxType i = 0; i < target; i++)
+        if (rng() & 1)
+            ss << "cx q[" << i << "],q[" << target << "];\n";
+    for (IdxType i = 0; i < target; i++)
+        ss << "h q[" << i << "];\n";
+    return ss.str();
+}
+
+// UCCSD-like ansatz: Pauli-string exponentials of random double excitations
+// (basis change, CX ladder over the span i..l, rz, ladder back), which
+// produce long-range CX chains
+inline std::string generate_uccsd(IdxType n_qubits, IdxType n_excitations, unsigned seed)
+{
+    if (n_qubits < 4)
+        throw std::invalid_argument("uccsd needs at least 4 qubits");
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<ValType> pick_angle(-PI, PI);
+    std::stringstream ss;
+    ss << qasm_header(n_qubits);
+    for (IdxType i = 0; i < n_qubits / 2; i++)
+        ss << "x q[" << i << "];\n";
+    for (IdxType e = 0; e < n_excitations; e++)
+    {
+        std::vector<IdxType> picked(n_qubits);
+        for (IdxType i = 0; i < n_qubits; i++)
+            picked[i] = i;
+        std::shuffle(picked.begin(), picked.end(), rng);
+        picked.resize(4);
+        std::sort(picked.begin(), picked.end());
+        std::string theta = qasm_angle(pick_angle(rng));
+        // one of the 8 Pauli strings of the excitation, chosen by e
+        for (IdxType k = 0; k < 4; k++)
+        {
+            if ((e >> k) & 1)
+                ss << "h q[" << picked[k] << "];\n";
+            else
+                ss << "rx(" << qasm_angle(PI / 2) << ") q[" << picked[k] << "];\n";
+        }
+        for (IdxType q = picked[0]; q < picked[3]; q++)
+            ss << "cx q[" << q << "],q[" << q + 1 << "];\n";
+        ss << "rz(" << theta << ") q[" << picked[3] << "];\n";
+        for (IdxType q = picked[3]; q > picked[0]; q--)
+            ss << "cx q[" << q - 1 << "],q[" << q << "];\n";
+        for (IdxType k = 0; k < 4; k++)
+        {
+            if ((e >> k) & 1)
+                ss << "h q[" << picked[k] << "];\n";
+            else
+                ss << "rx(" << qasm_angle(-PI / 2) << ") q[" << picked[k] << "];\n";
+        }
+    }
+    return ss.str();
+}
+
+//======================================== Devices ========================================
+
+inline json device_from_edges(const std::string &name, IdxType n_qubits, const std::vector<std::pair<IdxType, IdxType>> &edges)
+{
+    json coupling = json::array();
+    for (auto &e : edges)
+    {
+        coupling.push_back(std::to_string(e.first) + "_" + std::to_string(e.second));
+        coupling.push_back(std::to_string(e.second) + "_" + std::to_string(e.first));
+    }
+    return {{"name", name}, {"num_qubits", n_qubits}, {"cx_coupling", coupling}};
+}
+
+// Smallest near-square grid with at least n_qubits qubits
+inline json generate_grid_device(IdxType n_qubits)
+{
+    IdxType cols = std::max<IdxType>(2, (IdxType)std::ceil(std::sqrt(double(n_qubits))));
+    IdxType rows = std::max<IdxType>(1, (n_qubits + cols - 1) / cols);
+    std::vector<std::pair<IdxType, IdxType>> edges;
+    for (IdxType r = 0; r < rows; r++)
+        for (IdxType c = 0; c < cols; c++)
+        {
+            IdxType q = r * cols + c;
+            if (c + 1 < cols)
+                edges.push_back(std::make_pair(q, q + 1));
+            if (r + 1 < rows)
+                edges.push_back(std::make_pair(q, q + cols));
+        }
+    return device_from_edges("grid_" + std::to_string(rows) + "x" + std::to_string(cols), rows * cols, edges);
+}
+
+inline json generate_ring_device(IdxType n_qubits)
+{
+    n_qubits = std::max<IdxType>(3, n_qubits);
+    std::vector<std::pair<IdxType, IdxType>> edges;
+    for (IdxType q = 0; q < n_qubits; q++)
+        edges.push_back(std::make_pair(q, (q + 1) % n_qubits));
+    return device_from_edges("ring_" + std::to_string(n_qubits), n_qubits, edges);
+}
+
+// IBM-style heavy-hex lattice: rows of linearly coupled qubits joined by
+// bridge qubits every 4 columns, offset by 2 on alternate rows
+inline json generate_heavy_hex_device(IdxType n_qubits)
+{
+    // rows of length 4k+3 grow until the lattice holds n_qubits
+    IdxType row_len = 7;
+    IdxType n_rows = 1;
+    auto lattice_size = [](IdxType len, IdxType rows)
+    {
+        IdxType bridges_per_gap = (len + 3) / 4;
+        return len * rows + bridges_per_gap * (rows - 1);
+    };
+    while (lattice_size(row_len, n_rows) < n_qubits)
+    {
+        if (n_rows * 4 < row_len)
+            n_rows++;
+        else
+            row_len += 4;
+    }
+    std::vector<std::pair<IdxType, IdxType>> edges;
+    IdxType next = n_rows * row_len;
+    for (IdxType r = 0; r < n_rows; r++)
+    {
+        for (IdxType c = 0; c + 1 < row_len; c++)
+            edges.push_back(std::make_pair(r * row_len + c, r * row_len + c + 1));
+        if (r + 1 == n_rows)
+            continue;
+        for (IdxType c = (r % 2 == 0 ? 0 : 2); c < row_len; c += 4)
+        {
+            edges.push_back(std::make_pair(r * row_len + c, next));
+            edges.push_back(std::make_pair(next, (r + 1) * row_len + c));
+            next++;
+        }
+    }
+    return device_from_edges("heavy_hex_" + std::to_string(next), next, edges);
+}
+
+inline json generate_device(const std::string &kind, IdxType n_qubits)
+{
+    if (kind == "heavy_hex")
+        return generate_heavy_hex_device(n_qubits);
+    if (kind == "grid")
+        return generate_grid_device(n_qubits);
+    if (kind == "ring")
+        return generate_ring_device(n_qubits);
+    throw std::invalid_argument("Unknown device kind: " + kind);
+}
+
+// family is one of qft, random, qaoa, bv, uccsd; size is the gate count for
+// random, the number of layers for qaoa and of excitations for uccsd
+inline std::string generate_circuit(const std::string &family, IdxType n_qubits, IdxType size, unsigned seed)
+{
+    if (family == "qft")
+        return generate_qft(n_qubits);
+    if (family == "random")
+        return generate_random(n_qubits, size, seed);
+    if (family == "qaoa")
+        return generate_qaoa(n_qubits, size, seed);
+    if (family == "bv")
+        return generate_bv(n_qubits, seed);
+    if (family == "uccsd")
+        return generate_uccsd(n_qubits, size, seed);
+    throw std::invalid_argument("Unknown circuit family: " + family);
+}
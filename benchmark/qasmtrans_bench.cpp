@@ -0,0 +1,424 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+
+#include "QASMTransPrimitives.hpp"
+#include "IR/chip.hpp"
+#include "parser/parser_util.hpp"
+#include "parser/qasm_parser.hpp"
+#include "circuit_passes/transpiler.hpp"
+#include "dump_qasm.hpp"
+#include "circuit_generators.hpp"
+
+using namespace QASMTrans;
+
+/***********************************************
+ * qasmtrans_bench: times every pipeline stage on
+ * synthetic circuits and devices, reports
+ * throughput and output quality, and compares
+ * the results against a stored baseline.
+ ***********************************************/
+
+struct BenchCase
+{
+    std::string family;
+    IdxType n_qubits;
+    IdxType size;
+    std::string device;
+
+    std::string name() const
+    {
+        std::stringstream ss;
+        ss << family << "_n" << n_qubits;
+        if (family == "random" || family == "qaoa" || family == "uccsd")
+            ss << "_s" << size;
+        ss << "_" << device;
+        return ss.str();
+    }
+};
+
+// quick: seconds, for every change; medium: around a minute; full: the
+// 10-1000 qubit, 1e3-1e7 gate range (long)
+std::vector<BenchCase> bench_suite(const std::string &suite)
+{
+    if (suite == "quick")
+        return {{"qft", 20, 0, "heavy_hex"},
+                {"qft", 40, 0, "grid"},
+                {"random", 20, 1000, "heavy_hex"},
+                {"random", 40, 1000, "grid"},
+                {"random", 24, 1000, "ring"},
+                {"qaoa", 30, 2, "grid"},
+                {"qaoa", 40, 2, "ring"},
+                {"bv", 100, 0, "heavy_hex"},
+                {"uccsd", 16, 50, "heavy_hex"},
+                {"uccsd", 20, 100, "grid"}};
+    if (suite == "medium")
+        return {{"qft", 100, 0, "heavy_hex"},
+                {"random", 100, 100000, "heavy_hex"},
+                {"random", 200, 100000, "grid"},
+                {"qaoa", 200, 3, "heavy_hex"},
+                {"qaoa", 100, 4, "ring"},
+                {"bv", 500, 0, "grid"},
+                {"uccsd", 32, 500, "heavy_hex"}};
+    if (suite == "full")
+        return {{"qft", 500, 0, "heavy_hex"},
+                {"qft", 1000, 0, "grid"},
+                {"random", 1000, 1000000, "heavy_hex"},
+                {"random", 1000, 10000000, "grid"},
+                {"qaoa", 1000, 10, "heavy_hex"},
+                {"bv", 1000, 0, "heavy_hex"},
+                {"uccsd", 64, 10000, "grid"}};
+    throw std::invalid_argument("Unknown suite: " + suite + " (quick, medium or full)");
+}
+
+// "random:500:100000:grid"
+BenchCase parse_case(const std::string &spec)
+{
+    std::vector<std::string> fields;
+    std::stringstream ss(spec);
+    std::string field;
+    while (std::getline(ss, field, ':'))
+        fields.push_back(field);
+    if (fields.size() != 4)
+        throw std::invalid_argument("Case must be family:n_qubits:size:device, got " + spec);
+    return {fields[0], std::stoll(fields[1]), std::stoll(fields[2]), fields[3]};
+}
+
+// Number of layers when every gate occupies its qubits for one step
+IdxType circuit_depth(shared_ptr<Circuit> circuit)
+{
+    std::vector<IdxType> level(circuit->num_qubits(), 0);
+    IdxType depth = 0;
+    for (const Gate &g : *circuit->gates)
+    {
+        IdxType qubits[3] = {g.qubit, g.ctrl, g.extra};
+        IdxType d = 0;
+        for (IdxType q : qubits)
+        {
+            if (q < 0)
+                continue;
+            if (q >= (IdxType)level.size())
+                level.resize(q + 1, 0);
+            d = std::max(d, level[q]);
+        }
+        d++;
+        for (IdxType q : qubits)
+            if (q >= 0)
+                level[q] = d;
+        depth = std::max(depth, d);
+    }
+    return depth;
+}
+
+struct StageTimes
+{
+    std::map<std::string, std::vector<long long>> ns;
+
+    void add(const std::string &stage, long long value) { ns[stage].push_back(value); }
+    static long long median(std::vector<long long> values)
+    {
+        std::sort(values.begin(), values.end());
+        return values.empty() ? 0 : values[values.size() / 2];
+    }
+    json to_json() const
+    {
+        json stages = json::object();
+        for (auto &entry : ns)
+        {
+            stages[entry.first] = {{"median_ns", median(entry.second)},
+                                   {"min_ns", *std::min_element(entry.second.begin(), entry.second.end())}};
+        }
+        return stages;
+    }
+};
+
+json run_case(const BenchCase &bench, const std::vector<std::string> &pipeline, IdxType mode, IdxType warmup,
+              IdxType reps, unsigned seed, const std::string &save_dir, const SabreOptions &sabre)
+{
+    std::string qasm = generate_circuit(bench.family, bench.n_qubits, bench.size, seed);
+    json device = generate_device(bench.device, bench.n_qubits);
+    if (!save_dir.empty())
+    {
+        // inputs for reproducing a case with QASMTrans
+        std::ofstream(save_dir + "/" + bench.name() + ".qasm") << qasm;
+        std::ofstream(save_dir + "/" + bench.name() + ".json") << device.dump(2) << std::endl;
+    }
+    StageTimes times;
+    json quality;
+    IdxType input_gates = 0;
+    for (IdxType rep = 0; rep < warmup + reps; rep++)
+    {
+        bool measured = rep >= warmup;
+        steady_timer timer;
+
+        timer.start_timer();
+        std::istringstream qasm_stream(qasm);
+        qasm_parser parser(qasm_stream);
+        shared_ptr<Circuit> circuit = make_shared<Circuit>(parser.num_qubits());
+        parser.loadin_circuit(circuit);
+        timer.stop_timer();
+        if (measured)
+            times.add("parse", timer.measure_ns());
+        input_gates = circuit->num_gates();
+
+        timer.start_timer();
+        shared_ptr<Chip> chip = constructChipFromConfig(circuit->num_qubits(), device, false, 0);
+        timer.stop_timer();
+        if (measured)
+            times.add("chip", timer.measure_ns());
+
+        timer.start_timer();
+        vector<PassStats> pass_stats = transpiler(circuit, chip, parser.get_list_cregs(), 0, mode, seed, pipeline, sabre);
+        timer.stop_timer();
+        if (measured)
+        {
+            times.add("transpile", timer.measure_ns());
+            for (auto &stats : pass_stats)
+                times.add("pass:" + stats.name, stats.time_ns);
+        }
+
+        timer.start_timer();
+        std::ostringstream out;
+        std::map<std::string, IdxType> gate_counts;
+        writeQASM(circuit, out, gate_counts);
+        timer.stop_timer();
+        if (measured)
+            times.add("dump", timer.measure_ns());
+
+        // the pipeline is seeded, so every repetition produces the same circuit
+        IdxType swaps = 0;
+        for (auto &stats : pass_stats)
+            if (stats.name == "routing")
+                swaps = stats.counters.value("final_swaps", IdxType(0));
+        quality = {{"swaps", swaps},
+                   {"depth", circuit_depth(circuit)},
+                   {"output_gates", circuit->num_gates()},
+                   {"two_qubit_gates", gate_counts["cx"] + gate_counts["cz"] + gate_counts["rxx"] + gate_counts["rzz"]}};
+    }
+    json stages = times.to_json();
+    long long transpile_ns = stages["transpile"]["median_ns"];
+    long long total_ns = transpile_ns + (long long)stages["parse"]["median_ns"] + (long long)stages["chip"]["median_ns"] +
+                         (long long)stages["dump"]["median_ns"];
+    json result = {{"case", bench.name()},
+                   {"n_qubits", bench.n_qubits},
+                   {"device_qubits", device["num_qubits"]},
+                   {"input_gates", input_gates},
+                   {"stages", stages},
+                   {"transpile_gates_per_s", transpile_ns > 0 ? input_gates * 1e9 / transpile_ns : 0.0},
+                   {"end_to_end_gates_per_s", total_ns > 0 ? input_gates * 1e9 / total_ns : 0.0}};
+    result.update(quality);
+    return result;
+}
+
+// Returns the number of regressions: swaps/depth above (1 + quality_tolerance)
+// of the baseline, or throughput below (1 - tolerance) of it if tolerance >= 0
+// (throughput depends on the machine, so it is only compared on request)
+IdxType compare_baseline(const json &results, const json &baseline, double tolerance, double quality_tolerance)
+{
+    std::map<std::string, json> base;
+    for (auto &entry : baseline.at("results"))
+        base[entry.at("case").get<std::string>()] = entry;
+    IdxType regressions = 0;
+    std::cout << std::endl
+              << std::left << std::setw(32) << "case" << std::right << std::setw(14) << "gates/s"
+              << std::setw(10) << "vs base" << std::setw(10) << "swaps" << std::setw(10) << "base"
+              << std::setw(10) << "depth" << std::setw(10) << "base" << "  status" << std::endl;
+    for (auto &r : results)
+    {
+        std::string name = r["case"];
+        auto it = base.find(name);
+        if (it == base.end())
+        {
+            std::cout << std::left << std::setw(32) << name << "  (not in baseline)" << std::endl;
+            continue;
+        }
+        const json &b = it->second;
+        double rate = r["transpile_gates_per_s"];
+        double base_rate = b["transpile_gates_per_s"];
+        double ratio = base_rate > 0 ? rate / base_rate : 1.0;
+        IdxType swaps = r["swaps"], base_swaps = b["swaps"];
+        IdxType depth = r["depth"], base_depth = b["depth"];
+        std::vector<std::string> failures;
+        if (tolerance >= 0 && ratio < 1.0 - tolerance)
+            failures.push_back("throughput");
+        if (swaps > base_swaps * (1.0 + quality_tolerance))
+            failures.push_back("swaps");
+        if (depth > base_depth * (1.0 + quality_tolerance))
+            failures.push_back("depth");
+        std::string status = "ok";
+        for (size_t i = 0; i < failures.size(); i++)
+            status = (i ? status + "," : std::string("REGRESSION: ")) + failures[i];
+        regressions += !failures.empty();
+        std::cout << std::left << std::setw(32) << name << std::right << std::setw(14) << (IdxType)rate
+                  << std::setw(9) << std::fixed << std::setprecision(2) << ratio << "x" << std::setw(10) << swaps
+                  << std::setw(10) << base_swaps << std::setw(10) << depth << std::setw(10) << base_depth
+                  << "  " << status << std::endl;
+    }
+    return regressions;
+}
+
+void print_help()
+{
+    std::cout << "Usage: ./qasmtrans_bench [options]" << std::endl;
+    std::cout << "Option              Description" << std::endl;
+    std::cout << "-suite <name>       quick (default), medium or full" << std::endl;
+    std::cout << "-case <spec>        Run a single case family:n_qubits:size:device instead, "
+              << "e.g. random:500:100000:grid" << std::endl;
+    std::cout << "                    family: qft, random (size = gates), qaoa (size = layers), bv, "
+              << "uccsd (size = excitations); device: heavy_hex, grid, ring" << std::endl;
+    std::cout << "-filter <text>      Only run cases whose name contains the text" << std::endl;
+    std::cout << "-reps <n>           Measured repetitions per case, default is 3" << std::endl;
+    std::cout << "-warmup <n>         Unmeasured warm-up runs per case, default is 1" << std::endl;
+    std::cout << "-passes <spec>      Pass pipeline, as for qasmtrans" << std::endl;
+    std::cout << "-m <name>           Basis gate mode, default is ibmq" << std::endl;
+    std::cout << "-seed <n>           Seed of the generators and the router, default is 1" << std::endl;
+    std::cout << "-ext_size <n>, -ext_weight <w>, -decay <d>, -decay_reset <n>, -stagnation <n>, -max_swaps_per_gate <n>,"
+              << " -parallel_swaps, -depth_weight <w>, -commutation_block <n>,"
+              << " -router <engine>, -beam_width <n>, -search_depth <n>, -search_nodes <n>, -search_threads <n>, -bridge, -time_slices <k>  SABRE parameters, as for qasmtrans" << std::endl;
+    std::cout << "-o <path>           Write the results as JSON" << std::endl;
+    std::cout << "-save <dir>         Also write each generated circuit and device to the directory" << std::endl;
+    std::cout << "-baseline <path>    Compare with a results file; exit with 1 on regressions" << std::endl;
+    std::cout << "-tolerance <x>      Also fail on a throughput drop above x (e.g. 0.25); off by default, "
+              << "as the baseline may come from another machine" << std::endl;
+    std::cout << "-quality_tolerance <x>  Allowed swap/depth increase, default is 0.05" << std::endl;
+    std::cout << "-h                  print the help function" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (cmdOptionExists(argv, argv + argc, "-h"))
+    {
+        print_help();
+        return 0;
+    }
+    try
+    {
+        std::string suite = "quick";
+        IdxType reps = 3, warmup = 1, mode = 0;
+        unsigned seed = 1;
+        double tolerance = -1, quality_tolerance = 0.05;
+        std::vector<std::string> pipeline = default_pipeline();
+        if (cmdOptionExists(argv, argv + argc, "-suite"))
+            suite = getCmdOption(argv, argv + argc, "-suite");
+        if (cmdOptionExists(argv, argv + argc, "-reps"))
+            reps = std::max(1LL, std::stoll(getCmdOption(argv, argv + argc, "-reps")));
+        if (cmdOptionExists(argv, argv + argc, "-warmup"))
+            warmup = std::max(0LL, std::stoll(getCmdOption(argv, argv + argc, "-warmup")));
+        if (cmdOptionExists(argv, argv + argc, "-seed"))
+            seed = std::stoul(getCmdOption(argv, argv + argc, "-seed"));
+        SabreOptions sabre;
+        if (cmdOptionExists(argv, argv + argc, "-ext_size"))
+            sabre.extended_size = std::stoll(getCmdOption(argv, argv + argc, "-ext_size"));
+        if (cmdOptionExists(argv, argv + argc, "-ext_weight"))
+            sabre.extended_weight = std::stod(getCmdOption(argv, argv + argc, "-ext_weight"));
+        if (cmdOptionExists(argv, argv + argc, "-decay"))
+            sabre.decay = std::stod(getCmdOption(argv, argv + argc, "-decay"));
+        if (cmdOptionExists(argv, argv + argc, "-decay_reset"))
+            sabre.decay_reset = std::stoll(getCmdOption(argv, argv + argc, "-decay_reset"));
+        if (cmdOptionExists(argv, argv + argc, "-stagnation"))
+            sabre.stagnation_limit = std::stoll(getCmdOption(argv, argv + argc, "-stagnation"));
+        if (cmdOptionExists(argv, argv + argc, "-max_swaps_per_gate"))
+            sabre.max_swaps_per_gate = std::stoll(getCmdOption(argv, argv + argc, "-max_swaps_per_gate"));
+        sabre.parallel_swaps = cmdOptionExists(argv, argv + argc, "-parallel_swaps");
+        if (cmdOptionExists(argv, argv + argc, "-commutation_block"))
+            sabre.commutation_block = std::stoll(getCmdOption(argv, argv + argc, "-commutation_block"));
+        if (cmdOptionExists(argv, argv + argc, "-router"))
+            sabre.beam_search = std::string(getCmdOption(argv, argv + argc, "-router")) == "beam";
+        if (cmdOptionExists(argv, argv + argc, "-beam_width"))
+            sabre.beam_width = std::stoll(getCmdOption(argv, argv + argc, "-beam_width"));
+        if (cmdOptionExists(argv, argv + argc, "-search_depth"))
+            sabre.search_depth = std::stoll(getCmdOption(argv, argv + argc, "-search_depth"));
+        if (cmdOptionExists(argv, argv + argc, "-search_nodes"))
+            sabre.search_nodes = std::stoll(getCmdOption(argv, argv + argc, "-search_nodes"));
+        if (cmdOptionExists(argv, argv + argc, "-search_threads"))
+            sabre.search_threads = std::stoll(getCmdOption(argv, argv + argc, "-search_threads"));
+        if (cmdOptionExists(argv, argv + argc, "-depth_weight"))
+            sabre.depth_weight = std::stod(getCmdOption(argv, argv + argc, "-depth_weight"));
+        sabre.bridge = cmdOptionExists(argv, argv + argc, "-bridge");
+        if (cmdOptionExists(argv, argv + argc, "-time_slices"))
+            sabre.time_slices = std::stoll(getCmdOption(argv, argv + argc, "-time_slices"));
+        sabre.validate();
+        if (cmdOptionExists(argv, argv + argc, "-tolerance"))
+            tolerance = std::stod(getCmdOption(argv, argv + argc, "-tolerance"));
+        if (cmdOptionExists(argv, argv + argc, "-quality_tolerance"))
+            quality_tolerance = std::stod(getCmdOption(argv, argv + argc, "-quality_tolerance"));
+        if (cmdOptionExists(argv, argv + argc, "-passes"))
+            pipeline = parse_pipeline(getCmdOption(argv, argv + argc, "-passes"));
+        if (cmdOptionExists(argv, argv + argc, "-m"))
+        {
+            mode = mode_from_name(getCmdOption(argv, argv + argc, "-m"));
+            if (mode < 0)
+                throw std::invalid_argument("Invalid mode name");
+        }
+        std::string save_dir;
+        if (cmdOptionExists(argv, argv + argc, "-save"))
+            save_dir = getCmdOption(argv, argv + argc, "-save");
+        std::vector<BenchCase> cases;
+        if (cmdOptionExists(argv, argv + argc, "-case"))
+            cases.push_back(parse_case(getCmdOption(argv, argv + argc, "-case")));
+        else
+            cases = bench_suite(suite);
+        if (cmdOptionExists(argv, argv + argc, "-filter"))
+        {
+            std::string filter = getCmdOption(argv, argv + argc, "-filter");
+            cases.erase(std::remove_if(cases.begin(), cases.end(), [&](const BenchCase &c)
+                                       { return c.name().find(filter) == std::string::npos; }),
+                        cases.end());
+        }
+
+        json results = json::array();
+        std::cout << std::left << std::setw(32) << "case" << std::right << std::setw(10) << "gates"
+                  << std::setw(12) << "parse ms" << std::setw(12) << "route ms" << std::setw(14) << "transpile ms"
+                  << std::setw(14) << "gates/s" << std::setw(10) << "swaps" << std::setw(10) << "depth" << std::endl;
+        for (auto &bench : cases)
+        {
+            json r = run_case(bench, pipeline, mode, warmup, reps, seed, save_dir, sabre);
+            json &stages = r["stages"];
+            double route_ms = stages.contains("pass:routing") ? (long long)stages["pass:routing"]["median_ns"] * 1e-6 : 0.0;
+            std::cout << std::left << std::setw(32) << bench.name() << std::right << std::setw(10)
+                      << r["input_gates"].get<IdxType>() << std::fixed << std::setprecision(2) << std::setw(12)
+                      << (long long)stages["parse"]["median_ns"] * 1e-6 << std::setw(12) << route_ms << std::setw(14)
+                      << (long long)stages["transpile"]["median_ns"] * 1e-6 << std::setw(14)
+                      << (IdxType)r["transpile_gates_per_s"].get<double>() << std::setw(10) << r["swaps"].get<IdxType>()
+                      << std::setw(10) << r["depth"].get<IdxType>() << std::endl;
+            results.push_back(r);
+        }
+
+        json report = {{"suite", cmdOptionExists(argv, argv + argc, "-case") ? "custom" : suite},
+                       {"pipeline", pipeline},
+                       {"seed", seed},
+                       {"sabre", sabre.to_string()},
+                       {"reps", reps},
+                       {"warmup", warmup},
+                       {"results", results}};
+        if (cmdOptionExists(argv, argv + argc, "-o"))
+        {
+            std::ofstream out(getCmdOption(argv, argv + argc, "-o"));
+            out << report.dump(2) << std::endl;
+        }
+        if (cmdOptionExists(argv, argv + argc, "-baseline"))
+        {
+            std::ifstream f(getCmdOption(argv, argv + argc, "-baseline"));
+            if (f.fail())
+                throw std::runtime_error(std::string("Could not open baseline at: ") + getCmdOption(argv, argv + argc, "-baseline"));
+            IdxType regressions = compare_baseline(results, json::parse(f), tolerance, quality_tolerance);
+            if (regressions > 0)
+            {
+                std::cout << regressions << " regression(s) against the baseline" << std::endl;
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
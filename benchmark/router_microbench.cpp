@@ -0,0 +1,550 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+
+#include "QASMTransPrimitives.hpp"
+#include "IR/chip.hpp"
+#include "parser/parser_util.hpp"
+#include "parser/qasm_parser.hpp"
+#include "circuit_passes/decompose.hpp"
+#include "circuit_passes/routing_mapping.hpp"
+#include "transpile_cache.hpp"
+
+using namespace QASMTrans;
+
+/***********************************************
+ * router_microbench: ns/op of the SABRE router
+ * primitives (heuristic, find_executable_gates,
+ * maintain_layer, pick_one_movement,
+ * DAG_generator, floyd) replayed over router
+ * states recorded from a real routing run, so
+ * that parsing and I/O are out of the loop.
+ *
+ * A state stores the layout, the front layer, the
+ * extended (future) set and the number of executed
+ * gates per logical qubit, from which the DAG
+ * state (gate_state, gate_dependency, qubit_state)
+ * is rebuilt.
+ ***********************************************/
+
+struct RouterSnapshot
+{
+    IdxType step;
+    std::vector<IdxType> mapping;
+    std::vector<IdxType> progress; // executed gates per logical qubit
+    std::vector<IdxType> current_layer;
+    std::vector<IdxType> future_layer;
+};
+
+// The 2-qubit gates as routed by one_round_optimization: {ctrl, qubit} after
+// three_to_two, in circuit order
+std::vector<std::vector<IdxType>> load_router_circuit(const std::string &qasm_path, IdxType &n_qubits)
+{
+    qasm_parser parser(qasm_path.c_str());
+    shared_ptr<Circuit> circuit = make_shared<Circuit>(parser.num_qubits());
+    parser.loadin_circuit(circuit);
+    Decompose_three_to_two(circuit);
+    n_qubits = circuit->num_qubits();
+    std::vector<std::vector<IdxType>> gates;
+    for (const Gate &g : *circuit->gates)
+        if (OP_ARITY[g.op_name] == 2)
+            gates.push_back({g.ctrl, g.qubit});
+    return gates;
+}
+
+std::string router_circuit_hash(const std::vector<std::vector<IdxType>> &circuit)
+{
+    CacheHasher hasher;
+    hasher.add<uint64_t>(circuit.size());
+    for (auto &gate : circuit)
+    {
+        hasher.add<int64_t>(gate[0]);
+        hasher.add<int64_t>(gate[1]);
+    }
+    return hasher.hex();
+}
+
+json snapshot_to_json(const RouterSnapshot &s)
+{
+    return {{"step", s.step},
+            {"mapping", s.mapping},
+            {"progress", s.progress},
+            {"current_layer", s.current_layer},
+            {"future_layer", s.future_layer}};
+}
+
+RouterSnapshot snapshot_from_json(const json &j)
+{
+    return {j.at("step").get<IdxType>(), j.at("mapping").get<std::vector<IdxType>>(),
+            j.at("progress").get<std::vector<IdxType>>(), j.at("current_layer").get<std::vector<IdxType>>(),
+            j.at("future_layer").get<std::vector<IdxType>>()};
+}
+
+// Route the circuit and keep about n_snapshots evenly spaced states of the
+// first SABRE round (every stride-th step; the stride doubles whenever twice
+// as many states have been kept)
+json record_router_states(const std::string &qasm_path, const std::string &device_path, bool limited, IdxType seed,
+                          IdxType n_snapshots)
+{
+    qasm_parser parser(qasm_path.c_str());
+    shared_ptr<Circuit> circuit = make_shared<Circuit>(parser.num_qubits());
+    parser.loadin_circuit(circuit);
+    Decompose_three_to_two(circuit);
+    IdxType n_qubits = circuit->num_qubits();
+    shared_ptr<Chip> chip = constructChip(n_qubits, device_path, limited, 0);
+
+    std::vector<RouterSnapshot> snapshots;
+    std::string circuit_hash;
+    IdxType round = 0, stride = 1;
+    RoutingStats stats;
+    stats.observer = [&](const RouterStateView &view)
+    {
+        if (view.step == 0)
+            round++;
+        if (round != 1)
+            return;
+        if (view.step == 0)
+            circuit_hash = router_circuit_hash(view.circuit);
+        if (view.step % stride != 0)
+            return;
+        std::vector<IdxType> progress(n_qubits, 0);
+        for (size_t g = 0; g < view.circuit.size(); g++)
+            if (view.gate_state[g] == 3)
+            {
+                progress[view.circuit[g][0]]++;
+                progress[view.circuit[g][1]]++;
+            }
+        snapshots.push_back({view.step, view.mapping, progress, view.current_layer, view.future_layer});
+        if ((IdxType)snapshots.size() >= 2 * n_snapshots)
+        {
+            std::vector<RouterSnapshot> kept;
+            for (size_t i = 0; i < snapshots.size(); i += 2)
+                kept.push_back(snapshots[i]);
+            snapshots.swap(kept);
+            stride *= 2;
+        }
+    };
+    Routing(circuit, chip, 0, seed, &stats);
+
+    json states = json::array();
+    for (auto &s : snapshots)
+        states.push_back(snapshot_to_json(s));
+    return {{"circuit", qasm_path},
+            {"device", device_path},
+            {"limited", limited},
+            {"seed", seed},
+            {"n_qubits", n_qubits},
+            {"circuit_hash", circuit_hash},
+            {"stride", stride},
+            {"snapshots", states}};
+}
+
+// Loaded states with everything needed to replay them
+struct RouterWorkload
+{
+    std::vector<std::vector<IdxType>> circuit;
+    shared_ptr<Chip> chip;
+    std::vector<RouterSnapshot> snapshots;
+    // static DAG: followers from DAG_generator, predecessor of gate g on
+    // circuit[g][k] and the position of g in that qubit's gate sequence
+    std::vector<std::vector<IdxType>> following;
+    std::vector<IdxType> pred[2];
+    std::vector<IdxType> position[2];
+
+    bool executed(IdxType gate, const RouterSnapshot &s) const
+    {
+        return position[0][gate] < s.progress[circuit[gate][0]];
+    }
+
+    // DAG state of the router at the snapshot
+    void restore(const RouterSnapshot &s, std::vector<IdxType> &gate_state, std::vector<IdxType> &gate_dependency,
+                 std::vector<IdxType> &qubit_state) const
+    {
+        IdxType n_gates = circuit.size();
+        gate_state.assign(n_gates, 0);
+        gate_dependency.assign(n_gates, 0);
+        qubit_state.assign(chip->qubit_num, 0);
+        for (IdxType g = 0; g < n_gates; g++)
+        {
+            if (executed(g, s))
+            {
+                gate_state[g] = 3;
+                continue;
+            }
+            for (int k = 0; k < 2; k++)
+                if (pred[k][g] >= 0 && !executed(pred[k][g], s))
+                    gate_dependency[g]++;
+        }
+        for (IdxType g : s.future_layer)
+            gate_state[g] = 1;
+        for (IdxType g : s.current_layer)
+        {
+            gate_state[g] = 2;
+            qubit_state[circuit[g][0]] = 1;
+            qubit_state[circuit[g][1]] = 1;
+        }
+    }
+};
+
+RouterWorkload load_router_workload(const std::string &states_path, std::string qasm_path, std::string device_path)
+{
+    std::ifstream f(states_path);
+    if (f.fail())
+        throw std::runtime_error("Could not open router states at: " + states_path + " (see -record)");
+    json states = json::parse(f);
+    if (qasm_path.empty())
+        qasm_path = states.at("circuit");
+    if (device_path.empty())
+        device_path = states.at("device");
+
+    RouterWorkload w;
+    IdxType n_qubits = 0;
+    w.circuit = load_router_circuit(qasm_path, n_qubits);
+    if (router_circuit_hash(w.circuit) != states.at("circuit_hash").get<std::string>())
+        throw std::runtime_error("Router states were recorded for a different circuit than " + qasm_path);
+    w.chip = constructChip(n_qubits, device_path, states.at("limited").get<bool>(), 0);
+    for (auto &s : states.at("snapshots"))
+        w.snapshots.push_back(snapshot_from_json(s));
+
+    IdxType n_gates = w.circuit.size();
+    std::vector<IdxType> gate_state(n_gates, 0), gate_dependency(n_gates, 2), qubit_state(w.chip->qubit_num, 0);
+    std::vector<IdxType> first_layer;
+    DAG_generator(w.chip->qubit_num, w.circuit, gate_state, qubit_state, gate_dependency, w.following, first_layer);
+    std::vector<IdxType> last(n_qubits, -1), count(n_qubits, 0);
+    for (int k = 0; k < 2; k++)
+    {
+        w.pred[k].resize(n_gates);
+        w.position[k].resize(n_gates);
+    }
+    for (IdxType g = 0; g < n_gates; g++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            IdxType q = w.circuit[g][k];
+            w.pred[k][g] = last[q];
+            w.position[k][g] = count[q]++;
+        }
+        last[w.circuit[g][0]] = last[w.circuit[g][1]] = g;
+    }
+    return w;
+}
+
+//======================================== Measurement ========================================
+
+struct MicroResult
+{
+    std::string name;
+    IdxType ops_per_batch = 0;
+    std::vector<double> ns_per_op; // one value per repetition
+};
+
+// A batch runs every operation of a benchmark once and returns the measured
+// time in ns; each repetition runs batches for at least min_time_ns
+MicroResult measure(const std::string &name, IdxType ops_per_batch, IdxType reps, long long min_time_ns,
+                    const std::function<long long()> &batch)
+{
+    MicroResult result;
+    result.name = name;
+    result.ops_per_batch = ops_per_batch;
+    if (ops_per_batch == 0)
+        return result;
+    batch(); // warm-up
+    for (IdxType rep = 0; rep < reps; rep++)
+    {
+        long long measured_ns = 0;
+        IdxType ops = 0;
+        long long rep_start = get_steady_ns();
+        do
+        {
+            measured_ns += batch();
+            ops += ops_per_batch;
+        } while (get_steady_ns() - rep_start < min_time_ns);
+        result.ns_per_op.push_back(double(measured_ns) / ops);
+    }
+    return result;
+}
+
+json result_to_json(const MicroResult &r)
+{
+    std::vector<double> v = r.ns_per_op;
+    std::sort(v.begin(), v.end());
+    if (v.empty())
+        return {{"name", r.name}, {"ops_per_batch", 0}};
+    double median = v[v.size() / 2];
+    return {{"name", r.name},
+            {"ops_per_batch", r.ops_per_batch},
+            {"median_ns_per_op", median},
+            {"min_ns_per_op", v.front()},
+            {"max_ns_per_op", v.back()},
+            {"spread", median > 0 ? (v.back() - v.front()) / median : 0.0}};
+}
+
+// Defeats dead-code elimination of benchmarked results
+volatile double bench_sink = 0;
+
+std::vector<MicroResult> run_microbenchmarks(RouterWorkload &w, IdxType reps, long long min_time_ns,
+                                             const std::string &filter)
+{
+    auto selected = [&](const std::string &name)
+    { return filter.empty() || name.find(filter) != std::string::npos; };
+    std::vector<MicroResult> results;
+    const auto &distance_mat = w.chip->distance_mat;
+    IdxType qubit_num = w.chip->qubit_num;
+
+    // states where no front gate is executable, i.e., where the router picks a swap
+    std::vector<const RouterSnapshot *> swap_states, execute_states;
+    for (auto &s : w.snapshots)
+    {
+        if (find_executable_gates(s.mapping, s.current_layer, w.circuit, distance_mat).empty())
+            swap_states.push_back(&s);
+        else
+            execute_states.push_back(&s);
+    }
+
+    if (selected("heuristic"))
+    {
+        // every candidate swap of every swap state, as pick_one_movement scores them
+        struct Candidate
+        {
+            const RouterSnapshot *state;
+            std::vector<IdxType> mapping;
+        };
+        std::vector<Candidate> candidates;
+        for (const RouterSnapshot *s : swap_states)
+        {
+            std::vector<IdxType> p2l = find_reverse_mapping(s->mapping, qubit_num);
+            for (IdxType g : s->current_layer)
+                for (IdxType q : {s->mapping[w.circuit[g][0]], s->mapping[w.circuit[g][1]]})
+                    for (IdxType target : w.chip->edge_list[q])
+                    {
+                        std::vector<IdxType> mapping = s->mapping;
+                        if (p2l[q] >= 0)
+                            mapping[p2l[q]] = target;
+                        if (p2l[target] >= 0)
+                            mapping[p2l[target]] = q;
+                        candidates.push_back({s, mapping});
+                    }
+        }
+        results.push_back(measure("heuristic", candidates.size(), reps, min_time_ns, [&]()
+                                  {
+            long long start = get_steady_ns();
+            double sum = 0;
+            for (auto &c : candidates)
+                sum += heuristic(c.mapping, c.state->current_layer, c.state->future_layer, distance_mat, w.circuit);
+            long long elapsed = get_steady_ns() - start;
+            bench_sink = sum;
+            return elapsed; }));
+    }
+
+    if (selected("find_executable_gates"))
+    {
+        results.push_back(measure("find_executable_gates", w.snapshots.size(), reps, min_time_ns, [&]()
+                                  {
+            long long start = get_steady_ns();
+            size_t n = 0;
+            for (auto &s : w.snapshots)
+                n += find_executable_gates(s.mapping, s.current_layer, w.circuit, distance_mat).size();
+            long long elapsed = get_steady_ns() - start;
+            bench_sink = n;
+            return elapsed; }));
+    }
+
+    if (selected("pick_one_movement"))
+    {
+        std::vector<IdxType> mapping;
+        results.push_back(measure("pick_one_movement", swap_states.size(), reps, min_time_ns, [&]()
+                                  {
+            long long start = get_steady_ns();
+            IdxType sum = 0;
+            for (const RouterSnapshot *s : swap_states)
+            {
+                mapping = s->mapping;
+                sum += pick_one_movement(mapping, s->current_layer, s->future_layer, distance_mat, qubit_num, w.circuit, w.chip)[0];
+            }
+            long long elapsed = get_steady_ns() - start;
+            bench_sink = sum;
+            return elapsed; }));
+    }
+
+    if (selected("maintain_layer"))
+    {
+        // maintain_layer updates the DAG state in place, so each call is timed
+        // on its own and the entries it may touch are restored afterwards
+        const IdxType calls_per_state = 16;
+        std::vector<IdxType> gate_state, gate_dependency, qubit_state;
+        std::vector<IdxType> saved_state, saved_dependency, saved_qubits, touched;
+        std::vector<IdxType> current_layer, future_layer, updated_layer;
+        results.push_back(measure("maintain_layer", execute_states.size() * calls_per_state, reps, min_time_ns, [&]()
+                                  {
+            long long elapsed = 0;
+            for (const RouterSnapshot *s : execute_states)
+            {
+                w.restore(*s, gate_state, gate_dependency, qubit_state);
+                saved_state = gate_state;
+                saved_dependency = gate_dependency;
+                saved_qubits = qubit_state;
+                set<IdxType> execute = find_executable_gates(s->mapping, s->current_layer, w.circuit, distance_mat);
+                for (IdxType call = 0; call < calls_per_state; call++)
+                {
+                    current_layer = s->current_layer;
+                    future_layer = s->future_layer;
+                    long long start = get_steady_ns();
+                    maintain_layer(current_layer, execute, w.circuit, gate_state, w.following, qubit_state, gate_dependency,
+                                   updated_layer, future_layer);
+                    elapsed += get_steady_ns() - start;
+                    // executed gates and their followers
+                    touched.assign(execute.begin(), execute.end());
+                    for (IdxType g : execute)
+                        touched.insert(touched.end(), w.following[g].begin(), w.following[g].end());
+                    for (IdxType g : touched)
+                    {
+                        gate_state[g] = saved_state[g];
+                        gate_dependency[g] = saved_dependency[g];
+                    }
+                    qubit_state = saved_qubits;
+                }
+            }
+            bench_sink = updated_layer.size();
+            return elapsed; }));
+    }
+
+    if (selected("DAG_generator"))
+    {
+        IdxType n_gates = w.circuit.size();
+        results.push_back(measure("DAG_generator", 1, reps, min_time_ns, [&]()
+                                  {
+            std::vector<IdxType> gate_state(n_gates, 0), gate_dependency(n_gates, 2), qubit_state(qubit_num, 0);
+            std::vector<std::vector<IdxType>> following;
+            std::vector<IdxType> first_layer;
+            long long start = get_steady_ns();
+            DAG_generator(qubit_num, w.circuit, gate_state, qubit_state, gate_dependency, following, first_layer);
+            long long elapsed = get_steady_ns() - start;
+            bench_sink = first_layer.size();
+            return elapsed; }));
+    }
+
+    if (selected("floyd"))
+    {
+        results.push_back(measure("floyd", 1, reps, min_time_ns, [&]()
+                                  {
+            long long start = get_steady_ns();
+            std::vector<std::vector<IdxType>> distances = floyd(w.chip->adj_mat.size(), w.chip->adj_mat);
+            long long elapsed = get_steady_ns() - start;
+            bench_sink = distances[0].back();
+            return elapsed; }));
+    }
+    return results;
+}
+
+void print_help()
+{
+    std::cout << "Usage: ./router_microbench [options]" << std::endl;
+    std::cout << "Option              Description" << std::endl;
+    std::cout << "-states <path>      Recorded router states, default is "
+              << "../benchmark/data/bwt_n21_ibm_brisbane_states.json" << std::endl;
+    std::cout << "-filter <text>      Only run benchmarks whose name contains the text" << std::endl;
+    std::cout << "-reps <n>           Repetitions per benchmark, default is 7" << std::endl;
+    std::cout << "-min_time <ms>      Minimum time of a repetition, default is 100" << std::endl;
+    std::cout << "-o <path>           Write the results as JSON" << std::endl;
+    std::cout << "-record <path>      Record router states of a routing run to the path instead" << std::endl;
+    std::cout << "-i <path>           Circuit of the run, default is the one of the states "
+              << "(for -record: ../data/test_benchmark/bwt_n21.qasm)" << std::endl;
+    std::cout << "-c <path>           Device of the run, default is the one of the states "
+              << "(for -record: ../data/devices/ibm_brisbane.json)" << std::endl;
+    std::cout << "-seed <n>           For -record: seed of the router, default is 1" << std::endl;
+    std::cout << "-snapshots <n>      For -record: approximate number of states, default is 64" << std::endl;
+    std::cout << "-limited            For -record: restrict the device to the circuit width" << std::endl;
+    std::cout << "-h                  print the help function" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (cmdOptionExists(argv, argv + argc, "-h"))
+    {
+        print_help();
+        return 0;
+    }
+    try
+    {
+        std::string qasm_path, device_path;
+        if (cmdOptionExists(argv, argv + argc, "-i"))
+            qasm_path = getCmdOption(argv, argv + argc, "-i");
+        if (cmdOptionExists(argv, argv + argc, "-c"))
+            device_path = getCmdOption(argv, argv + argc, "-c");
+
+        if (cmdOptionExists(argv, argv + argc, "-record"))
+        {
+            IdxType seed = 1, n_snapshots = 64;
+            if (cmdOptionExists(argv, argv + argc, "-seed"))
+                seed = std::stoll(getCmdOption(argv, argv + argc, "-seed"));
+            if (cmdOptionExists(argv, argv + argc, "-snapshots"))
+                n_snapshots = std::max(1LL, std::stoll(getCmdOption(argv, argv + argc, "-snapshots")));
+            json states = record_router_states(qasm_path.empty() ? "../data/test_benchmark/bwt_n21.qasm" : qasm_path,
+                                               device_path.empty() ? "../data/devices/ibm_brisbane.json" : device_path,
+                                               cmdOptionExists(argv, argv + argc, "-limited"), seed, n_snapshots);
+            std::string out_path = getCmdOption(argv, argv + argc, "-record");
+            std::ofstream out(out_path);
+            out << states.dump() << std::endl;
+            if (!out)
+                throw std::runtime_error("Could not write router states to: " + out_path);
+            std::cout << "Recorded " << states["snapshots"].size() << " router states to " << out_path << std::endl;
+            return 0;
+        }
+
+        std::string states_path = "../benchmark/data/bwt_n21_ibm_brisbane_states.json";
+        IdxType reps = 7;
+        long long min_time_ms = 100;
+        std::string filter;
+        if (cmdOptionExists(argv, argv + argc, "-states"))
+            states_path = getCmdOption(argv, argv + argc, "-states");
+        if (cmdOptionExists(argv, argv + argc, "-reps"))
+            reps = std::max(1LL, std::stoll(getCmdOption(argv, argv + argc, "-reps")));
+        if (cmdOptionExists(argv, argv + argc, "-min_time"))
+            min_time_ms = std::max(0LL, std::stoll(getCmdOption(argv, argv + argc, "-min_time")));
+        if (cmdOptionExists(argv, argv + argc, "-filter"))
+            filter = getCmdOption(argv, argv + argc, "-filter");
+
+        RouterWorkload workload = load_router_workload(states_path, qasm_path, device_path);
+        std::cout << "Loaded " << workload.snapshots.size() << " router states over " << workload.circuit.size()
+                  << " 2-qubit gates on " << workload.chip->qubit_num << " qubits" << std::endl;
+        std::vector<MicroResult> results = run_microbenchmarks(workload, reps, min_time_ms * 1000000, filter);
+
+        json report = json::array();
+        std::cout << std::left << std::setw(24) << "benchmark" << std::right << std::setw(10) << "ops"
+                  << std::setw(16) << "median ns/op" << std::setw(14) << "min ns/op" << std::setw(10) << "spread"
+                  << std::endl;
+        for (auto &r : results)
+        {
+            json j = result_to_json(r);
+            report.push_back(j);
+            if (r.ns_per_op.empty())
+            {
+                std::cout << std::left << std::setw(24) << r.name << "  (no recorded states apply)" << std::endl;
+                continue;
+            }
+            std::cout << std::left << std::setw(24) << r.name << std::right << std::setw(10) << r.ops_per_batch
+                      << std::fixed << std::setprecision(1) << std::setw(16) << j["median_ns_per_op"].get<double>()
+                      << std::setw(14) << j["min_ns_per_op"].get<double>() << std::setw(9)
+                      << j["spread"].get<double>() * 100 << "%" << std::endl;
+        }
+        if (cmdOptionExists(argv, argv + argc, "-o"))
+        {
+            std::ofstream out(getCmdOption(argv, argv + argc, "-o"));
+            out << json({{"states", states_path}, {"reps", reps}, {"min_time_ms", min_time_ms}, {"results", report}}).dump(2)
+                << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -4,9 +4,12 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cstdint>
+#include <algorithm>
 
 #include "../nlomann/json.hpp"
 #include "graph.hpp"
+#include "../trace.hpp"
 #include <limits.h>
 
 using json = nlohmann::json;
@@ -22,7 +25,15 @@ namespace QASMTrans
     public:
         // Constructor
         Chip(IdxType num_qubits, const vector<vector<IdxType>> &adjacency_matrix, const vector<vector<IdxType>> &edges, const vector<vector<IdxType>> &dism)
-            : qubit_num(num_qubits), adj_mat(adjacency_matrix), edge_list(edges), distance_mat(dism) {}
+            : qubit_num(num_qubits), adj_mat(adjacency_matrix), edge_list(edges), distance_mat(dism)
+        {
+            // one entry of padding for the 32-bit gathers of the SWAP scoring
+            size_t n = distance_mat.size();
+            distance16.assign(n * n + 1, 0);
+            for (size_t i = 0; i < n; i++)
+                for (size_t j = 0; j < n; j++)
+                    distance16[i * n + j] = (uint16_t)std::min<IdxType>(distance_mat[i][j], UINT16_MAX);
+        }
 
     public:
         IdxType qubit_num;
@@ -30,9 +41,11 @@ namespace QASMTrans
         vector<vector<IdxType>> adj_mat;
         vector<vector<IdxType>> edge_list;
         vector<vector<IdxType>> distance_mat;
+        // distance_mat flattened row-major to uint16 (saturated), for the batch SWAP scoring
+        vector<uint16_t> distance16;
     };
 
-    vector<vector<IdxType>> floyd(IdxType node_num, vector<vector<IdxType>> &adj_mat)
+    inline vector<vector<IdxType>> floyd(IdxType node_num, vector<vector<IdxType>> &adj_mat)
     {
         vector<vector<IdxType>> distance_mat(node_num, vector<IdxType>(node_num));
         for (IdxType i = 0; i < node_num; ++i)
@@ -66,19 +79,13 @@ namespace QASMTrans
         return distance_mat;
     }
 
-    shared_ptr<Chip> constructChip(IdxType qubit_num, string backendpath, bool run_with_limit, IdxType debug_level)
+    // Build the chip from a parsed device configuration (see data/devices)
+    inline shared_ptr<Chip> constructChipFromConfig(IdxType qubit_num, const json &backend_config, bool run_with_limit, IdxType debug_level)
     {
-        // string path = "../data/device/" +backend_name+ ".json";
-        // string path = "/Users/lian599/local/QASMTrans/data/devices/" +backend_name+ ".json";
-        // string path = backend_name;
-
-        ifstream f(backendpath);
+        QASMTRANS_TRACE_SCOPE("construct_chip");
         bool limited_arc = run_with_limit;
-        if (f.fail())
-            throw logic_error("Device config file not found at " + backendpath);
-        json backend_config = json::parse(f);
         vector<pair<IdxType, IdxType>> pairs;
-        auto cx_coupling = backend_config["cx_coupling"];
+        auto cx_coupling = backend_config.at("cx_coupling");
         // Iterate over the array
         for (const auto &item : cx_coupling)
         {
@@ -131,9 +138,22 @@ namespace QASMTrans
         vector<vector<IdxType>> distance_mat(vertices.size(), vector<IdxType>(vertices.size(), 0));
         distance_mat = floyd(vertices.size(), adj_mat);
         shared_ptr<Chip> chip = make_shared<Chip>(distance_mat.size(), adj_mat, edge_list, distance_mat);
-        auto chip_qubit_num = backend_config["num_qubits"];
+        auto chip_qubit_num = backend_config.at("num_qubits");
         chip->chip_qubit_num = chip_qubit_num;
         return chip;
     }
 
+    inline shared_ptr<Chip> constructChip(IdxType qubit_num, string backendpath, bool run_with_limit, IdxType debug_level)
+    {
+        // string path = "../data/device/" +backend_name+ ".json";
+        // string path = "/Users/lian599/local/QASMTrans/data/devices/" +backend_name+ ".json";
+        // string path = backend_name;
+
+        ifstream f(backendpath);
+        if (f.fail())
+            throw logic_error("Device config file not found at " + backendpath);
+        json backend_config = json::parse(f);
+        return constructChipFromConfig(qubit_num, backend_config, run_with_limit, debug_level);
+    }
+
 }
\ No newline at end of file
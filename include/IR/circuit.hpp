@@ -6,10 +6,12 @@
 #include <memory>
 #include <cmath>
 #include <map>
+#include <stdexcept>
 
 #include "../QASMTransPrimitives.hpp"
 #include "../parser/parser_util.hpp"
 #include "gate.hpp"
+#include "parameter.hpp"
 
 using namespace std;
 
@@ -26,6 +28,8 @@ namespace QASMTrans
         std::shared_ptr<std::vector<Gate>> gates;
         map<string, creg> list_cregs;
         std::vector<IdxType> initial_mapping;
+        // symbolic angles, null unless the input has free parameters
+        std::shared_ptr<ParameterTable> params;
         Circuit(IdxType _n_qubits) : n_qubits(_n_qubits)
         {
             // Implementation of constructor
@@ -35,6 +39,26 @@ namespace QASMTrans
         IdxType num_qubits() { return n_qubits; };
         IdxType num_gates() { return gates->size(); };
         bool is_empty() { return gates->empty(); };
+        // Throw unless every gate acts on distinct qubits of the circuit
+        // (routing assumes both, e.g., for input from a server request)
+        void check_operands()
+        {
+            for (const Gate &g : *gates)
+            {
+                IdxType operands[3] = {g.qubit, g.ctrl, g.extra};
+                for (IdxType i = 0; i < 3; i++)
+                {
+                    if (operands[i] >= n_qubits || (operands[i] < 0 && operands[i] != -1))
+                        throw std::out_of_range(std::string("Qubit ") + std::to_string(operands[i]) + " of " + OP_NAMES[g.op_name] +
+                                                " is outside the " + std::to_string(n_qubits) + " qubits of the circuit");
+                    for (IdxType j = 0; j < i; j++)
+                    {
+                        if (operands[i] >= 0 && operands[i] == operands[j])
+                            throw std::invalid_argument(std::string("Qubit ") + std::to_string(operands[i]) + " is used twice by " + OP_NAMES[g.op_name]);
+                    }
+                }
+            }
+        }
         std::vector<Gate> get_gates()
         {
             return *gates;
@@ -42,6 +66,16 @@ namespace QASMTrans
         void set_gates(std::vector<Gate> new_gates)
         {
             gates = std::make_shared<std::vector<Gate>>(new_gates);
+            if (params)
+                params->invalidate();
+        }
+        bool is_parametric() { return params && !params->empty(); }
+        // Evaluate all parametric angles for the given parameter values
+        void bind(const std::vector<ValType> &values)
+        {
+            if (!is_parametric())
+                throw std::logic_error("Circuit has no free parameters to bind");
+            params->bind(values, *gates);
         }
         void set_creg(map<string, creg> list_cregs)
         {
@@ -67,6 +101,8 @@ namespace QASMTrans
         {
             // Implementation of clear function
             gates->clear();
+            if (params)
+                params->invalidate();
             // n_qubits = 0;
         }
         void reset()
@@ -428,9 +464,10 @@ namespace QASMTrans
             Gate G(OP::SWAP, qubit, ctrl, -1, 2);
             gates->push_back(G);
         }
-        void M(IdxType qubit) // default is pauli-Z
+        void M(IdxType qubit, IdxType cbit = -1) // default is pauli-Z
         {
             Gate G(OP::M, qubit);
+            G.cbit = cbit;
             gates->push_back(G);
         }
         void MA(IdxType repetition) // default is pauli-Z
@@ -443,6 +480,14 @@ namespace QASMTrans
             Gate G(OP::RESET, qubit);
             gates->push_back(G);
         }
+        void BARRIER(const vector<IdxType> &qubits)
+        {
+            for (IdxType qubit : qubits)
+            {
+                Gate G(OP::BARRIER, qubit, -1, -1, qubits.size());
+                gates->push_back(G);
+            }
+        }
         // ============================== Other Gate Definition ================================
         void U3(ValType theta, ValType phi, ValType lam, IdxType qubit)
         {
@@ -239,11 +239,16 @@ namespace QASMTrans
         RCCX,
         C3X,
         C3SQRTX,
+        /******************************************
+         * Barrier: an ordering constraint across
+         * several qubits. It is held as one BARRIER
+         * gate per qubit, consecutive in the gate
+         * list, each with n_qubits set to the width
+         * of the barrier.
+         ******************************************/
+        BARRIER,
     };
 
-    // need more
-    static const std::set<OP> varGates = {RX, RY, RZ, RI, U, CU};
-
     // Name of the gate for tracing purpose
     const char *const OP_NAMES[] = {
         // Basic
@@ -295,7 +300,140 @@ namespace QASMTrans
         "CCX",
         "RCCX",
         "C3X",
-        "C3SQRTX"};
+        "C3SQRTX",
+        "BARRIER"};
+
+    /***********************************************
+     * Per-OP gate properties, indexed by OP. Passes
+     * should branch on these tables rather than on
+     * OP_NAMES string comparisons.
+     ***********************************************/
+    // Number of qubits the gate acts on (0 for whole-register MA; each
+    // BARRIER gate covers one qubit of the barrier)
+    constexpr unsigned char OP_ARITY[] = {
+        1, 1, 1, 1, 1, 1, 1, 1,    // X .. TDG
+        1, 1, 1, 1, 1, 1, 1,       // RI .. U
+        2, 2, 2, 2, 2, 2, 2, 2,    // CX .. CTDG
+        2, 2, 2, 2, 2, 2, 2,       // CRI .. CU
+        2, 2, 2,                   // RXX, RYY, RZZ
+        1, 2, 1, 0, 1,             // ID, SWAP, M, MA, RESET
+        1, 2, 4, 2,                // C1, C2, C4, ZZ
+        3, 3, 3, 4, 4,             // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        1};                        // BARRIER
+
+    // Number of angle parameters (theta, phi, lam, gamma in order)
+    constexpr unsigned char OP_NUM_PARAMS[] = {
+        0, 0, 0, 0, 0, 0, 0, 0,    // X .. TDG
+        1, 1, 1, 1, 0, 1, 3,       // RI .. U
+        0, 0, 0, 0, 0, 0, 0, 0,    // CX .. CTDG
+        1, 1, 1, 1, 0, 1, 4,       // CRI .. CU
+        1, 1, 1,                   // RXX, RYY, RZZ
+        0, 0, 0, 0, 0,             // ID, SWAP, M, MA, RESET
+        0, 0, 0, 1,                // C1, C2, C4, ZZ
+        0, 0, 0, 0, 0,             // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        0};                        // BARRIER
+
+    // Inverse opcode; -1 means the inverse is not in the OP set (or the op
+    // is not unitary). Rotations and phases map to themselves with negated
+    // angles; U(theta, phi, lam) maps to U(-theta, -lam, -phi) and
+    // CU(theta, phi, lam, gamma) to CU(-theta, -lam, -phi, -gamma), which
+    // swap phi and lam besides negating them.
+    constexpr int OP_INVERSE[] = {
+        X, Y, Z, H, SDG, S, TDG, T,                // X .. TDG
+        RI, RX, RY, RZ, -1, P, U,                  // RI .. U
+        CX, CY, CZ, CH, CSDG, CS, CTDG, CT,        // CX .. CTDG
+        CRI, CRX, CRY, CRZ, -1, CP, CU,            // CRI .. CU
+        RXX, RYY, RZZ,                             // RXX, RYY, RZZ
+        ID, SWAP, -1, -1, -1,                      // ID, SWAP, M, MA, RESET
+        -1, -1, -1, ZZ,                            // C1, C2, C4, ZZ
+        CSWAP, CCX, -1, C3X, -1,                   // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        -1};                                       // BARRIER
+
+    // The gate is its own inverse without changing any parameter
+    constexpr bool OP_SELF_INVERSE[] = {
+        true, true, true, true, false, false, false, false,   // X .. TDG
+        false, false, false, false, false, false, false,      // RI .. U
+        true, true, true, true, false, false, false, false,   // CX .. CTDG
+        false, false, false, false, false, false, false,      // CRI .. CU
+        false, false, false,                                  // RXX, RYY, RZZ
+        true, true, false, false, false,                      // ID, SWAP, M, MA, RESET
+        false, false, false, false,                           // C1, C2, C4, ZZ
+        true, true, false, true, false,                       // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        false};                                               // BARRIER
+
+    // The gate matrix is diagonal in the computational basis
+    constexpr bool OP_IS_DIAGONAL[] = {
+        false, false, true, false, true, true, true, true,    // X .. TDG
+        true, false, false, true, false, true, false,         // RI .. U
+        false, false, true, false, true, true, true, true,    // CX .. CTDG
+        true, false, false, true, false, true, false,         // CRI .. CU
+        false, false, true,                                   // RXX, RYY, RZZ
+        true, false, false, false, false,                     // ID, SWAP, M, MA, RESET
+        false, false, false, true,                            // C1, C2, C4, ZZ
+        false, false, false, false, false,                    // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        false};                                               // BARRIER
+
+    // The gate is a Clifford gate for every parameter value
+    constexpr bool OP_IS_CLIFFORD[] = {
+        true, true, true, true, true, true, false, false,     // X .. TDG
+        false, false, false, false, true, false, false,       // RI .. U
+        true, true, true, false, false, false, false, false,  // CX .. CTDG
+        false, false, false, false, false, false, false,      // CRI .. CU
+        false, false, false,                                  // RXX, RYY, RZZ
+        true, true, false, false, false,                      // ID, SWAP, M, MA, RESET
+        false, false, false, false,                           // C1, C2, C4, ZZ
+        false, false, false, false, false,                    // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        false};                                               // BARRIER
+
+    /***********************************************
+     * Commutation class of a gate restricted to one
+     * of its wires. A gate commutes with a CX if it
+     * is COMM_Z on the CX control wire and COMM_X on
+     * the CX target wire.
+     ***********************************************/
+    enum CommClass
+    {
+        COMM_NONE = 0, // commutes with neither Z nor X on this wire
+        COMM_Z = 1,    // diagonal on this wire
+        COMM_X = 2,    // commutes with X on this wire
+        COMM_ALL = 3   // identity on this wire
+    };
+
+    // Commutation class on the `qubit` wire
+    constexpr unsigned char OP_COMM_QUBIT[] = {
+        COMM_X, COMM_NONE, COMM_Z, COMM_NONE, COMM_Z, COMM_Z, COMM_Z, COMM_Z, // X .. TDG
+        COMM_Z, COMM_X, COMM_NONE, COMM_Z, COMM_X, COMM_Z, COMM_NONE,         // RI .. U
+        COMM_X, COMM_NONE, COMM_Z, COMM_NONE, COMM_Z, COMM_Z, COMM_Z, COMM_Z, // CX .. CTDG
+        COMM_Z, COMM_X, COMM_NONE, COMM_Z, COMM_X, COMM_Z, COMM_NONE,         // CRI .. CU
+        COMM_X, COMM_NONE, COMM_Z,                                            // RXX, RYY, RZZ
+        COMM_ALL, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE,                 // ID, SWAP, M, MA, RESET
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_Z,                              // C1, C2, C4, ZZ
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE,                // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        COMM_NONE};                                                           // BARRIER
+
+    // Commutation class on the `ctrl` wire (second qubit of RXX/RYY/RZZ/ZZ)
+    constexpr unsigned char OP_COMM_CTRL[] = {
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, // X .. TDG
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE,            // RI .. U
+        COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z,                         // CX .. CTDG
+        COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z, COMM_Z,                                 // CRI .. CU
+        COMM_X, COMM_NONE, COMM_Z,                                                              // RXX, RYY, RZZ
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE,                                  // ID, SWAP, M, MA, RESET
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_Z,                                                // C1, C2, C4, ZZ
+        COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE, COMM_NONE,                                  // CSWAP, CCX, RCCX, C3X, C3SQRTX
+        COMM_NONE};                                                                             // BARRIER
+
+    constexpr IdxType NUM_OPS = BARRIER + 1;
+    static_assert(sizeof(OP_NAMES) / sizeof(OP_NAMES[0]) == NUM_OPS, "OP_NAMES must cover every OP");
+    static_assert(sizeof(OP_ARITY) == NUM_OPS, "OP_ARITY must cover every OP");
+    static_assert(sizeof(OP_NUM_PARAMS) == NUM_OPS, "OP_NUM_PARAMS must cover every OP");
+    static_assert(sizeof(OP_INVERSE) / sizeof(OP_INVERSE[0]) == NUM_OPS, "OP_INVERSE must cover every OP");
+    static_assert(sizeof(OP_SELF_INVERSE) == NUM_OPS, "OP_SELF_INVERSE must cover every OP");
+    static_assert(sizeof(OP_IS_DIAGONAL) == NUM_OPS, "OP_IS_DIAGONAL must cover every OP");
+    static_assert(sizeof(OP_IS_CLIFFORD) == NUM_OPS, "OP_IS_CLIFFORD must cover every OP");
+    static_assert(sizeof(OP_COMM_QUBIT) == NUM_OPS, "OP_COMM_QUBIT must cover every OP");
+    static_assert(sizeof(OP_COMM_CTRL) == NUM_OPS, "OP_COMM_CTRL must cover every OP");
+
     /***********************************************
      * Gate Definition
      ***********************************************/
@@ -313,6 +451,12 @@ namespace QASMTrans
         ValType lam;
         ValType gamma = 0;
         IdxType repetition;
+        // Index into the circuit ParameterTable when the angles depend on
+        // circuit parameters, -1 otherwise
+        IdxType param_id = -1;
+        // Classical bit written by M: offset of the creg (in declaration
+        // order) plus the bit index, -1 if the gate writes no bit
+        IdxType cbit = -1;
 
         Gate(enum OP _op_name,
              IdxType _qubit,
@@ -340,7 +484,10 @@ namespace QASMTrans
                               theta(g.theta),
                               phi(g.phi),
                               lam(g.lam),
-                              repetition(g.repetition) {}
+                              gamma(g.gamma),
+                              repetition(g.repetition),
+                              param_id(g.param_id),
+                              cbit(g.cbit) {}
         ~Gate() {}
 
         // for dumping the gate
@@ -375,7 +522,7 @@ namespace QASMTrans
             }
             else
             {
-                if (varGates.find(op_name) != varGates.end())
+                if (OP_NUM_PARAMS[op_name] > 0)
                 {
                     // this means the variable gate with all-zero angle. It is an identity gate
                     return "";
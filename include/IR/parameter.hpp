@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+#include "../QASMTransPrimitives.hpp"
+#include "gate.hpp"
+
+namespace QASMTrans
+{
+    /***********************************************
+     * Affine expression over circuit parameters:
+     *   offset + sum(coef * symbol)
+     * Every angle produced by the transpiler passes
+     * is affine in the input angles, so symbolic
+     * angles can be carried through as this form.
+     ***********************************************/
+    struct AffineExpr
+    {
+        ValType offset = 0;
+        std::vector<std::pair<IdxType, ValType>> terms; // (symbol index, coefficient)
+
+        AffineExpr(ValType _offset = 0) : offset(_offset) {}
+
+        static AffineExpr symbol(IdxType idx)
+        {
+            AffineExpr e;
+            e.terms.push_back({idx, 1.0});
+            return e;
+        }
+        bool is_constant() const { return terms.empty(); }
+        ValType evaluate(const std::vector<ValType> &values) const
+        {
+            ValType v = offset;
+            for (const auto &t : terms)
+                v += t.second * values[t.first];
+            return v;
+        }
+        // this += scale * other
+        void add_scaled(const AffineExpr &other, ValType scale)
+        {
+            offset += scale * other.offset;
+            for (const auto &t : other.terms)
+            {
+                bool merged = false;
+                for (auto &mine : terms)
+                {
+                    if (mine.first == t.first)
+                    {
+                        mine.second += scale * t.second;
+                        merged = true;
+                        break;
+                    }
+                }
+                if (!merged)
+                    terms.push_back({t.first, scale * t.second});
+            }
+        }
+    };
+
+    // Angle slots of a gate in the order theta, phi, lam, gamma
+    const IdxType NUM_ANGLE_SLOTS = 4;
+    using GateAngleExpr = std::array<AffineExpr, NUM_ANGLE_SLOTS>;
+
+    inline ValType &angle_slot(Gate &g, IdxType slot)
+    {
+        switch (slot)
+        {
+        case 0:
+            return g.theta;
+        case 1:
+            return g.phi;
+        case 2:
+            return g.lam;
+        default:
+            return g.gamma;
+        }
+    }
+
+    /***********************************************
+     * Circuit parameters (symbols) and the symbolic
+     * angles of the gates that depend on them. A gate
+     * with param_id >= 0 takes its angles from
+     * exprs[param_id].
+     ***********************************************/
+    class ParameterTable
+    {
+    public:
+        std::vector<std::string> symbols;
+        std::vector<GateAngleExpr> exprs;
+        // current binding, all zero until bind() is called
+        std::vector<ValType> values;
+
+        IdxType num_symbols() const { return symbols.size(); }
+        bool empty() const { return exprs.empty(); }
+
+        IdxType symbol_index(const std::string &name, bool create)
+        {
+            for (size_t i = 0; i < symbols.size(); i++)
+                if (symbols[i] == name)
+                    return i;
+            if (!create)
+                return -1;
+            symbols.push_back(name);
+            values.push_back(0);
+            return symbols.size() - 1;
+        }
+        IdxType add_expr(const GateAngleExpr &expr)
+        {
+            exprs.push_back(expr);
+            invalidate();
+            return exprs.size() - 1;
+        }
+        void clear_exprs()
+        {
+            exprs.clear();
+            invalidate();
+        }
+        // Must be called whenever the gate list holding param_id changes
+        void invalidate() { compiled = false; }
+        // Set the angles of all parametric gates for the given symbol values.
+        // The first call after the gate list changes builds a flat slot table;
+        // every later call is one sweep over that table.
+        void bind(const std::vector<ValType> &new_values, std::vector<Gate> &gates)
+        {
+            if ((IdxType)new_values.size() != num_symbols())
+                throw std::invalid_argument("Expected " + std::to_string(num_symbols()) +
+                                            " parameter values, got " + std::to_string(new_values.size()));
+            values = new_values;
+            if (!compiled)
+                compile(gates);
+            IdxType n_slots = slot_gate.size();
+            slot_value.resize(n_slots);
+            for (IdxType s = 0; s < n_slots; s++)
+            {
+                ValType v = slot_offset[s];
+                for (IdxType k = term_start[s]; k < term_start[s + 1]; k++)
+                    v += term_coef[k] * values[term_symbol[k]];
+                slot_value[s] = v;
+            }
+            for (IdxType s = 0; s < n_slots; s++)
+                angle_slot(gates[slot_gate[s]], slot_field[s]) = slot_value[s];
+        }
+
+    private:
+        // flattened (structure-of-arrays) form of the symbolic slots
+        bool compiled = false;
+        std::vector<IdxType> slot_gate;
+        std::vector<IdxType> slot_field;
+        std::vector<ValType> slot_offset;
+        std::vector<IdxType> term_start;
+        std::vector<IdxType> term_symbol;
+        std::vector<ValType> term_coef;
+        std::vector<ValType> slot_value;
+
+        void compile(const std::vector<Gate> &gates)
+        {
+            slot_gate.clear();
+            slot_field.clear();
+            slot_offset.clear();
+            term_symbol.clear();
+            term_coef.clear();
+            term_start.assign(1, 0);
+            for (size_t i = 0; i < gates.size(); i++)
+            {
+                if (gates[i].param_id < 0)
+                    continue;
+                const GateAngleExpr &expr = exprs[gates[i].param_id];
+                for (IdxType slot = 0; slot < NUM_ANGLE_SLOTS; slot++)
+                {
+                    if (expr[slot].is_constant())
+                        continue;
+                    slot_gate.push_back(i);
+                    slot_field.push_back(slot);
+                    slot_offset.push_back(expr[slot].offset);
+                    for (const auto &t : expr[slot].terms)
+                    {
+                        term_symbol.push_back(t.first);
+                        term_coef.push_back(t.second);
+                    }
+                    term_start.push_back(term_symbol.size());
+                }
+            }
+            compiled = true;
+        }
+    };
+}
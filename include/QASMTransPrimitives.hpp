@@ -18,7 +18,7 @@ static const unsigned __int64 epoch = ((unsigned __int64)116444736000000000ULL);
  * Note: this function is not for Win32 high precision timing purpose. See
  * elapsed_time().
  */
-int
+inline int
 gettimeofday(struct timeval* tp, struct timezone* tzp)
 {
     FILETIME    file_time;
@@ -38,8 +38,14 @@ gettimeofday(struct timeval* tp, struct timezone* tzp)
 
 #else
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fstream>
 #endif
 
+#include <atomic>
+#include <chrono>
+
 /* Constant value of PI */
 #define PI 3.14159265358979323846
 
@@ -75,4 +81,74 @@ namespace QASMTrans
         double start;
         double stop;
     } cpu_timer;
+
+    /***********************************************
+     * Monotonic nanosecond timer for measurements
+     * reported in machine-readable form
+     ***********************************************/
+    inline long long get_steady_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    typedef struct Steady_Timer
+    {
+        Steady_Timer() { start = stop = 0; }
+        void start_timer() { start = get_steady_ns(); }
+        void stop_timer() { stop = get_steady_ns(); }
+        long long measure_ns() { return stop - start; }
+        double measure() { return (stop - start) * 1e-6; }
+        long long start;
+        long long stop;
+    } steady_timer;
+
+    /***********************************************
+     * Heap allocation counters. They are only
+     * incremented when the executable replaces the
+     * global operator new (see src/qasmtrans.cpp).
+     ***********************************************/
+    struct AllocationCounters
+    {
+        std::atomic<long long> count{0};
+        std::atomic<long long> bytes{0};
+    };
+    inline AllocationCounters &allocation_counters()
+    {
+        static AllocationCounters counters;
+        return counters;
+    }
+
+    /***********************************************
+     * Process memory in KB, 0 where unsupported
+     ***********************************************/
+    // Resident set size now
+    inline long long current_rss_kb()
+    {
+#if defined(__linux__)
+        long long pages_total = 0, pages_resident = 0;
+        std::ifstream statm("/proc/self/statm");
+        if (!(statm >> pages_total >> pages_resident))
+            return 0;
+        return pages_resident * (long long)sysconf(_SC_PAGESIZE) / 1024;
+#else
+        return 0;
+#endif
+    }
+    // Highest resident set size so far
+    inline long long peak_rss_kb()
+    {
+#if defined(_MSC_VER)
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    }
 } // namespace QASMTrans
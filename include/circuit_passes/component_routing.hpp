@@ -0,0 +1,358 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <functional>
+
+#include "../QASMTransPrimitives.hpp"
+
+#include "../IR/gate.hpp"
+#include "../IR/circuit.hpp"
+#include "../IR/chip.hpp"
+#include "../run_control.hpp"
+#include "routing_options.hpp"
+#include "routing_mapping.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+/***********************************************
+ * Routing of independent subcircuits in parallel.
+ *
+ * The logical qubits are split into the connected
+ * components of the interaction graph (qubits
+ * linked by 2-qubit gates). Each component with
+ * 2-qubit gates gets a connected region of the
+ * chip, disjoint from the others, of its size plus
+ * a share of the spare qubits (less if the
+ * regions do not fit otherwise), and is routed by
+ * Routing on its own thread against the chip
+ * restricted to the region (distances within the
+ * region only). Qubits without 2-qubit gates take
+ * the physical qubits left over. The routed
+ * components are concatenated on the physical
+ * qubits of the whole chip.
+ *
+ * A barrier across components becomes one barrier
+ * per component. With a single component, or when
+ * the chip cannot fit disjoint connected regions,
+ * the circuit is routed as a whole by Routing.
+ ***********************************************/
+
+// Logical qubits of each connected component, components with 2-qubit
+// gates first, largest first; singleton components have no 2-qubit gates
+inline vector<vector<IdxType>> interaction_components(const vector<Gate> &gates, IdxType n_qubits)
+{
+    vector<IdxType> parent(n_qubits);
+    iota(parent.begin(), parent.end(), 0);
+    auto find_root = [&](IdxType q)
+    {
+        while (parent[q] != q)
+            q = parent[q] = parent[parent[q]];
+        return q;
+    };
+    vector<char> interacts(n_qubits, 0);
+    for (const Gate &g : gates)
+    {
+        if (OP_ARITY[g.op_name] == 2)
+        {
+            parent[find_root(g.ctrl)] = find_root(g.qubit);
+            interacts[g.ctrl] = interacts[g.qubit] = 1;
+        }
+    }
+    vector<vector<IdxType>> by_root(n_qubits);
+    for (IdxType q = 0; q < n_qubits; q++)
+        by_root[find_root(q)].push_back(q);
+    vector<vector<IdxType>> components;
+    for (auto &members : by_root)
+    {
+        if (!members.empty())
+            components.push_back(members);
+    }
+    stable_sort(components.begin(), components.end(), [&](const vector<IdxType> &a, const vector<IdxType> &b)
+                {
+                    if (interacts[a[0]] != interacts[b[0]])
+                        return interacts[a[0]] > interacts[b[0]];
+                    return a.size() > b.size(); });
+    return components;
+}
+
+// Disjoint connected regions (physical qubits) of at least sizes[i] and at
+// most targets[i] qubits, in order; empty if they do not fit. Each region
+// starts from the free qubit with the fewest free neighbors, so that regions
+// fill the chip from its edges, and grows by the free neighbor with the most
+// couplings into the region.
+inline vector<vector<IdxType>> allocate_regions(shared_ptr<Chip> chip, const vector<IdxType> &sizes, const vector<IdxType> &targets)
+{
+    IdxType n = chip->qubit_num;
+    vector<char> used(n, 0);
+    vector<vector<IdxType>> regions;
+    for (size_t c = 0; c < sizes.size(); c++)
+    {
+        vector<IdxType> seeds;
+        for (IdxType p = 0; p < n; p++)
+        {
+            if (!used[p])
+                seeds.push_back(p);
+        }
+        auto free_degree = [&](IdxType p)
+        {
+            IdxType d = 0;
+            for (IdxType q : chip->edge_list[p])
+                d += !used[q];
+            return d;
+        };
+        stable_sort(seeds.begin(), seeds.end(), [&](IdxType a, IdxType b)
+                    { return free_degree(a) < free_degree(b); });
+        vector<IdxType> region;
+        for (IdxType seed : seeds)
+        {
+            region.assign(1, seed);
+            vector<IdxType> links(n, 0); // couplings into the region
+            vector<char> in_region(n, 0);
+            in_region[seed] = 1;
+            for (IdxType q : chip->edge_list[seed])
+                links[q]++;
+            while ((IdxType)region.size() < targets[c])
+            {
+                IdxType next = -1;
+                for (IdxType p : region)
+                {
+                    for (IdxType q : chip->edge_list[p])
+                    {
+                        if (!used[q] && !in_region[q] && (next < 0 || links[q] > links[next] || (links[q] == links[next] && q < next)))
+                            next = q;
+                    }
+                }
+                if (next < 0)
+                    break;
+                region.push_back(next);
+                in_region[next] = 1;
+                for (IdxType q : chip->edge_list[next])
+                    links[q]++;
+            }
+            if ((IdxType)region.size() >= sizes[c])
+                break;
+            region.clear();
+        }
+        if (region.empty())
+            return {};
+        for (IdxType p : region)
+            used[p] = 1;
+        regions.push_back(region);
+    }
+    return regions;
+}
+
+// The chip restricted to the region: qubit i is region[i], distances are
+// shortest paths within the region
+inline shared_ptr<Chip> restrict_chip(shared_ptr<Chip> chip, const vector<IdxType> &region)
+{
+    IdxType r = region.size();
+    vector<IdxType> local(chip->qubit_num, -1);
+    for (IdxType i = 0; i < r; i++)
+        local[region[i]] = i;
+    vector<vector<IdxType>> adj_mat(r, vector<IdxType>(r, 0));
+    vector<vector<IdxType>> edge_list(r);
+    for (IdxType i = 0; i < r; i++)
+    {
+        for (IdxType q : chip->edge_list[region[i]])
+        {
+            if (local[q] >= 0)
+            {
+                adj_mat[i][local[q]] = 1;
+                edge_list[i].push_back(local[q]);
+            }
+        }
+    }
+    vector<vector<IdxType>> distance_mat = floyd(r, adj_mat);
+    shared_ptr<Chip> sub_chip = make_shared<Chip>(r, adj_mat, edge_list, distance_mat);
+    sub_chip->chip_qubit_num = r;
+    return sub_chip;
+}
+
+// Run task(0) ... task(n_tasks - 1) on up to n_threads threads (0: all
+// cores), in order of index; the first exception is rethrown after all ran
+inline void run_parallel(IdxType n_tasks, IdxType n_threads, const function<void(IdxType)> &task)
+{
+    vector<exception_ptr> errors(n_tasks);
+    atomic<IdxType> next_task(0);
+    auto worker = [&]()
+    {
+        for (IdxType i = next_task++; i < n_tasks; i = next_task++)
+        {
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                errors[i] = current_exception();
+            }
+        }
+    };
+    IdxType workers = min<IdxType>(n_tasks, n_threads > 0 ? n_threads : max(1u, thread::hardware_concurrency()));
+    vector<thread> threads;
+    for (IdxType t = 1; t < workers; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+    for (auto &error : errors)
+    {
+        if (error)
+            rethrow_exception(error);
+    }
+}
+
+// Route the components of the circuit in parallel (see above); n_threads 0:
+// all cores. stats sums the RoutingStats of the components; `components` is
+// set to the number of components routed apart, 1 if routed as a whole.
+inline void ComponentRouting(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_level, IdxType seed = -1,
+                             RoutingStats *stats = nullptr, const SabreOptions &options = SabreOptions(),
+                             const RunControl *control = nullptr, IdxType n_threads = 0, IdxType *components = nullptr)
+{
+    IdxType n_qubits = circuit->num_qubits();
+    vector<Gate> gate_info = circuit->get_gates();
+    vector<vector<IdxType>> parts = interaction_components(gate_info, n_qubits);
+    vector<IdxType> sizes, targets;
+    IdxType interacting = 0, singles = 0;
+    for (auto &part : parts)
+    {
+        if (part.size() > 1)
+        {
+            sizes.push_back(part.size());
+            interacting += part.size();
+        }
+        else
+            singles++;
+    }
+    // spare physical qubits, shared in proportion to the component sizes;
+    // halved until the regions fit
+    IdxType spare = chip->qubit_num - interacting - singles;
+    vector<vector<IdxType>> regions;
+    for (IdxType share = spare; sizes.size() > 1 && share >= 0 && regions.empty(); share = share > 0 ? share / 2 : -1)
+    {
+        targets.clear();
+        for (IdxType size : sizes)
+            targets.push_back(size + share * size / interacting);
+        regions = allocate_regions(chip, sizes, targets);
+    }
+    if (components)
+        *components = regions.empty() ? 1 : regions.size();
+    if (regions.empty())
+    {
+        Routing(circuit, chip, debug_level, seed, stats, options, control);
+        return;
+    }
+    if (debug_level > 0)
+        cout << "Routing " << regions.size() << " components apart, " << singles << " qubits without 2-qubit gates" << endl;
+
+    //^ split the gates: logical qubits relabelled within their component
+    IdxType n_parts = regions.size();
+    vector<IdxType> part_of(n_qubits, -1), local(n_qubits, -1);
+    for (IdxType c = 0; c < n_parts; c++)
+    {
+        for (IdxType i = 0; i < (IdxType)parts[c].size(); i++)
+        {
+            part_of[parts[c][i]] = c;
+            local[parts[c][i]] = i;
+        }
+    }
+    // qubits without 2-qubit gates are placed on the physical qubits left over
+    vector<char> used(chip->qubit_num, 0);
+    for (auto &region : regions)
+        for (IdxType p : region)
+            used[p] = 1;
+    vector<IdxType> placement(n_qubits, -1);
+    IdxType next_free = 0;
+    for (size_t c = n_parts; c < parts.size(); c++)
+    {
+        while (used[next_free])
+            next_free++;
+        placement[parts[c][0]] = next_free;
+        used[next_free] = 1;
+    }
+    vector<vector<Gate>> part_gates(n_parts);
+    vector<Gate> placed_gates;
+    for (size_t i = 0; i < gate_info.size(); i++)
+    {
+        const Gate &g = gate_info[i];
+        if (OP_ARITY[g.op_name] == 0)
+            continue;
+        size_t width = 1;
+        if (g.op_name == OP::BARRIER)
+        {
+            // the BARRIER gates of one barrier are consecutive, see WireSchedule
+            while (width < (size_t)g.n_qubits && i + width < gate_info.size() && gate_info[i + width].op_name == OP::BARRIER)
+                width++;
+        }
+        vector<IdxType> pieces(n_parts, 0);
+        for (size_t k = i; k < i + width; k++)
+        {
+            if (part_of[gate_info[k].qubit] >= 0)
+                pieces[part_of[gate_info[k].qubit]]++;
+        }
+        for (size_t k = i; k < i + width; k++)
+        {
+            Gate piece = gate_info[k];
+            IdxType c = part_of[piece.qubit];
+            if (c < 0)
+            {
+                piece.qubit = placement[piece.qubit];
+                if (piece.op_name == OP::BARRIER)
+                    piece.n_qubits = 1;
+                placed_gates.push_back(piece);
+                continue;
+            }
+            piece.qubit = local[piece.qubit];
+            if (OP_ARITY[piece.op_name] == 2)
+                piece.ctrl = local[piece.ctrl];
+            if (piece.op_name == OP::BARRIER)
+                piece.n_qubits = pieces[c];
+            part_gates[c].push_back(piece);
+        }
+        i += width - 1;
+    }
+
+    //^ route the components, largest first, on a pool of threads
+    vector<shared_ptr<Circuit>> part_circuits(n_parts);
+    vector<RoutingStats> part_stats(n_parts);
+    vector<RunControl> part_controls = worker_controls(control, n_parts);
+    for (IdxType c = 0; c < n_parts; c++)
+    {
+        part_circuits[c] = make_shared<Circuit>(parts[c].size());
+        part_circuits[c]->set_gates(part_gates[c]);
+    }
+    run_parallel(n_parts, n_threads, [&](IdxType c)
+                 { Routing(part_circuits[c], restrict_chip(chip, regions[c]), 0, seed, &part_stats[c], options,
+                           control ? &part_controls[c] : nullptr); });
+
+    //^ merge onto the physical qubits of the chip
+    vector<Gate> routed = placed_gates;
+    vector<IdxType> mapping = placement;
+    for (IdxType c = 0; c < n_parts; c++)
+    {
+        const vector<IdxType> &region = regions[c];
+        for (Gate g : *part_circuits[c]->gates)
+        {
+            g.qubit = region[g.qubit];
+            if (OP_ARITY[g.op_name] == 2)
+                g.ctrl = region[g.ctrl];
+            routed.push_back(g);
+        }
+        vector<IdxType> part_mapping = part_circuits[c]->get_mapping();
+        for (IdxType i = 0; i < (IdxType)parts[c].size(); i++)
+            mapping[parts[c][i]] = region[part_mapping[i]];
+        if (stats)
+            stats->merge(part_stats[c]);
+    }
+    join_worker_controls(control, part_controls);
+    set_routed_mapping(circuit, mapping);
+    circuit->set_gates(routed);
+}
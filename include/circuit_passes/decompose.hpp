@@ -1,32 +1,36 @@
 #pragma once
 
+#include <thread>
+
 #include "../QASMTransPrimitives.hpp"
 #include "../IR/gate.hpp"
+#include "../IR/circuit.hpp"
+#include "../trace.hpp"
 
 using namespace QASMTrans;
 using namespace std;
 
-Gate BasicRZ(ValType theta, IdxType qubit)
+inline Gate BasicRZ(ValType theta, IdxType qubit)
 {
     Gate G(OP::RZ, qubit, -1, -1, 1, theta);
     return G;
 }
-Gate BasicSX(IdxType qubit)
+inline Gate BasicSX(IdxType qubit)
 {
     Gate G(OP::SX, qubit);
     return G;
 }
-Gate BasicX(IdxType qubit)
+inline Gate BasicX(IdxType qubit)
 {
     Gate G(OP::X, qubit);
     return G;
 }
-Gate BasicCX(IdxType ctrl, IdxType qubit)
+inline Gate BasicCX(IdxType ctrl, IdxType qubit)
 {
     Gate G(OP::CX, qubit, ctrl, -1, 2);
     return G;
 }
-vector<Gate> decomposeHadamard(IdxType qubit)
+inline vector<Gate> decomposeHadamard(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     // Assuming the Gate constructor takes name, control qubit, target qubit, and angle (in that order)
@@ -42,7 +46,7 @@ vector<Gate> decomposeHadamard(IdxType qubit)
     decomposedGates.push_back(xgate);
     return decomposedGates;
 }
-vector<Gate> decomposeT(IdxType qubit)
+inline vector<Gate> decomposeT(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     // Applies the π/8 gate to a single qubit.
@@ -50,7 +54,7 @@ vector<Gate> decomposeT(IdxType qubit)
     decomposedGates.push_back(rzgate);
     return decomposedGates;
 }
-vector<Gate> decomposeTdg(IdxType qubit)
+inline vector<Gate> decomposeTdg(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     // Applies the π/8 gate to a single qubit.
@@ -58,14 +62,14 @@ vector<Gate> decomposeTdg(IdxType qubit)
     decomposedGates.push_back(rzgate);
     return decomposedGates;
 }
-vector<Gate> decomposeZ(IdxType qubit)
+inline vector<Gate> decomposeZ(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate rzgate = BasicRZ(PI, qubit);
     decomposedGates.push_back(rzgate);
     return decomposedGates;
 }
-vector<Gate> decomposeY(IdxType qubit)
+inline vector<Gate> decomposeY(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate sxgate = BasicSX(qubit);
@@ -77,7 +81,7 @@ vector<Gate> decomposeY(IdxType qubit)
     decomposedGates.push_back(sxgate);
     return decomposedGates;
 }
-vector<Gate> decomposeRx(ValType theta, IdxType qubit)
+inline vector<Gate> decomposeRx(ValType theta, IdxType qubit)
 {
     vector<Gate> decomposedGates;
     vector<Gate> decomposeh = decomposeHadamard(qubit);
@@ -87,7 +91,7 @@ vector<Gate> decomposeRx(ValType theta, IdxType qubit)
     decomposedGates.insert(decomposedGates.end(), decomposeh.begin(), decomposeh.end());
     return decomposedGates;
 }
-vector<Gate> decomposeP(ValType theta, IdxType qubit)
+inline vector<Gate> decomposeP(ValType theta, IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate rzgate = BasicRZ(theta, qubit);
@@ -95,7 +99,7 @@ vector<Gate> decomposeP(ValType theta, IdxType qubit)
     return decomposedGates;
 }
 
-vector<Gate> decomposeRI(ValType theta, IdxType qubit)
+inline vector<Gate> decomposeRI(ValType theta, IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate rzgate = BasicRZ(2 * theta, qubit);
@@ -104,7 +108,7 @@ vector<Gate> decomposeRI(ValType theta, IdxType qubit)
     decomposedGates.insert(decomposedGates.end(), decomposeh.begin(), decomposeh.end());
     return decomposedGates;
 }
-vector<Gate> decomposeRy(ValType theta, IdxType qubit)
+inline vector<Gate> decomposeRy(ValType theta, IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate sxgate = BasicSX(qubit);
@@ -116,21 +120,21 @@ vector<Gate> decomposeRy(ValType theta, IdxType qubit)
     decomposedGates.push_back(sxgate);
     return decomposedGates;
 }
-vector<Gate> decomposeS(IdxType qubit)
+inline vector<Gate> decomposeS(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate rzgate = BasicRZ(PI / 2, qubit);
     decomposedGates.push_back(rzgate);
     return decomposedGates;
 }
-vector<Gate> decomposeSdg(IdxType qubit)
+inline vector<Gate> decomposeSdg(IdxType qubit)
 {
     vector<Gate> decomposedGates;
     Gate rzgate = BasicRZ(-PI / 2, qubit);
     decomposedGates.push_back(rzgate);
     return decomposedGates;
 }
-vector<Gate> decomposeU(ValType theta, ValType phi, ValType lam, IdxType qubit)
+inline vector<Gate> decomposeU(ValType theta, ValType phi, ValType lam, IdxType qubit)
 {
     vector<Gate> decomposedGates;
     if (lam != 0)
@@ -144,7 +148,7 @@ vector<Gate> decomposeU(ValType theta, ValType phi, ValType lam, IdxType qubit)
 
     return decomposedGates;
 }
-vector<Gate> decomposeCZ(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCZ(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     vector<Gate> decomposery = decomposeHadamard(qubit);
@@ -153,7 +157,7 @@ vector<Gate> decomposeCZ(IdxType qubit, IdxType ctrl)
     decomposedGates.insert(decomposedGates.end(), decomposery.begin(), decomposery.end());
     return decomposedGates;
 }
-vector<Gate> decomposeCY(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCY(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(-PI / 2, qubit));
@@ -161,7 +165,7 @@ vector<Gate> decomposeCY(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCH(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCH(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(-PI, qubit));
@@ -172,7 +176,7 @@ vector<Gate> decomposeCH(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicSX(qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCS(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCS(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(PI / 4, ctrl));
@@ -182,7 +186,7 @@ vector<Gate> decomposeCS(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 4, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCSDG(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCSDG(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
@@ -199,7 +203,7 @@ vector<Gate> decomposeCSDG(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 4, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCT(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCT(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(PI / 8, ctrl));
@@ -209,7 +213,7 @@ vector<Gate> decomposeCT(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 8, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCTDG(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCTDG(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(-PI / 8, ctrl));
@@ -219,7 +223,7 @@ vector<Gate> decomposeCTDG(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(-PI / 8, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCRX(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCRX(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
@@ -234,7 +238,7 @@ vector<Gate> decomposeCRX(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeRXX(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeRXX(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
@@ -254,7 +258,7 @@ vector<Gate> decomposeRXX(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 2, ctrl));
     return decomposedGates;
 }
-vector<Gate> decomposeRYY(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeRYY(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicSX(qubit));
@@ -270,7 +274,7 @@ vector<Gate> decomposeRYY(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(-PI, ctrl));
     return decomposedGates;
 }
-vector<Gate> decomposeRZZ(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeRZZ(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicCX(ctrl, qubit));
@@ -278,7 +282,7 @@ vector<Gate> decomposeRZZ(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicCX(ctrl, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCRY(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCRY(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicSX(qubit));
@@ -293,7 +297,7 @@ vector<Gate> decomposeCRY(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicCX(ctrl, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCRZ(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCRZ(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     // cout<<"theta is"<<theta<<endl;
@@ -306,7 +310,7 @@ vector<Gate> decomposeCRZ(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicCX(ctrl, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCSX(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCSX(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
@@ -321,7 +325,7 @@ vector<Gate> decomposeCSX(IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(PI / 2, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCP(ValType theta, IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeCP(ValType theta, IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicRZ(theta / 2, ctrl));
@@ -331,7 +335,7 @@ vector<Gate> decomposeCP(ValType theta, IdxType qubit, IdxType ctrl)
     decomposedGates.push_back(BasicRZ(theta / 2, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeCU(ValType theta, ValType phi, ValType lam, ValType gamma,
+inline vector<Gate> decomposeCU(ValType theta, ValType phi, ValType lam, ValType gamma,
                          IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
@@ -355,7 +359,7 @@ vector<Gate> decomposeCU(ValType theta, ValType phi, ValType lam, ValType gamma,
     decomposedGates.push_back(BasicRZ(3 * PI + phi, qubit));
     return decomposedGates;
 }
-vector<Gate> decomposeSWAP(IdxType qubit, IdxType ctrl)
+inline vector<Gate> decomposeSWAP(IdxType qubit, IdxType ctrl)
 {
     vector<Gate> decomposedGates;
     Gate cxgate = BasicCX(ctrl, qubit);
@@ -375,7 +379,7 @@ vector<Gate> decomposeSWAP(IdxType qubit, IdxType ctrl)
 //   cx a,b; t a; tdg b;
 //   cx a,b;
 // }
-vector<Gate> decomposeCCX(IdxType a, IdxType b, IdxType c)
+inline vector<Gate> decomposeCCX(IdxType a, IdxType b, IdxType c)
 {
     vector<Gate> decomposedGates;
 
@@ -397,7 +401,7 @@ vector<Gate> decomposeCCX(IdxType a, IdxType b, IdxType c)
     return decomposedGates;
 }
 
-vector<Gate> decomposeRCCX(IdxType a, IdxType b, IdxType c)
+inline vector<Gate> decomposeRCCX(IdxType a, IdxType b, IdxType c)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(Gate(OP::U, c, -1, -1, 1, PI / 2, 0, PI));
@@ -411,7 +415,7 @@ vector<Gate> decomposeRCCX(IdxType a, IdxType b, IdxType c)
     decomposedGates.push_back(Gate(OP::U, c, -1, -1, 1, PI / 2, 0, PI));
     return decomposedGates;
 }
-vector<Gate> decomposeCSWAP(IdxType a, IdxType b, IdxType c)
+inline vector<Gate> decomposeCSWAP(IdxType a, IdxType b, IdxType c)
 {
     vector<Gate> decomposedGates;
     decomposedGates.push_back(BasicCX(c, b));
@@ -420,13 +424,13 @@ vector<Gate> decomposeCSWAP(IdxType a, IdxType b, IdxType c)
     decomposedGates.push_back(BasicCX(c, b));
     return decomposedGates;
 }
-void Decompose_three_to_two(shared_ptr<Circuit> circuit)
+inline void Decompose_three_to_two(shared_ptr<Circuit> circuit)
 {
     vector<Gate> circuit_gates = circuit->get_gates();
     vector<Gate> decomposedGates;
     for (Gate g : circuit_gates)
     {
-        if (g.n_qubits > 2)
+        if (OP_ARITY[g.op_name] > 2)
         {
             // std::cout<<"find three-qubit gates"<<std::endl;
             // print gate and control, target , extra qubit
@@ -434,17 +438,17 @@ void Decompose_three_to_two(shared_ptr<Circuit> circuit)
             // std::cout<<"gate control is"<<g.ctrl;
             // std::cout<<"gate target is"<<g.qubit;
             // std::cout<<"gate extra is"<<g.extra<<std::endl;
-            if (strcmp(OP_NAMES[g.op_name], "CSWAP") == 0)
+            if (g.op_name == OP::CSWAP)
             {
                 vector<Gate> Decomposed_gates = decomposeCSWAP(g.qubit, g.ctrl, g.extra);
                 decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
             }
-            else if (strcmp(OP_NAMES[g.op_name], "CCX") == 0)
+            else if (g.op_name == OP::CCX)
             {
                 vector<Gate> Decomposed_gates = decomposeCCX(g.qubit, g.ctrl, g.extra);
                 decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
             }
-            else if (strcmp(OP_NAMES[g.op_name], "RCCX") == 0)
+            else if (g.op_name == OP::RCCX)
             {
                 vector<Gate> Decomposed_gates = decomposeRCCX(g.qubit, g.ctrl, g.extra);
                 decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
@@ -474,325 +478,446 @@ void Decompose_three_to_two(shared_ptr<Circuit> circuit)
 
     return;
 }
-void Decompose(shared_ptr<Circuit> circuit, IdxType mode)
+// Decompose one gate into the IBM basis {RZ, SX, X, CX}, appending to `out`.
+// Gates without a decomposition rule are passed through and false is returned.
+inline bool decompose_to_ibm(const Gate &g, vector<Gate> &out)
 {
-    vector<Gate> circuit_gates = circuit->get_gates();
-    vector<Gate> decomposedGates;
-    for (Gate g : circuit_gates)
+    vector<Gate> Decomposed_gates;
+    switch (g.op_name)
     {
-        if (strcmp(OP_NAMES[g.op_name], "H") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeHadamard(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "T") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeT(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "Z") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeZ(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "TDG") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeTdg(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "Y") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeY(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "S") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeS(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "SDG") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeSdg(g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RX") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeRx(g.theta, g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RY") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeRy(g.theta, g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
+    case OP::H:
+        Decomposed_gates = decomposeHadamard(g.qubit);
+        break;
+    case OP::T:
+        Decomposed_gates = decomposeT(g.qubit);
+        break;
+    case OP::Z:
+        Decomposed_gates = decomposeZ(g.qubit);
+        break;
+    case OP::TDG:
+        Decomposed_gates = decomposeTdg(g.qubit);
+        break;
+    case OP::Y:
+        Decomposed_gates = decomposeY(g.qubit);
+        break;
+    case OP::S:
+        Decomposed_gates = decomposeS(g.qubit);
+        break;
+    case OP::SDG:
+        Decomposed_gates = decomposeSdg(g.qubit);
+        break;
+    case OP::RX:
+        Decomposed_gates = decomposeRx(g.theta, g.qubit);
+        break;
+    case OP::RY:
+        Decomposed_gates = decomposeRy(g.theta, g.qubit);
+        break;
+    case OP::RI: //^ double check RI gate later
+        Decomposed_gates = decomposeRI(g.theta, g.qubit);
+        break;
+    case OP::P:
+        Decomposed_gates = decomposeP(g.theta, g.qubit);
+        break;
+    case OP::U:
+        Decomposed_gates = decomposeU(g.theta, g.phi, g.lam, g.qubit);
+        break;
+    case OP::CZ:
+        Decomposed_gates = decomposeCZ(g.qubit, g.ctrl);
+        break;
+    case OP::CY:
+        Decomposed_gates = decomposeCY(g.qubit, g.ctrl);
+        break;
+    case OP::CH:
+        Decomposed_gates = decomposeCH(g.qubit, g.ctrl);
+        break;
+    case OP::CS:
+        Decomposed_gates = decomposeCS(g.qubit, g.ctrl);
+        break;
+    case OP::CSDG:
+        Decomposed_gates = decomposeCSDG(g.qubit, g.ctrl);
+        break;
+    case OP::CT:
+        Decomposed_gates = decomposeCT(g.qubit, g.ctrl);
+        break;
+    case OP::CTDG:
+        Decomposed_gates = decomposeCTDG(g.qubit, g.ctrl);
+        break;
+    case OP::CRX:
+        Decomposed_gates = decomposeCRX(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::CRY:
+        Decomposed_gates = decomposeCRY(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::CRZ:
+        Decomposed_gates = decomposeCRZ(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::CSX:
+        Decomposed_gates = decomposeCSX(g.qubit, g.ctrl);
+        break;
+    case OP::CP:
+        Decomposed_gates = decomposeCP(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::CU:
+        Decomposed_gates = decomposeCU(g.theta, g.phi, g.lam, g.gamma, g.qubit, g.ctrl);
+        break;
+    case OP::RXX:
+        Decomposed_gates = decomposeRXX(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::RYY:
+        Decomposed_gates = decomposeRYY(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::RZZ:
+        Decomposed_gates = decomposeRZZ(g.theta, g.qubit, g.ctrl);
+        break;
+    case OP::SWAP:
+        Decomposed_gates = decomposeSWAP(g.qubit, g.ctrl);
+        break;
+    case OP::RZ:
+        out.push_back(BasicRZ(g.theta, g.qubit));
+        return true;
+    case OP::CX:
+    case OP::SX:
+    case OP::X:
+    case OP::MA:
+    case OP::ID:
+    case OP::M:
+    case OP::RESET:
+    case OP::BARRIER:
+        out.push_back(g);
+        return true;
+    default:
+        out.push_back(g);
+        return false;
+    }
+    out.insert(out.end(), Decomposed_gates.begin(), Decomposed_gates.end());
+    return true;
+}
 
-        } //^ double check RI gate later
-        else if (strcmp(OP_NAMES[g.op_name], "RI") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeRI(g.theta, g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "P") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeP(g.theta, g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "U") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeU(g.theta, g.phi, g.lam, g.qubit);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CZ") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCZ(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CY") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCY(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CH") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCH(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CS") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCS(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CSDG") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCSDG(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CT") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCT(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CTDG") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCTDG(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CRX") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCRX(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CRY") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCRY(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CRZ") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCRZ(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CSX") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCSX(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CP") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCP(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CU") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeCU(g.theta, g.phi, g.lam, g.gamma, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RXX") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeRXX(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RYY") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeRYY(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RZZ") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeRZZ(g.theta, g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "SWAP") == 0)
-        {
-            vector<Gate> Decomposed_gates = decomposeSWAP(g.qubit, g.ctrl);
-            decomposedGates.insert(decomposedGates.end(), Decomposed_gates.begin(), Decomposed_gates.end());
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "CX") == 0)
-        {
-            decomposedGates.push_back(g);
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RZ") == 0)
-        {
-            // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-            decomposedGates.push_back(BasicRZ(g.theta, g.qubit));
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "SX") == 0)
-        {
-            decomposedGates.push_back(g);
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "X") == 0)
-        {
-            decomposedGates.push_back(g);
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "MA") == 0)
-        {
-            decomposedGates.push_back(g);
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "ID") == 0)
-        {
-            decomposedGates.push_back(g);
-        }
-        else if (strcmp(OP_NAMES[g.op_name], "RESET") == 0)
-        {
-            decomposedGates.push_back(g);
-        }
-        else
-        {
-            cout << "Error: cannot find this gate: " << endl;
-            cout << "Gate " << OP_NAMES[g.op_name] << " not supported" << endl;
-            decomposedGates.push_back(g);
-        }
+// Number of native gates lower_to_mode() writes for one IBM basis gate
+inline IdxType lowered_size(OP op, IdxType mode)
+{
+    if (mode < 1 || mode > 4)
+        return 1;
+    switch (op)
+    {
+    case OP::RZ:
+    case OP::SX:
+    case OP::X:
+    case OP::M:
+    case OP::RESET:
+    case OP::BARRIER:
+        return 1;
+    case OP::CX:
+        return mode == 3 ? 7 : (mode == 4 ? 3 : 5);
+    default:
+        return 0; // only RZ, SX, X, CX and non-unitary ops survive in non-IBM modes
     }
-    if (mode == 0)
+}
+
+// Lower one IBM basis gate to the native gates of `mode`, writing exactly
+// lowered_size(g.op_name, mode) gates starting at `out`
+inline void lower_to_mode(const Gate &g, IdxType mode, Gate *out)
+{
+    if (mode < 1 || mode > 4)
     {
-        circuit->set_gates(decomposedGates);
+        out[0] = g;
         return;
     }
-    else if (mode == 1)
+    switch (g.op_name)
     {
-        vector<Gate> decomposedGates_IonQ;
-        for (Gate g : decomposedGates)
-        {
-            if (strcmp(OP_NAMES[g.op_name], "RZ") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_IonQ.push_back(BasicRZ(g.theta, g.qubit));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "SX") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_IonQ.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, PI / 2));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "X") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_IonQ.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, PI));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "CX") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_IonQ.push_back(Gate(OP::RY, g.qubit, -1, -1, 1, PI / 2));
-                decomposedGates_IonQ.push_back(Gate(OP::RXX, g.qubit, g.ctrl, -1, 2, PI / 2));
-                decomposedGates_IonQ.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, -PI / 2));
-                decomposedGates_IonQ.push_back(Gate(OP::RX, g.ctrl, -1, -1, 1, -PI / 2));
-                decomposedGates_IonQ.push_back(Gate(OP::RY, g.qubit, -1, -1, 1, -PI / 2));
-            }
-        }
-        circuit->set_gates(decomposedGates_IonQ);
+    case OP::RZ:
+        out[0] = BasicRZ(g.theta, g.qubit);
+        return;
+    case OP::SX:
+        out[0] = mode == 2 ? Gate(OP::U, g.qubit, -1, -1, 1, PI / 2) : Gate(OP::RX, g.qubit, -1, -1, 1, PI / 2);
+        return;
+    case OP::X:
+        out[0] = mode == 2 ? Gate(OP::U, g.qubit, -1, -1, 1, PI) : Gate(OP::RX, g.qubit, -1, -1, 1, PI);
+        return;
+    case OP::M:
+    case OP::RESET:
+    case OP::BARRIER:
+        out[0] = g;
+        return;
+    case OP::CX:
+        break;
+    default:
         return;
     }
-    else if (mode == 2)
+    if (mode == 1) // IonQ
     {
-        vector<Gate> decomposedGates_Quantinuum;
-        for (Gate g : decomposedGates)
-        {
-            if (strcmp(OP_NAMES[g.op_name], "RZ") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Quantinuum.push_back(BasicRZ(g.theta, g.qubit));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "SX") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Quantinuum.push_back(Gate(OP::U, g.qubit, -1, -1, 1, PI / 2));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "X") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Quantinuum.push_back(Gate(OP::U, g.qubit, -1, -1, 1, PI));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "CX") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Quantinuum.push_back(Gate(OP::U, g.qubit, -1, -1, 1, -PI / 2, PI / 2));
-                decomposedGates_Quantinuum.push_back(Gate(OP::ZZ, g.qubit, g.ctrl, -1, 2, PI / 2));
-                decomposedGates_Quantinuum.push_back(Gate(OP::RZ, g.ctrl, -1, -1, 1, -PI / 2));
-                decomposedGates_Quantinuum.push_back(Gate(OP::U, g.qubit, -1, -1, 1, PI / 2, PI));
-                decomposedGates_Quantinuum.push_back(Gate(OP::RZ, g.ctrl, -1, -1, 1, -PI / 2));
-            }
-        }
-        circuit->set_gates(decomposedGates_Quantinuum);
+        out[0] = Gate(OP::RY, g.qubit, -1, -1, 1, PI / 2);
+        out[1] = Gate(OP::RXX, g.qubit, g.ctrl, -1, 2, PI / 2);
+        out[2] = Gate(OP::RX, g.qubit, -1, -1, 1, -PI / 2);
+        out[3] = Gate(OP::RX, g.ctrl, -1, -1, 1, -PI / 2);
+        out[4] = Gate(OP::RY, g.qubit, -1, -1, 1, -PI / 2);
+    }
+    else if (mode == 2) // Quantinuum
+    {
+        out[0] = Gate(OP::U, g.qubit, -1, -1, 1, -PI / 2, PI / 2);
+        out[1] = Gate(OP::ZZ, g.qubit, g.ctrl, -1, 2, PI / 2);
+        out[2] = Gate(OP::RZ, g.ctrl, -1, -1, 1, -PI / 2);
+        out[3] = Gate(OP::U, g.qubit, -1, -1, 1, PI / 2, PI);
+        out[4] = Gate(OP::RZ, g.ctrl, -1, -1, 1, -PI / 2);
+    }
+    else if (mode == 3) // Rigetti
+    {
+        out[0] = Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2);
+        out[1] = Gate(OP::RX, g.qubit, -1, -1, 1, -PI / 2);
+        out[2] = Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2);
+        out[3] = Gate(OP::CZ, g.qubit, g.ctrl, 2);
+        out[4] = Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2);
+        out[5] = Gate(OP::RX, g.qubit, -1, -1, 1, -PI / 2);
+        out[6] = Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2);
+    }
+    else // Quafu
+    {
+        out[0] = Gate(OP::H, g.qubit);
+        out[1] = Gate(OP::CZ, g.qubit, g.ctrl, 2);
+        out[2] = Gate(OP::H, g.qubit);
+    }
+}
+
+inline void report_unsupported_gate(const Gate &g)
+{
+    cout << "Error: cannot find this gate: " << endl;
+    cout << "Gate " << OP_NAMES[g.op_name] << " not supported" << endl;
+}
+
+inline void Decompose_serial(shared_ptr<Circuit> circuit, IdxType mode)
+{
+    const vector<Gate> &circuit_gates = *circuit->gates;
+    vector<Gate> decomposedGates;
+    for (const Gate &g : circuit_gates)
+    {
+        if (!decompose_to_ibm(g, decomposedGates))
+            report_unsupported_gate(g);
+    }
+    if (mode < 1 || mode > 4)
+    {
+        circuit->set_gates(decomposedGates);
         return;
     }
-    else if (mode == 3)
+    IdxType n_lowered = 0;
+    for (const Gate &g : decomposedGates)
+        n_lowered += lowered_size(g.op_name, mode);
+    vector<Gate> lowered_gates(n_lowered, Gate(OP::ID, -1));
+    IdxType pos = 0;
+    for (const Gate &g : decomposedGates)
     {
-        vector<Gate> decomposedGates_Rigetti;
-        for (Gate g : decomposedGates)
-        {
-            if (strcmp(OP_NAMES[g.op_name], "RZ") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Rigetti.push_back(BasicRZ(g.theta, g.qubit));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "SX") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Rigetti.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, PI / 2));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "X") == 0)
-            {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Rigetti.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, PI));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "CX") == 0)
+        lower_to_mode(g, mode, &lowered_gates[pos]);
+        pos += lowered_size(g.op_name, mode);
+    }
+    circuit->set_gates(lowered_gates);
+}
+
+// Output size of every OP for `mode`, obtained by decomposing a probe gate
+// with non-zero angles. Only U depends on its angles (see decomposed_size).
+inline vector<IdxType> decomposed_size_table(IdxType mode)
+{
+    vector<IdxType> size_table(NUM_OPS, 0);
+    vector<Gate> scratch;
+    for (IdxType op = 0; op < NUM_OPS; op++)
+    {
+        scratch.clear();
+        decompose_to_ibm(Gate(OP(op), 1, 0, 2, OP_ARITY[op], 1, 1, 1), scratch);
+        for (const Gate &b : scratch)
+            size_table[op] += lowered_size(b.op_name, mode);
+    }
+    return size_table;
+}
+
+inline IdxType decomposed_size(const Gate &g, IdxType mode, const vector<IdxType> &size_table)
+{
+    IdxType n = size_table[g.op_name];
+    // decomposeU skips RZ(lam) when lam is zero
+    if (g.op_name == OP::U && g.lam == 0)
+        n -= lowered_size(OP::RZ, mode);
+    return n;
+}
+
+// Parallel basis decomposition. The gate array is split into one chunk per
+// thread; each thread counts its output size, the chunk offsets are taken
+// from a prefix sum, and each thread then writes its gates directly into
+// the shared output array. The result is identical to Decompose_serial.
+inline void Decompose_parallel(shared_ptr<Circuit> circuit, IdxType mode, IdxType n_threads)
+{
+    const vector<Gate> &circuit_gates = *circuit->gates;
+    IdxType n_gates = circuit_gates.size();
+    n_threads = max(IdxType(1), min(n_threads, n_gates));
+    IdxType chunk = (n_gates + n_threads - 1) / n_threads;
+    vector<IdxType> size_table = decomposed_size_table(mode);
+    vector<IdxType> offsets(n_threads + 1, 0);
+    vector<thread> workers;
+    // unused when tracing is compiled out
+    [[maybe_unused]] const long long trace_circuit = QASMTRANS_TRACE_CURRENT_CIRCUIT();
+
+    //^ phase 1: per-chunk output size
+    for (IdxType t = 0; t < n_threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+            QASMTRANS_TRACE_CIRCUIT(trace_circuit);
+            QASMTRANS_TRACE_SCOPE("decompose_count");
+            IdxType count = 0;
+            for (IdxType i = t * chunk; i < min(n_gates, (t + 1) * chunk); i++)
+                count += decomposed_size(circuit_gates[i], mode, size_table);
+            offsets[t + 1] = count; });
+    }
+    for (auto &w : workers)
+        w.join();
+    workers.clear();
+    for (IdxType t = 0; t < n_threads; t++)
+        offsets[t + 1] += offsets[t];
+
+    //^ phase 2: write each chunk at its prefix-sum offset
+    vector<Gate> decomposedGates(offsets[n_threads], Gate(OP::ID, -1));
+    vector<vector<IdxType>> unsupported(n_threads);
+    for (IdxType t = 0; t < n_threads; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+            QASMTRANS_TRACE_CIRCUIT(trace_circuit);
+            QASMTRANS_TRACE_SCOPE("decompose_write");
+            vector<Gate> scratch;
+            IdxType pos = offsets[t];
+            for (IdxType i = t * chunk; i < min(n_gates, (t + 1) * chunk); i++)
             {
-                // cout<<"gate name is"<<OP_NAMES[g.op_name]<<"angle is"<<g.theta<<endl;
-                decomposedGates_Rigetti.push_back(Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2));
-                decomposedGates_Rigetti.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, -PI / 2));
-                decomposedGates_Rigetti.push_back(Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2));
-                decomposedGates_Rigetti.push_back(Gate(OP::CZ, g.qubit, g.ctrl, 2));
-                decomposedGates_Rigetti.push_back(Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2));
-                decomposedGates_Rigetti.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, -PI / 2));
-                decomposedGates_Rigetti.push_back(Gate(OP::RZ, g.qubit, -1, -1, 1, -PI / 2));
-            }
-        }
-        circuit->set_gates(decomposedGates_Rigetti);
-        return;
+                scratch.clear();
+                if (!decompose_to_ibm(circuit_gates[i], scratch))
+                    unsupported[t].push_back(i);
+                for (const Gate &b : scratch)
+                {
+                    lower_to_mode(b, mode, &decomposedGates[pos]);
+                    pos += lowered_size(b.op_name, mode);
+                }
+            } });
+    }
+    for (auto &w : workers)
+        w.join();
+    for (auto &chunk_unsupported : unsupported)
+        for (IdxType i : chunk_unsupported)
+            report_unsupported_gate(circuit_gates[i]);
+    circuit->set_gates(decomposedGates);
+}
+
+// Decompose and lower one gate, appending the native gates to `out`
+inline bool decompose_and_lower(const Gate &g, IdxType mode, vector<Gate> &out)
+{
+    vector<Gate> ibm_gates;
+    bool supported = decompose_to_ibm(g, ibm_gates);
+    for (const Gate &b : ibm_gates)
+    {
+        IdxType pos = out.size();
+        out.resize(pos + lowered_size(b.op_name, mode), Gate(OP::ID, -1));
+        lower_to_mode(b, mode, &out[pos]);
     }
-    else if (mode == 4)
+    return supported;
+}
+
+// Angles at which parametric gates are decomposed. They are non-zero so
+// that no angle-dependent gate (e.g., RZ(lam) of U) is dropped, which keeps
+// the output structure valid for every binding.
+const ValType PARAM_PROBE_ANGLES[NUM_ANGLE_SLOTS] = {0.3, 0.5, 0.7, 1.1};
+
+// The decomposition rules scale angles by small rationals (1/2, -1, 2, ...)
+inline ValType snap_coefficient(ValType coef)
+{
+    ValType snapped = round(coef * 4) / 4;
+    return fabs(coef - snapped) < 1e-9 ? snapped : coef;
+}
+
+// Basis decomposition of a circuit with symbolic angles. Gates without
+// param_id take the normal path. A parametric gate is decomposed at a probe
+// point and at a unit step along each angle slot; since every rule is affine
+// in the angles, the differences give the coefficients of each output angle.
+// The output angles are composed with the input ParameterTable entries, and
+// the current binding is re-applied at the end.
+inline void Decompose_parametric(shared_ptr<Circuit> circuit, IdxType mode)
+{
+    ParameterTable &table = *circuit->params;
+    vector<GateAngleExpr> input_exprs = table.exprs;
+    table.clear_exprs();
+    vector<Gate> lowered_gates;
+    vector<Gate> probe_out[NUM_ANGLE_SLOTS + 2];
+    for (const Gate &g : *circuit->gates)
     {
-        vector<Gate> decomposedGates_Quafu;
-        for (Gate g : decomposedGates)
+        if (g.param_id < 0)
         {
-            if (strcmp(OP_NAMES[g.op_name], "RZ") == 0)
-            {
-                decomposedGates_Quafu.push_back(BasicRZ(g.theta, g.qubit));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "SX") == 0)
-            {
-                decomposedGates_Quafu.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, PI / 2));
-            }
-            else if (strcmp(OP_NAMES[g.op_name], "X") == 0)
+            if (!decompose_and_lower(g, mode, lowered_gates))
+                report_unsupported_gate(g);
+            continue;
+        }
+        //^ probe k = 0: base point, k = 1..4: unit step on slot k-1, k = 5: check point
+        bool supported = true;
+        for (IdxType k = 0; k < NUM_ANGLE_SLOTS + 2; k++)
+        {
+            Gate probe(g);
+            for (IdxType slot = 0; slot < NUM_ANGLE_SLOTS; slot++)
             {
-                decomposedGates_Quafu.push_back(Gate(OP::RX, g.qubit, -1, -1, 1, PI));
+                ValType step = k == slot + 1 ? 1 : (k == NUM_ANGLE_SLOTS + 1 ? 0.25 * (slot + 1) : 0);
+                angle_slot(probe, slot) = PARAM_PROBE_ANGLES[slot] + step;
             }
-            else if (strcmp(OP_NAMES[g.op_name], "CX") == 0)
+            probe_out[k].clear();
+            supported = decompose_and_lower(probe, mode, probe_out[k]) && supported;
+            if (probe_out[k].size() != probe_out[0].size())
+                throw logic_error(string("Decomposition of parametric ") + OP_NAMES[g.op_name] +
+                                  " depends on its angles");
+        }
+        if (!supported)
+            report_unsupported_gate(g);
+        const GateAngleExpr &in = input_exprs[g.param_id];
+        for (size_t i = 0; i < probe_out[0].size(); i++)
+        {
+            Gate out = probe_out[0][i];
+            out.param_id = -1;
+            GateAngleExpr expr;
+            bool is_symbolic = false;
+            for (IdxType slot = 0; slot < NUM_ANGLE_SLOTS; slot++)
             {
-                decomposedGates_Quafu.push_back(Gate(OP::H, g.qubit));
-                decomposedGates_Quafu.push_back(Gate(OP::CZ, g.qubit, g.ctrl, 2));
-                decomposedGates_Quafu.push_back(Gate(OP::H, g.qubit));
+                ValType base = angle_slot(out, slot);
+                ValType check = base;
+                expr[slot] = AffineExpr(base);
+                for (IdxType j = 0; j < NUM_ANGLE_SLOTS; j++)
+                {
+                    ValType coef = snap_coefficient(angle_slot(probe_out[j + 1][i], slot) - base);
+                    check += coef * 0.25 * (j + 1);
+                    if (coef == 0)
+                        continue;
+                    expr[slot].offset -= coef * PARAM_PROBE_ANGLES[j];
+                    expr[slot].add_scaled(in[j], coef);
+                }
+                if (fabs(check - angle_slot(probe_out[NUM_ANGLE_SLOTS + 1][i], slot)) > 1e-9)
+                    throw logic_error(string("Decomposition of parametric ") + OP_NAMES[g.op_name] +
+                                      " is not affine in its angles");
+                if (expr[slot].is_constant())
+                    angle_slot(out, slot) = expr[slot].offset;
+                else
+                    is_symbolic = true;
             }
+            if (is_symbolic)
+                out.param_id = table.add_expr(expr);
+            lowered_gates.push_back(out);
         }
-        circuit->set_gates(decomposedGates_Quafu);
+    }
+    circuit->set_gates(lowered_gates);
+    if (circuit->is_parametric())
+        circuit->bind(table.values);
+}
+
+// Circuits smaller than this are decomposed serially
+const IdxType PARALLEL_DECOMPOSE_MIN_GATES = 1 << 16;
+
+inline void Decompose(shared_ptr<Circuit> circuit, IdxType mode)
+{
+    if (circuit->is_parametric())
+    {
+        Decompose_parametric(circuit, mode);
         return;
     }
+    IdxType n_threads = thread::hardware_concurrency();
+    if (n_threads > 1 && circuit->num_gates() >= PARALLEL_DECOMPOSE_MIN_GATES)
+        Decompose_parallel(circuit, mode, n_threads);
+    else
+        Decompose_serial(circuit, mode);
 }
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "../QASMTransPrimitives.hpp"
+#include "../IR/gate.hpp"
+#include "../IR/circuit.hpp"
+
+#include "decompose.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+// number of wires touched by the gate list (gates are on physical qubits after routing)
+inline IdxType num_wires(const vector<Gate> &gates)
+{
+    IdxType n_wires = 0;
+    for (const Gate &g : gates)
+    {
+        n_wires = max(n_wires, max(g.qubit, max(g.ctrl, g.extra)) + 1);
+    }
+    return n_wires;
+}
+
+// Expand each SWAP into three CX. The orientation is chosen so that the
+// outer CX pair matches a CX directly before or after the SWAP on the
+// same two wires, which lets the cancellation scan fuse them.
+inline vector<Gate> expand_swaps(const vector<Gate> &gates)
+{
+    IdxType n_gates = gates.size();
+    IdxType n_wires = num_wires(gates);
+    vector<IdxType> prev_gate(n_gates * 2, -1);
+    vector<IdxType> next_gate(n_gates * 2, -1);
+    vector<IdxType> last_on_wire(n_wires, -1);
+    for (IdxType i = 0; i < n_gates; i++)
+    {
+        const Gate &g = gates[i];
+        if (g.qubit >= 0)
+        {
+            prev_gate[2 * i] = last_on_wire[g.qubit];
+            last_on_wire[g.qubit] = i;
+        }
+        if (g.ctrl >= 0)
+        {
+            prev_gate[2 * i + 1] = last_on_wire[g.ctrl];
+            last_on_wire[g.ctrl] = i;
+        }
+    }
+    fill(last_on_wire.begin(), last_on_wire.end(), -1);
+    for (IdxType i = n_gates - 1; i >= 0; i--)
+    {
+        const Gate &g = gates[i];
+        if (g.qubit >= 0)
+        {
+            next_gate[2 * i] = last_on_wire[g.qubit];
+            last_on_wire[g.qubit] = i;
+        }
+        if (g.ctrl >= 0)
+        {
+            next_gate[2 * i + 1] = last_on_wire[g.ctrl];
+            last_on_wire[g.ctrl] = i;
+        }
+    }
+
+    vector<Gate> expanded;
+    expanded.reserve(n_gates);
+    for (IdxType i = 0; i < n_gates; i++)
+    {
+        const Gate &g = gates[i];
+        if (g.op_name != OP::SWAP)
+        {
+            expanded.push_back(g);
+            continue;
+        }
+        IdxType ctrl = g.ctrl;
+        IdxType qubit = g.qubit;
+        for (IdxType neighbor : {prev_gate[2 * i], next_gate[2 * i]})
+        {
+            if (neighbor == -1 || (neighbor != prev_gate[2 * i + 1] && neighbor != next_gate[2 * i + 1]))
+                continue;
+            const Gate &n = gates[neighbor];
+            if (n.op_name == OP::CX)
+            {
+                // decomposeSWAP emits CX(ctrl,qubit) CX(qubit,ctrl) CX(ctrl,qubit)
+                ctrl = n.ctrl;
+                qubit = n.qubit;
+                break;
+            }
+        }
+        vector<Gate> cx_gates = decomposeSWAP(qubit, ctrl);
+        expanded.insert(expanded.end(), cx_gates.begin(), cx_gates.end());
+    }
+    return expanded;
+}
+
+// One linear scan: cancel CX(c,t) ... CX(c,t) pairs whose intermediate
+// gates on c and t all commute with the CX. Removing a pair unblocks an
+// enclosing pair (e.g., CX(a,b) CX(b,a) CX(b,a) CX(a,b)): blockers and
+// pending CX are kept on stacks, so that the outer ones are restored when
+// an inner pair is removed. Returns the number of cancelled pairs.
+inline IdxType cancel_cx_pairs(vector<Gate> &gates)
+{
+    IdxType n_gates = gates.size();
+    IdxType n_wires = num_wires(gates);
+    // live gates on each wire that do not commute with Z (resp. X), in order;
+    // removed gates are popped when they reach the top
+    vector<vector<IdxType>> block_z(n_wires);
+    vector<vector<IdxType>> block_x(n_wires);
+    IdxType block_all = -1;
+    // live CX per (ctrl, target) pair, in order
+    unordered_map<IdxType, vector<IdxType>> pending_cx;
+    vector<bool> removed(n_gates, false);
+    IdxType n_cancelled = 0;
+
+    auto last_blocker = [&](vector<IdxType> &stack)
+    {
+        while (!stack.empty() && removed[stack.back()])
+            stack.pop_back();
+        return stack.empty() ? (IdxType)-1 : stack.back();
+    };
+    auto mark_wire = [&](IdxType wire, unsigned char comm, IdxType i)
+    {
+        if (!(comm & COMM_Z))
+            block_z[wire].push_back(i);
+        if (!(comm & COMM_X))
+            block_x[wire].push_back(i);
+    };
+
+    for (IdxType i = 0; i < n_gates; i++)
+    {
+        const Gate &g = gates[i];
+        if (g.qubit < 0)
+        {
+            // whole-register operations (e.g., MA) block everything
+            block_all = i;
+            continue;
+        }
+        if (g.op_name == OP::CX)
+        {
+            vector<IdxType> &pending = pending_cx[g.ctrl * n_wires + g.qubit];
+            if (!pending.empty())
+            {
+                IdxType j = pending.back();
+                if (j > block_all && j > last_blocker(block_z[g.ctrl]) && j > last_blocker(block_x[g.qubit]))
+                {
+                    removed[j] = true;
+                    removed[i] = true;
+                    pending.pop_back();
+                    n_cancelled++;
+                    continue;
+                }
+            }
+            pending.push_back(i);
+        }
+        mark_wire(g.qubit, OP_COMM_QUBIT[g.op_name], i);
+        if (g.ctrl >= 0)
+            mark_wire(g.ctrl, OP_COMM_CTRL[g.op_name], i);
+        if (g.extra >= 0)
+            mark_wire(g.extra, COMM_NONE, i);
+    }
+    if (n_cancelled > 0)
+    {
+        IdxType kept = 0;
+        for (IdxType i = 0; i < n_gates; i++)
+        {
+            if (!removed[i])
+                gates[kept++] = gates[i];
+        }
+        gates.erase(gates.begin() + kept, gates.end());
+    }
+    return n_cancelled;
+}
+
+// Commutation-aware CX cancellation. SWAPs are expanded into CX first so
+// that CX adjacent to a routing SWAP can be fused with it. Returns the
+// number of cancelled pairs.
+inline IdxType CX_cancellation(shared_ptr<Circuit> circuit, IdxType debug_level)
+{
+    vector<Gate> gates = expand_swaps(circuit->get_gates());
+    IdxType n_cancelled = cancel_cx_pairs(gates);
+    if (debug_level > 1)
+        cout << "Cancelled " << n_cancelled << " CX pairs" << endl;
+    circuit->set_gates(gates);
+    return n_cancelled;
+}
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "../QASMTransPrimitives.hpp"
+
+#include "../IR/gate.hpp"
+#include "../IR/circuit.hpp"
+#include "../IR/chip.hpp"
+
+#include "../nlomann/json.hpp"
+#include "../trace.hpp"
+#include "../run_control.hpp"
+
+#include "routing_mapping.hpp"
+#include "component_routing.hpp"
+#include "sliced_routing.hpp"
+#include "decompose.hpp"
+#include "remapping.hpp"
+#include "gate_cancellation.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+using json = nlohmann::json;
+
+/***********************************************
+ * Pass manager: transpilation is a pipeline of
+ * named passes looked up in a registry. A
+ * pipeline is given as a comma separated list of
+ * pass names, a preset name, or a JSON array of
+ * names (or {"passes": [...]}), and is checked
+ * before it runs: a pass may require others to
+ * run before it, and a pipeline routes at most
+ * once. Optional passes
+ * (optimizations the result does not depend on)
+ * are skipped once the deadline of the
+ * RunControl has passed.
+ ***********************************************/
+
+// Everything a pass may need besides the circuit
+struct PassContext
+{
+    shared_ptr<Chip> chip;
+    IdxType mode = 0;
+    IdxType debug_level = 0;
+    IdxType seed = -1;
+    SabreOptions sabre;
+    // deadline, cancellation and progress, if any
+    const RunControl *control = nullptr;
+    // pass-specific counters reported by the running pass
+    json counters = json::object();
+};
+
+using PassFunction = function<void(shared_ptr<Circuit>, PassContext &)>;
+
+struct PassInfo
+{
+    string name;
+    string description;
+    PassFunction run;
+    bool optional = false;
+    // passes that must run earlier in the pipeline
+    vector<string> prerequisites;
+    // maps the circuit onto the chip; a pipeline holds at most one such pass
+    bool routing = false;
+};
+
+// Measured effect of one pass on the circuit
+struct PassStats
+{
+    string name;
+    double time_ms = 0;
+    long long time_ns = 0;
+    IdxType gates_before = 0;
+    IdxType gates_after = 0;
+    long long rss_before_kb = 0;
+    long long rss_after_kb = 0;
+    long long peak_rss_kb = 0;
+    // process-wide heap allocations during the pass, 0 if not tracked
+    long long allocations = 0;
+    long long allocated_bytes = 0;
+    json counters = json::object();
+};
+
+inline json pass_stats_to_json(const PassStats &stats)
+{
+    return {{"name", stats.name},
+            {"time_ns", stats.time_ns},
+            {"gates_before", stats.gates_before},
+            {"gates_after", stats.gates_after},
+            {"rss_before_kb", stats.rss_before_kb},
+            {"rss_after_kb", stats.rss_after_kb},
+            {"peak_rss_kb", stats.peak_rss_kb},
+            {"allocations", stats.allocations},
+            {"allocated_bytes", stats.allocated_bytes},
+            {"counters", stats.counters}};
+}
+
+class PassRegistry
+{
+public:
+    static PassRegistry &instance()
+    {
+        static PassRegistry registry;
+        return registry;
+    }
+
+    // Register a pass; a pass with the same name is replaced
+    void register_pass(const string &name, const string &description, PassFunction run, bool optional = false,
+                       const vector<string> &prerequisites = {}, bool routing = false)
+    {
+        if (passes.find(name) == passes.end())
+            order.push_back(name);
+        passes[name] = {name, description, run, optional, prerequisites, routing};
+    }
+    bool has_pass(const string &name) const { return passes.find(name) != passes.end(); }
+    const PassInfo &get_pass(const string &name) const
+    {
+        auto it = passes.find(name);
+        if (it == passes.end())
+            throw std::invalid_argument("Unknown pass: " + name);
+        return it->second;
+    }
+    // Pass names in registration order
+    const vector<string> &pass_names() const { return order; }
+
+    void register_preset(const string &name, const vector<string> &pipeline) { presets[name] = pipeline; }
+    bool has_preset(const string &name) const { return presets.find(name) != presets.end(); }
+    const map<string, vector<string>> &preset_pipelines() const { return presets; }
+    const vector<string> &get_preset(const string &name) const { return presets.at(name); }
+
+private:
+    map<string, PassInfo> passes;
+    vector<string> order;
+    map<string, vector<string>> presets;
+
+    PassRegistry()
+    {
+        register_pass("three_to_two", "Decompose 3-qubit gates into 1- and 2-qubit gates",
+                      [](shared_ptr<Circuit> circuit, PassContext &)
+                      { Decompose_three_to_two(circuit); });
+        register_pass("remap", "Relabel logical qubits by gate count before routing",
+                      [](shared_ptr<Circuit> circuit, PassContext &)
+                      { Remap(circuit); }, true);
+        register_pass("routing", "SABRE routing and mapping onto the chip",
+                      [](shared_ptr<Circuit> circuit, PassContext &ctx)
+                      {
+                          RoutingStats routing_stats;
+                          if (ctx.sabre.time_slices > 1)
+                              SlicedRouting(circuit, ctx.chip, ctx.debug_level, ctx.seed, &routing_stats, ctx.sabre, ctx.control);
+                          else
+                              Routing(circuit, ctx.chip, ctx.debug_level, ctx.seed, &routing_stats, ctx.sabre, ctx.control);
+                          ctx.counters = routing_stats.to_json();
+                      },
+                      false, {"three_to_two"}, true);
+        register_pass("component_routing", "Routing of independent qubit groups on disjoint chip regions in parallel",
+                      [](shared_ptr<Circuit> circuit, PassContext &ctx)
+                      {
+                          RoutingStats routing_stats;
+                          IdxType components = 1;
+                          ComponentRouting(circuit, ctx.chip, ctx.debug_level, ctx.seed, &routing_stats, ctx.sabre, ctx.control, 0, &components);
+                          ctx.counters = routing_stats.to_json();
+                          ctx.counters["components"] = components;
+                      },
+                      false, {"three_to_two"}, true);
+        register_pass("cx_cancellation", "Commutation-aware CX cancellation",
+                      [](shared_ptr<Circuit> circuit, PassContext &ctx)
+                      { ctx.counters["cancelled_pairs"] = CX_cancellation(circuit, ctx.debug_level); }, true);
+        register_pass("decompose", "Decompose into the basis gates of the mode",
+                      [](shared_ptr<Circuit> circuit, PassContext &ctx)
+                      { Decompose(circuit, ctx.mode); }, false, {"three_to_two"});
+
+        register_preset("default", {"three_to_two", "routing", "cx_cancellation", "decompose"});
+        // no optimization, for latency-critical jobs
+        register_preset("fast", {"three_to_two", "routing", "decompose"});
+        // circuits of independent parts, e.g., batched jobs
+        register_preset("components", {"three_to_two", "component_routing", "cx_cancellation", "decompose"});
+    }
+};
+
+inline string trim_pass_name(const string &name)
+{
+    size_t first = name.find_first_not_of(" \t\r\n");
+    if (first == string::npos)
+        return "";
+    size_t last = name.find_last_not_of(" \t\r\n");
+    return name.substr(first, last - first + 1);
+}
+
+// Check the order of the passes: the passes each one requires run earlier,
+// and at most one pass routes (routing the routed circuit again breaks it)
+inline void check_pipeline(const vector<string> &pipeline)
+{
+    PassRegistry &registry = PassRegistry::instance();
+    string routed_by;
+    for (size_t i = 0; i < pipeline.size(); i++)
+    {
+        const PassInfo &pass = registry.get_pass(pipeline[i]);
+        for (const string &required : pass.prerequisites)
+        {
+            if (find(pipeline.begin(), pipeline.begin() + i, required) == pipeline.begin() + i)
+                throw std::invalid_argument("Pass " + pass.name + " requires " + required + " earlier in the pipeline");
+        }
+        if (pass.routing)
+        {
+            if (!routed_by.empty())
+                throw std::invalid_argument("Pipeline routes twice: " + routed_by + " and " + pass.name);
+            routed_by = pass.name;
+        }
+    }
+}
+
+// Expand preset names and check that every pass exists and the pipeline is valid
+inline vector<string> resolve_pipeline(const vector<string> &names)
+{
+    PassRegistry &registry = PassRegistry::instance();
+    vector<string> pipeline;
+    for (const string &name : names)
+    {
+        if (registry.has_preset(name))
+        {
+            const vector<string> &preset = registry.get_preset(name);
+            pipeline.insert(pipeline.end(), preset.begin(), preset.end());
+        }
+        else if (registry.has_pass(name))
+            pipeline.push_back(name);
+        else
+            throw std::invalid_argument("Unknown pass or pipeline: " + name);
+    }
+    check_pipeline(pipeline);
+    return pipeline;
+}
+
+inline vector<string> pipeline_from_json(const json &spec)
+{
+    const json &names = spec.is_object() ? spec.at("passes") : spec;
+    if (!names.is_array())
+        throw std::invalid_argument("Pipeline JSON must be an array of pass names or {\"passes\": [...]}");
+    vector<string> pipeline;
+    for (auto &name : names)
+        pipeline.push_back(name.get<string>());
+    return resolve_pipeline(pipeline);
+}
+
+// "fast", "three_to_two,routing,decompose", "[\"default\"]" or a path to a .json file
+inline vector<string> parse_pipeline(const string &spec)
+{
+    string text = trim_pass_name(spec);
+    if (text.size() > 5 && text.substr(text.size() - 5) == ".json")
+    {
+        ifstream f(text);
+        if (f.fail())
+            throw std::invalid_argument("Could not open pipeline file at: " + text);
+        return pipeline_from_json(json::parse(f));
+    }
+    if (!text.empty() && (text[0] == '[' || text[0] == '{'))
+        return pipeline_from_json(json::parse(text));
+    vector<string> names;
+    stringstream ss(text);
+    string name;
+    while (getline(ss, name, ','))
+    {
+        name = trim_pass_name(name);
+        if (!name.empty())
+            names.push_back(name);
+    }
+    return resolve_pipeline(names);
+}
+
+inline string pipeline_to_string(const vector<string> &pipeline)
+{
+    string text;
+    for (size_t i = 0; i < pipeline.size(); i++)
+        text += (i ? "," : "") + pipeline[i];
+    return text;
+}
+
+inline const vector<string> &default_pipeline()
+{
+    return PassRegistry::instance().get_preset("default");
+}
+
+// Run the passes in order, measuring each one
+inline vector<PassStats> run_pipeline(shared_ptr<Circuit> circuit, const vector<string> &pipeline, PassContext &ctx)
+{
+    PassRegistry &registry = PassRegistry::instance();
+    vector<PassStats> all_stats;
+    for (size_t i = 0; i < pipeline.size(); i++)
+    {
+        const PassInfo &pass = registry.get_pass(pipeline[i]);
+        PassStats stats;
+        stats.name = pass.name;
+        stats.gates_before = circuit->num_gates();
+        if (ctx.control)
+        {
+            ctx.control->check_cancelled();
+            ctx.control->pass_start_ns = get_steady_ns();
+            if (pass.optional && ctx.control->past_deadline())
+            {
+                stats.gates_after = stats.gates_before;
+                stats.counters["skipped"] = "deadline";
+                if (ctx.debug_level > 0)
+                    cout << "STEP-" << i + 1 << ". " << pass.name << " skipped: past the deadline" << endl;
+                all_stats.push_back(stats);
+                continue;
+            }
+        }
+        stats.rss_before_kb = current_rss_kb();
+        AllocationCounters &allocs = allocation_counters();
+        long long allocations_before = allocs.count;
+        long long allocated_bytes_before = allocs.bytes;
+        ctx.counters = json::object();
+        QASMTRANS_TRACE_SCOPE(pass.name.c_str());
+        steady_timer pass_timer;
+        pass_timer.start_timer();
+        pass.run(circuit, ctx);
+        pass_timer.stop_timer();
+        stats.time_ns = pass_timer.measure_ns();
+        stats.time_ms = pass_timer.measure();
+        stats.allocations = allocs.count - allocations_before;
+        stats.allocated_bytes = allocs.bytes - allocated_bytes_before;
+        stats.counters = std::move(ctx.counters);
+        stats.gates_after = circuit->num_gates();
+        stats.rss_after_kb = current_rss_kb();
+        stats.peak_rss_kb = peak_rss_kb();
+        if (ctx.debug_level > 0)
+        {
+            cout << "STEP-" << i + 1 << ". " << pass.name << " time: " << stats.time_ms << "ms"
+                 << ", gates: " << stats.gates_before << " -> " << stats.gates_after
+                 << ", rss: " << stats.rss_after_kb / 1024 << "MB ("
+                 << (stats.rss_after_kb >= stats.rss_before_kb ? "+" : "")
+                 << stats.rss_after_kb - stats.rss_before_kb << "KB)" << endl;
+        }
+        if (ctx.debug_level > 1 && pass.name == "routing")
+            cout << circuit->to_string() << endl;
+        all_stats.push_back(stats);
+        if (ctx.control)
+            ctx.control->report("pipeline", i + 1, pipeline.size(), -1, true);
+    }
+    return all_stats;
+}
@@ -7,7 +7,7 @@
 using namespace QASMTrans;
 using namespace std;
 
-void Remap(shared_ptr<Circuit> circuit)
+inline void Remap(shared_ptr<Circuit> circuit)
 {
     vector<IdxType> initial_mapping = circuit->get_mapping();
     vector<Gate> gate_info = circuit->get_gates();
@@ -19,42 +19,31 @@ void Remap(shared_ptr<Circuit> circuit)
         gateCountVec[i].first = i;
         gateCountVec[i].second = 0;
     }
-    for (auto g : gate_info)
+    // every operand of the gate, including the third one of CCX-like gates
+    auto count_qubit = [&](IdxType qubit)
     {
-        if (g.ctrl != -1)
+        auto it = find_if(gateCountVec.begin(), gateCountVec.end(),
+                          [qubit](const pair<IdxType, IdxType> &element)
+                          {
+                              return element.first == qubit;
+                          });
+        if (it != gateCountVec.end())
         {
-            int qubit = g.ctrl;
-            auto it = find_if(gateCountVec.begin(), gateCountVec.end(),
-                              [qubit](const pair<IdxType, IdxType> &element)
-                              {
-                                  return element.first == qubit;
-                              });
-            if (it != gateCountVec.end())
-            {
-                it->second++;
-            }
-            else
-            {
-                gateCountVec.push_back({qubit, 1});
-            }
+            it->second++;
         }
-        if (g.qubit != -1)
+        else
         {
-            int qubit = g.qubit;
-            auto it = find_if(gateCountVec.begin(), gateCountVec.end(),
-                              [qubit](const pair<IdxType, IdxType> &element)
-                              {
-                                  return element.first == qubit;
-                              });
-            if (it != gateCountVec.end())
-            {
-                it->second++;
-            }
-            else
-            {
-                gateCountVec.push_back({qubit, 1});
-            }
+            gateCountVec.push_back({qubit, 1});
         }
+    };
+    for (auto g : gate_info)
+    {
+        if (g.ctrl != -1)
+            count_qubit(g.ctrl);
+        if (g.qubit != -1)
+            count_qubit(g.qubit);
+        if (g.extra != -1)
+            count_qubit(g.extra);
     }
     sort(gateCountVec.begin(), gateCountVec.end(),
          [](const pair<IdxType, IdxType> &a, const pair<IdxType, int> &b)
@@ -86,6 +75,10 @@ void Remap(shared_ptr<Circuit> circuit)
         {
             g.qubit = new_mapping[g.qubit];
         }
+        if (g.extra != -1)
+        {
+            g.extra = new_mapping[g.extra];
+        }
     }
     //! update the newmapping to logical if initial mapping size is not 0
     vector<IdxType> new_mapping_logical(n_qubits);
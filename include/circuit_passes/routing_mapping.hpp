@@ -2,6 +2,7 @@
 
 #include <string>
 #include <random>
+#include <functional>
 
 #include "../QASMTransPrimitives.hpp"
 
@@ -9,6 +10,11 @@
 #include "../IR/circuit.hpp"
 #include "../IR/chip.hpp"
 #include "../IR/graph.hpp"
+#include "routing_options.hpp"
+#include "swap_scoring.hpp"
+#include "swap_search.hpp"
+#include "../trace.hpp"
+#include "../run_control.hpp"
 
 #include "../nlomann/json.hpp"
 
@@ -16,8 +22,119 @@ using namespace QASMTrans;
 using namespace std;
 using json = nlohmann::json;
 
+// Router state at the start of one step of a SABRE round (layer_index is 0 at
+// the start of every round); see RoutingStats::observer
+struct RouterStateView
+{
+    IdxType step;
+    const vector<IdxType> &mapping;
+    const vector<IdxType> &current_layer;
+    const vector<IdxType> &future_layer;
+    const vector<IdxType> &gate_state;
+    const vector<vector<IdxType>> &circuit;
+};
+
+// Counters collected by Routing over all its SABRE rounds
+struct RoutingStats
+{
+    IdxType rounds = 0;            // SABRE rounds run, not counting rounds_skipped
+    IdxType swaps = 0;             // SWAPs inserted, all rounds
+    IdxType final_swaps = 0;       // SWAPs in the output (last round)
+    IdxType swap_steps = 0;        // steps where no front gate was executable
+    IdxType releases = 0;          // steps where the release valve routed a gate
+    IdxType max_stagnation = 0;    // longest run of SWAPs without an executed gate
+    IdxType candidates_scored = 0; // SWAP candidates evaluated by the heuristic
+    IdxType search_nodes = 0;      // mappings generated by the beam search
+    IdxType search_fallbacks = 0;  // beam searches without a result
+    IdxType bridges = 0;           // distance-2 CX executed as a bridge instead of a SWAP
+    IdxType rounds_skipped = 0;    // layout rounds given up at the deadline
+    IdxType stitch_swaps = 0;      // SWAPs joining time slices, included in final_swaps
+    bool deadline_reached = false; // the last round was finished by the release valve
+    IdxType executed_gates = 0;    // 2-qubit gates scheduled
+    IdxType steps = 0;
+    // [0]: front layer of 0 or 1 gates, [k]: 2^k to 2^(k+1)-1 gates
+    vector<IdxType> front_layer_histogram;
+    long long pick_ns = 0;
+    long long maintain_layer_ns = 0;
+    long long total_ns = 0;
+    // called before every step if set, e.g., to record states for the router
+    // microbenchmarks (benchmark/router_microbench.cpp)
+    function<void(const RouterStateView &)> observer;
+
+    void record_front_layer(size_t size)
+    {
+        size_t bucket = 0;
+        while (size > 1)
+        {
+            size >>= 1;
+            bucket++;
+        }
+        if (front_layer_histogram.size() <= bucket)
+            front_layer_histogram.resize(bucket + 1, 0);
+        front_layer_histogram[bucket]++;
+    }
+
+    // Add the counters of a routing of another part of the circuit (see
+    // ComponentRouting, SlicedRouting); rounds and stagnation are those of
+    // the longest
+    void merge(const RoutingStats &other)
+    {
+        rounds = max(rounds, other.rounds);
+        swaps += other.swaps;
+        final_swaps += other.final_swaps;
+        swap_steps += other.swap_steps;
+        releases += other.releases;
+        max_stagnation = max(max_stagnation, other.max_stagnation);
+        candidates_scored += other.candidates_scored;
+        search_nodes += other.search_nodes;
+        search_fallbacks += other.search_fallbacks;
+        bridges += other.bridges;
+        rounds_skipped += other.rounds_skipped;
+        stitch_swaps += other.stitch_swaps;
+        deadline_reached = deadline_reached || other.deadline_reached;
+        executed_gates += other.executed_gates;
+        steps += other.steps;
+        if (front_layer_histogram.size() < other.front_layer_histogram.size())
+            front_layer_histogram.resize(other.front_layer_histogram.size(), 0);
+        for (size_t k = 0; k < other.front_layer_histogram.size(); k++)
+            front_layer_histogram[k] += other.front_layer_histogram[k];
+        pick_ns += other.pick_ns;
+        maintain_layer_ns += other.maintain_layer_ns;
+        total_ns += other.total_ns;
+    }
+
+    json to_json() const
+    {
+        json histogram = json::object();
+        for (size_t k = 0; k < front_layer_histogram.size(); k++)
+        {
+            string label = k == 0 ? "0-1" : to_string(1LL << k) + "-" + to_string((1LL << (k + 1)) - 1);
+            histogram[label] = front_layer_histogram[k];
+        }
+        return {{"rounds", rounds},
+                {"swaps", swaps},
+                {"final_swaps", final_swaps},
+                {"swap_steps", swap_steps},
+                {"search_nodes", search_nodes},
+                {"search_fallbacks", search_fallbacks},
+                {"bridges", bridges},
+                {"rounds_skipped", rounds_skipped},
+                {"stitch_swaps", stitch_swaps},
+                {"deadline_reached", deadline_reached},
+                {"releases", releases},
+                {"max_stagnation", max_stagnation},
+                {"candidates_scored", candidates_scored},
+                {"executed_gates", executed_gates},
+                {"steps", steps},
+                {"front_layer_histogram", histogram},
+                {"pick_swap_ns", pick_ns},
+                {"maintain_layer_ns", maintain_layer_ns},
+                {"executed_gates_per_s", total_ns > 0 ? executed_gates * 1e9 / total_ns : 0.0}};
+    }
+};
+
 // extract cx gates in json file for constructing graph
-vector<pair<IdxType, IdxType>> extract_cx_pairs(const json &j)
+inline vector<pair<IdxType, IdxType>> extract_cx_pairs(const json &j)
 {
     vector<pair<IdxType, IdxType>> pairs;
     for (auto &item : j.items())
@@ -37,7 +154,7 @@ vector<pair<IdxType, IdxType>> extract_cx_pairs(const json &j)
     return pairs;
 }
 
-void DAG_generator(IdxType qubit_num, vector<vector<IdxType>> &circuit, vector<IdxType> &gate_state, vector<IdxType> &qubit_state, vector<IdxType> &gate_dependency, vector<vector<IdxType>> &following_gate_idx, vector<IdxType> &first_layer_gates_idx)
+inline void DAG_generator(IdxType qubit_num, vector<vector<IdxType>> &circuit, vector<IdxType> &gate_state, vector<IdxType> &qubit_state, vector<IdxType> &gate_dependency, vector<vector<IdxType>> &following_gate_idx, vector<IdxType> &first_layer_gates_idx)
 {
     IdxType gate_num = circuit.size();
     vector<IdxType> current_gate_idx(qubit_num, -1);
@@ -86,9 +203,68 @@ void DAG_generator(IdxType qubit_num, vector<vector<IdxType>> &circuit, vector<I
         }
     }
 }
+// Commutation-aware variant of DAG_generator. On each wire, a run of 2-qubit
+// gates of the same commutation class there (COMM_Z, e.g., CZ, CP, RZZ and CX
+// controls, or COMM_X, e.g., CX targets), with only 1-qubit gates of that
+// class in between, forms a block of up to max_block gates, which commute and
+// may execute in any order; a gate depends on every gate of the previous block
+// on both of its wires. gate_info holds the gates in circuit order, its
+// 2-qubit gates being those of `circuit`.
+inline void commutation_DAG_generator(const vector<Gate> &gate_info, IdxType qubit_num, const vector<vector<IdxType>> &circuit, vector<IdxType> &gate_state,
+                                      vector<IdxType> &qubit_state, vector<IdxType> &gate_dependency, vector<vector<IdxType>> &following_gate_idx,
+                                      vector<IdxType> &first_layer_gates_idx, IdxType max_block)
+{
+    IdxType gate_num = circuit.size();
+    following_gate_idx.assign(gate_num, vector<IdxType>());
+    gate_dependency.assign(gate_num, 0);
+    // per wire: the open block, its class (COMM_NONE once closed), and the block before it
+    vector<vector<IdxType>> block(qubit_num), previous_block(qubit_num);
+    vector<unsigned char> block_class(qubit_num, COMM_NONE);
+    IdxType k = 0;
+    for (const Gate &g : gate_info)
+    {
+        if (OP_ARITY[g.op_name] == 1)
+        {
+            unsigned char comm = OP_COMM_QUBIT[g.op_name];
+            if (comm != COMM_ALL && comm != block_class[g.qubit])
+                block_class[g.qubit] = COMM_NONE;
+            continue;
+        }
+        if (OP_ARITY[g.op_name] != 2)
+            continue;
+        for (IdxType j = 0; j < 2; j++)
+        {
+            IdxType wire = circuit[k][j];
+            unsigned char comm = wire == g.qubit ? OP_COMM_QUBIT[g.op_name] : OP_COMM_CTRL[g.op_name];
+            if (block_class[wire] == COMM_NONE || comm != block_class[wire] || (IdxType)block[wire].size() >= max_block)
+            {
+                previous_block[wire].swap(block[wire]);
+                block[wire].clear();
+                block_class[wire] = (comm == COMM_Z || comm == COMM_X) ? comm : COMM_NONE;
+            }
+            for (IdxType prior : previous_block[wire])
+            {
+                following_gate_idx[prior].push_back(k);
+                gate_dependency[k]++;
+            }
+            block[wire].push_back(k);
+        }
+        k++;
+    }
+    for (IdxType i = 0; i < gate_num; i++)
+    {
+        if (gate_dependency[i] == 0)
+        {
+            first_layer_gates_idx.push_back(i);
+            gate_state[i] = 2;
+            qubit_state[circuit[i][0]] = 1;
+            qubit_state[circuit[i][1]] = 1;
+        }
+    }
+}
+
 // #gate_state
 // # 0 - not considered
-// # 1 - in future gate queue
 // # 2 - in current gate layer
 // # 3 - executed
 
@@ -96,7 +272,29 @@ void DAG_generator(IdxType qubit_num, vector<vector<IdxType>> &circuit, vector<I
 // # 0 - not occupied in current layer
 // # 1 - occupied in current layer
 
-void maintain_layer(vector<IdxType> &current_layer_gates_idx, set<IdxType> &gate_execute_idx_list, vector<vector<IdxType>> &circuit, vector<IdxType> &gate_state, vector<vector<IdxType>> &following_gate_idx, vector<IdxType> &qubit_state, vector<IdxType> &gate_dependency, vector<IdxType> &updated_layer_gates_idx, vector<IdxType> &future_layer_gates_idx, IdxType flag)
+// The SABRE extended set: the first `size` gates reached from the front layer
+// over the DAG successors, breadth first
+inline void extended_set(const vector<IdxType> &front_layer, const vector<vector<IdxType>> &following_gate_idx, IdxType size,
+                         vector<IdxType> &extended)
+{
+    extended.clear();
+    unordered_set<IdxType> seen;
+    auto visit = [&](IdxType gate_idx)
+    {
+        for (IdxType next_gate_idx : following_gate_idx[gate_idx])
+        {
+            // 0: no following gate on the qubit (gate 0 follows no gate)
+            if (next_gate_idx > 0 && (IdxType)extended.size() < size && seen.insert(next_gate_idx).second)
+                extended.push_back(next_gate_idx);
+        }
+    };
+    for (IdxType gate_idx : front_layer)
+        visit(gate_idx);
+    for (size_t head = 0; head < extended.size() && (IdxType)extended.size() < size; head++)
+        visit(extended[head]);
+}
+
+inline void maintain_layer(vector<IdxType> &current_layer_gates_idx, set<IdxType> &gate_execute_idx_list, vector<vector<IdxType>> &circuit, vector<IdxType> &gate_state, vector<vector<IdxType>> &following_gate_idx, vector<IdxType> &qubit_state, vector<IdxType> &gate_dependency, vector<IdxType> &updated_layer_gates_idx, vector<IdxType> &future_layer_gates_idx, IdxType extended_size = 20)
 {
     unordered_set<IdxType> updated_set;
     updated_layer_gates_idx.clear();
@@ -104,21 +302,17 @@ void maintain_layer(vector<IdxType> &current_layer_gates_idx, set<IdxType> &gate
     {
         if (gate_execute_idx_list.count(gate_idx) > 0)
         {
-            vector<IdxType> gate = circuit[gate_idx];
+            const vector<IdxType> &gate = circuit[gate_idx];
             gate_state[gate_idx] = 3;
-            future_layer_gates_idx.erase(remove(future_layer_gates_idx.begin(), future_layer_gates_idx.end(), gate_idx), future_layer_gates_idx.end());
-
             qubit_state[gate[0]] = 0;
             qubit_state[gate[1]] = 0;
-            vector<IdxType> following_gates = following_gate_idx[gate_idx];
-            for (IdxType next_gate_idx : following_gates)
+            for (IdxType next_gate_idx : following_gate_idx[gate_idx])
             {
                 gate_dependency[next_gate_idx]--;
                 if (gate_dependency[next_gate_idx] == 0)
                 {
                     updated_set.insert(next_gate_idx);
                     gate_state[next_gate_idx] = 2;
-                    future_layer_gates_idx.erase(remove(future_layer_gates_idx.begin(), future_layer_gates_idx.end(), next_gate_idx), future_layer_gates_idx.end());
                     qubit_state[circuit[next_gate_idx][0]] = 1;
                     qubit_state[circuit[next_gate_idx][1]] = 1;
                 }
@@ -130,36 +324,13 @@ void maintain_layer(vector<IdxType> &current_layer_gates_idx, set<IdxType> &gate
         }
     }
     updated_layer_gates_idx.assign(updated_set.begin(), updated_set.end());
-    if (!updated_layer_gates_idx.empty())
-    {
-        IdxType start_gate = *min_element(updated_layer_gates_idx.begin(), updated_layer_gates_idx.end());
-        for (IdxType gate_idx = start_gate; gate_idx < start_gate + 20 && gate_idx < circuit.size(); gate_idx++)
-        {
-            if (gate_state[gate_idx] == 0)
-            {
-                gate_state[gate_idx] = 1;
-                if (flag != 0)
-                {
-                    future_layer_gates_idx.push_back(gate_idx);
-                }
-            }
-        }
-    }
-    if (flag == 0)
-    {
-        for (IdxType gate_idx = 0; gate_idx < circuit.size(); gate_idx++)
-        {
-            if (gate_state[gate_idx] == 1)
-            {
-                future_layer_gates_idx.push_back(gate_idx);
-            }
-        }
-    }
     sort(updated_layer_gates_idx.begin(), updated_layer_gates_idx.end());
+    extended_set(updated_layer_gates_idx, following_gate_idx, extended_size, future_layer_gates_idx);
     sort(future_layer_gates_idx.begin(), future_layer_gates_idx.end());
 }
 
-double heuristic(const vector<IdxType> &new_mapping, const vector<IdxType> &current_layer_gates_idx, const vector<IdxType> &future_gates_idx, const vector<vector<IdxType>> &distance_mat, const vector<vector<IdxType>> &circuit)
+inline double heuristic(const vector<IdxType> &new_mapping, const vector<IdxType> &current_layer_gates_idx, const vector<IdxType> &future_gates_idx, const vector<vector<IdxType>> &distance_mat, const vector<vector<IdxType>> &circuit,
+                        double extended_weight = 0.5)
 {
     double cost = 0.0;
     double first_cost = 0.0;
@@ -185,10 +356,10 @@ double heuristic(const vector<IdxType> &new_mapping, const vector<IdxType> &curr
         second_cost += distance_mat[new_mapping[gate[0]]][new_mapping[gate[1]]];
     }
     second_cost /= future_gates_idx.size();
-    cost = first_cost + 0.5 * second_cost;
+    cost = first_cost + extended_weight * second_cost;
     return cost;
 }
-vector<IdxType> find_reverse_mapping(const vector<IdxType> &mapping, IdxType qubit_num)
+inline vector<IdxType> find_reverse_mapping(const vector<IdxType> &mapping, IdxType qubit_num)
 {
     vector<IdxType> reverse_mapping(qubit_num, -1);
     for (IdxType l_qubit = 0; l_qubit < mapping.size(); ++l_qubit)
@@ -207,43 +378,222 @@ vector<IdxType> find_reverse_mapping(const vector<IdxType> &mapping, IdxType qub
     return reverse_mapping;
 }
 
-vector<IdxType> pick_one_movement(vector<IdxType> &mapping, const vector<IdxType> &current_layer, const vector<IdxType> &future_layer, const vector<vector<IdxType>> &distance_mat, IdxType qubit_num, const vector<vector<IdxType>> &circuit, shared_ptr<Chip> chip)
+// Exchange the logical qubits on physical qubits a and b
+inline void swap_physical_qubits(vector<IdxType> &mapping, IdxType a, IdxType b)
 {
-    vector<IdxType> l2p_mapping = mapping;
-    vector<IdxType> key_p_qubits;
+    for (IdxType &p_qubit : mapping)
+    {
+        if (p_qubit == a)
+            p_qubit = b;
+        else if (p_qubit == b)
+            p_qubit = a;
+    }
+}
+
+// decay: SABRE decay factor of each physical qubit, if any (see SabreOptions)
+inline vector<IdxType> pick_one_movement(vector<IdxType> &mapping, const vector<IdxType> &current_layer, const vector<IdxType> &future_layer, const vector<vector<IdxType>> &distance_mat, IdxType qubit_num, const vector<vector<IdxType>> &circuit, shared_ptr<Chip> chip,
+                                         RoutingStats *stats = nullptr, double extended_weight = 0.5, const vector<double> *decay = nullptr)
+{
+    vector<pair<IdxType, IdxType>> possible_pairs;
     for (IdxType gate_idx : current_layer)
     {
-        vector<IdxType> gate = circuit[gate_idx];
-        key_p_qubits.push_back(l2p_mapping[gate[0]]);
-        key_p_qubits.push_back(l2p_mapping[gate[1]]);
+        for (IdxType p_qubit : {mapping[circuit[gate_idx][0]], mapping[circuit[gate_idx][1]]})
+        {
+            for (IdxType p_qubit_target : chip->edge_list[p_qubit])
+                possible_pairs.push_back(make_pair(p_qubit, p_qubit_target));
+        }
+    }
+    if (stats)
+        stats->candidates_scored += possible_pairs.size();
+    //^ score all candidates in one batch, see swap_scoring.hpp
+    SwapScoreLayer front(current_layer, circuit, mapping), future(future_layer, circuit, mapping);
+    pair<IdxType, IdxType> best = possible_pairs[best_swap_candidate(possible_pairs, front, future, chip->distance16, chip->qubit_num, extended_weight, decay)];
+    mapping.resize(qubit_num, -1);
+    swap_physical_qubits(mapping, best.first, best.second);
+    return {best.first, best.second};
+}
+
+// SWAP duration in 2-qubit gate layers (three CX)
+constexpr IdxType SWAP_LAYERS = 3;
+
+// Depth-aware variant of pick_one_movement (SabreOptions::parallel_swaps):
+// the first SWAP has the lowest SABRE cost plus the depth term, where
+// qubit_time holds the layer at which each physical qubit is free; further
+// SWAPs on qubits not used yet are added while one lowers both the front layer
+// distance and the SABRE cost without starting later than the first SWAP, so
+// that it shares its layer. Returns the SWAPs (physical qubits), already
+// applied to the mapping.
+inline vector<pair<IdxType, IdxType>> pick_parallel_movements(vector<IdxType> &mapping, const vector<IdxType> &current_layer, const vector<IdxType> &future_layer,
+                                                              IdxType qubit_num, const vector<vector<IdxType>> &circuit, shared_ptr<Chip> chip,
+                                                              const vector<IdxType> &qubit_time, const SabreOptions &options,
+                                                              RoutingStats *stats = nullptr, const vector<double> *decay = nullptr)
+{
+    vector<pair<IdxType, IdxType>> possible_pairs;
+    for (IdxType gate_idx : current_layer)
+    {
+        for (IdxType p_qubit : {mapping[circuit[gate_idx][0]], mapping[circuit[gate_idx][1]]})
+        {
+            for (IdxType p_qubit_target : chip->edge_list[p_qubit])
+                possible_pairs.push_back(make_pair(p_qubit, p_qubit_target));
+        }
+    }
+    IdxType earliest = -1;
+    for (auto &candidate : possible_pairs)
+    {
+        IdxType start = max(qubit_time[candidate.first], qubit_time[candidate.second]);
+        if (earliest < 0 || start < earliest)
+            earliest = start;
+    }
+    mapping.resize(qubit_num, -1);
+    const uint16_t *dist = chip->distance16.data();
+    int32_t n = (int32_t)chip->qubit_num;
+    vector<char> used(qubit_num, 0);
+    vector<pair<IdxType, IdxType>> swaps;
+    IdxType first_start = 0;
+    while (true)
+    {
+        SwapScoreLayer front(current_layer, circuit, mapping), future(future_layer, circuit, mapping);
+        // (-1, -1) matches no endpoint: the cost without a SWAP
+        int64_t front_sum = swapped_distance_sum(front, -1, -1, dist, n);
+        double current_cost = (double)front_sum / front.count;
+        if (future.count > 0)
+            current_cost += options.extended_weight * ((double)swapped_distance_sum(future, -1, -1, dist, n) / future.count);
+        IdxType best = -1;
+        double best_score = 0;
+        for (IdxType i = 0; i < (IdxType)possible_pairs.size(); i++)
+        {
+            IdxType a = possible_pairs[i].first, b = possible_pairs[i].second;
+            IdxType start = max(qubit_time[a], qubit_time[b]);
+            if (used[a] || used[b] || (!swaps.empty() && start > first_start))
+                continue;
+            int64_t swapped = swapped_distance_sum(front, (int32_t)a, (int32_t)b, dist, n);
+            if (!swaps.empty() && swapped >= front_sum)
+                continue;
+            double cost = (double)swapped / front.count;
+            if (future.count > 0)
+                cost += options.extended_weight * ((double)swapped_distance_sum(future, (int32_t)a, (int32_t)b, dist, n) / future.count);
+            if (!swaps.empty() && cost >= current_cost)
+                continue;
+            double score = cost;
+            if (decay)
+                score *= max((*decay)[a], (*decay)[b]);
+            score += options.depth_weight * (start - earliest) / SWAP_LAYERS;
+            if (best < 0 || score < best_score)
+            {
+                best = i;
+                best_score = score;
+            }
+        }
+        if (stats)
+            stats->candidates_scored += possible_pairs.size();
+        if (best < 0)
+            break;
+        IdxType a = possible_pairs[best].first, b = possible_pairs[best].second;
+        if (swaps.empty())
+            first_start = max(qubit_time[a], qubit_time[b]);
+        swap_physical_qubits(mapping, a, b);
+        used[a] = used[b] = 1;
+        swaps.push_back(make_pair(a, b));
+    }
+    return swaps;
+}
+
+// Release valve for a search that stopped making progress: move the front
+// layer gate with the shortest distance along a shortest path until it can
+// execute. Returns the SWAPs (physical qubits), already applied to the mapping.
+inline vector<pair<IdxType, IdxType>> release_valve(vector<IdxType> &mapping, const vector<IdxType> &current_layer,
+                                                    const vector<vector<IdxType>> &circuit, shared_ptr<Chip> chip)
+{
+    const vector<vector<IdxType>> &distance_mat = chip->distance_mat;
+    IdxType closest = current_layer[0];
+    for (IdxType gate_idx : current_layer)
+    {
+        if (distance_mat[mapping[circuit[gate_idx][0]]][mapping[circuit[gate_idx][1]]] <
+            distance_mat[mapping[circuit[closest][0]]][mapping[circuit[closest][1]]])
+            closest = gate_idx;
+    }
+    IdxType from = mapping[circuit[closest][0]], to = mapping[circuit[closest][1]];
+    vector<pair<IdxType, IdxType>> swaps;
+    while (distance_mat[from][to] > 1)
+    {
+        IdxType next = -1;
+        for (IdxType neighbor : chip->edge_list[from])
+        {
+            if (distance_mat[neighbor][to] == distance_mat[from][to] - 1)
+            {
+                next = neighbor;
+                break;
+            }
+        }
+        if (next < 0)
+            throw runtime_error("Routing: no path between physical qubits " + to_string(from) + " and " + to_string(to) +
+                                "; the device may be disconnected");
+        swap_physical_qubits(mapping, from, next);
+        swaps.push_back(make_pair(from, next));
+        from = next;
     }
-    vector<vector<IdxType>> possible_pairs;
-    for (IdxType p_qubit : key_p_qubits)
+    return swaps;
+}
+
+// Bridge candidate (SabreOptions::bridge): a front layer CX at distance 2 can
+// execute now as CX(c,m) CX(m,t) CX(c,m) CX(m,t) through a common neighbor m,
+// which it leaves unchanged, for the same four CX as a SWAP and the gate. The
+// bridge keeps the layout, so it is only taken when every SWAP ends with a
+// higher SABRE cost, i.e., when moving the qubits would disturb the gates that
+// follow. Returns the gate and sets the middle qubit, or returns -1.
+inline IdxType pick_bridge(const vector<IdxType> &mapping, const vector<IdxType> &current_layer, const vector<IdxType> &future_layer,
+                           const vector<vector<IdxType>> &circuit, const vector<Gate> &circuit_gate, shared_ptr<Chip> chip,
+                           double extended_weight, IdxType &middle)
+{
+    const vector<vector<IdxType>> &distance_mat = chip->distance_mat;
+    IdxType bridged = -1;
+    for (IdxType gate_idx : current_layer)
     {
-        for (IdxType p_qubit_target : chip->edge_list[p_qubit])
+        if (circuit_gate[gate_idx].op_name == OP::CX && distance_mat[mapping[circuit[gate_idx][0]]][mapping[circuit[gate_idx][1]]] == 2)
         {
-            possible_pairs.push_back({p_qubit, p_qubit_target});
+            bridged = gate_idx;
+            break;
         }
     }
-    vector<double> score(possible_pairs.size(), 0.0);
-    for (size_t pair_idx = 0; pair_idx < possible_pairs.size(); ++pair_idx)
+    if (bridged < 0)
+        return -1;
+    // the front layer cost of a bridge is that of the current mapping with
+    // the gate at distance 1, the lowest any SWAP can reach for it
+    SwapScoreLayer front(current_layer, circuit, mapping), future(future_layer, circuit, mapping);
+    const uint16_t *dist = chip->distance16.data();
+    int32_t n = (int32_t)chip->qubit_num;
+    auto cost = [&](int32_t a, int32_t b, int64_t front_offset)
     {
-        vector<IdxType> pair = possible_pairs[pair_idx];
-        vector<IdxType> p2l_mapping = find_reverse_mapping(l2p_mapping, qubit_num);
-        swap(p2l_mapping[pair[0]], p2l_mapping[pair[1]]);
-        vector<IdxType> temp_l2p_mapping = find_reverse_mapping(p2l_mapping, qubit_num);
-        score[pair_idx] = heuristic(temp_l2p_mapping, current_layer, future_layer, distance_mat, circuit);
+        double c = (double)(swapped_distance_sum(front, a, b, dist, n) + front_offset) / front.count;
+        if (future.count > 0)
+            c += extended_weight * ((double)swapped_distance_sum(future, a, b, dist, n) / future.count);
+        return c;
+    };
+    double bridge_cost = cost(-1, -1, -1);
+    for (IdxType gate_idx : current_layer)
+    {
+        for (IdxType p_qubit : {mapping[circuit[gate_idx][0]], mapping[circuit[gate_idx][1]]})
+        {
+            for (IdxType p_qubit_target : chip->edge_list[p_qubit])
+            {
+                if (cost((int32_t)p_qubit, (int32_t)p_qubit_target, 0) <= bridge_cost)
+                    return -1;
+            }
+        }
     }
-    size_t best_move_idx = distance(score.begin(), min_element(score.begin(), score.end()));
-    vector<IdxType> pair = possible_pairs[best_move_idx];
-    vector<IdxType> p2l_mapping = find_reverse_mapping(l2p_mapping, qubit_num);
-    swap(p2l_mapping[pair[0]], p2l_mapping[pair[1]]);
-    vector<IdxType> new_mapping = find_reverse_mapping(p2l_mapping, qubit_num);
-    mapping = new_mapping;
-    return pair;
+    IdxType c_qubit = mapping[circuit[bridged][0]], t_qubit = mapping[circuit[bridged][1]];
+    for (IdxType m : chip->edge_list[c_qubit])
+    {
+        if (distance_mat[m][t_qubit] == 1)
+        {
+            middle = m;
+            return bridged;
+        }
+    }
+    return -1;
 }
 
-set<IdxType> find_executable_gates(const vector<IdxType> &mapping, const vector<IdxType> &current_layer,
+inline set<IdxType> find_executable_gates(const vector<IdxType> &mapping, const vector<IdxType> &current_layer,
                                    const vector<vector<IdxType>> &circuit, const vector<vector<IdxType>> &distance_mat)
 {
     set<IdxType> executable_gates;
@@ -262,7 +612,7 @@ set<IdxType> find_executable_gates(const vector<IdxType> &mapping, const vector<
     return executable_gates;
 }
 
-vector<pair<IdxType, IdxType>> sortWithSwaps(vector<IdxType> &lst)
+inline vector<pair<IdxType, IdxType>> sortWithSwaps(vector<IdxType> &lst)
 {
     vector<IdxType> sorted_lst;
     vector<IdxType> temp_lst;
@@ -294,9 +644,153 @@ vector<pair<IdxType, IdxType>> sortWithSwaps(vector<IdxType> &lst)
     return swaps;
 }
 
-IdxType one_round_optimization(vector<IdxType> &initial_mapping, vector<Gate> circuit_gate, vector<vector<IdxType>> distance_mat,
-                               vector<Gate> gate_info, shared_ptr<Chip> chip, vector<vector<IdxType>> gate_qubit, vector<Gate> &return_circuit, IdxType debug_level)
+/***********************************************
+ * The operations other than 2-qubit gates (1-qubit
+ * gates, measure, reset, barrier) as ordered nodes
+ * on their wires. They are emitted when the router
+ * executes the next 2-qubit gate on the wire (or at
+ * the end), i.e., on the physical qubit the logical
+ * one has been moved to by then: emitting them right
+ * after the previous 2-qubit gate instead puts them
+ * in front of the SWAPs that move the qubit, which
+ * are usually on the critical path. A barrier is
+ * emitted once every wire has reached it, and holds
+ * back the 2-qubit gates behind it until then.
+ ***********************************************/
+struct WireSchedule
 {
+    // per wire: 2-qubit gate index k >= 0 or wire op -(op + 1), in circuit order
+    vector<vector<IdxType>> wires;
+    vector<IdxType> head;
+    // gates of each wire op: one gate, or one BARRIER gate per wire
+    vector<vector<Gate>> ops;
+    bool has_barriers = false;
+    // 2-qubit gates executed ahead of the head of one of their wires, which
+    // commutation-aware routing allows within a block
+    vector<char> done;
+
+    WireSchedule(const vector<Gate> &gate_info, IdxType n_wires) : wires(n_wires), head(n_wires, 0)
+    {
+        IdxType two_qubit_index = 0;
+        for (size_t i = 0; i < gate_info.size(); i++)
+        {
+            const Gate &g = gate_info[i];
+            if (OP_ARITY[g.op_name] == 2)
+            {
+                wires[g.ctrl].push_back(two_qubit_index);
+                wires[g.qubit].push_back(two_qubit_index);
+                two_qubit_index++;
+            }
+            else if (OP_ARITY[g.op_name] == 1)
+            {
+                // the BARRIER gates of one barrier are consecutive
+                size_t width = 1;
+                if (g.op_name == OP::BARRIER)
+                {
+                    has_barriers = true;
+                    while (width < (size_t)g.n_qubits && i + width < gate_info.size() &&
+                           gate_info[i + width].op_name == OP::BARRIER)
+                        width++;
+                }
+                IdxType op = ops.size();
+                ops.emplace_back(gate_info.begin() + i, gate_info.begin() + i + width);
+                for (const Gate &piece : ops.back())
+                    wires[piece.qubit].push_back(-(op + 1));
+                i += width - 1;
+            }
+        }
+        done.assign(two_qubit_index, 0);
+    }
+
+    // Only wire ops that can be emitted now stand between the head of the wire
+    // and `item`; pending 2-qubit gates in front of a front layer gate are of its block
+    bool reachable(IdxType wire, IdxType item) const
+    {
+        for (IdxType pos = head[wire]; pos < (IdxType)wires[wire].size(); pos++)
+        {
+            IdxType x = wires[wire][pos];
+            if (x == item)
+                return true;
+            if (x >= 0 && (done[x] || item >= 0))
+                continue;
+            if (x >= 0)
+                return false;
+            const vector<Gate> &op = ops[-x - 1];
+            if (op[0].op_name != OP::BARRIER)
+                continue;
+            for (const Gate &piece : op)
+            {
+                if (piece.qubit != wire && !reachable(piece.qubit, x))
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    // The 2-qubit gate k of the front layer is not held back by a barrier
+    bool ready(IdxType k, IdxType ctrl, IdxType qubit) const
+    {
+        return !has_barriers || (reachable(ctrl, k) && reachable(qubit, k));
+    }
+
+    // Emit the wire ops in front of `item` on the wire
+    void drain(IdxType wire, IdxType item, const vector<IdxType> &mapping, vector<Gate> &out)
+    {
+        while (head[wire] < (IdxType)wires[wire].size())
+        {
+            IdxType x = wires[wire][head[wire]];
+            if (x >= 0 && x != item && done[x])
+            {
+                head[wire]++;
+                continue;
+            }
+            if (x == item || x >= 0)
+                return;
+            const vector<Gate> &op = ops[-x - 1];
+            if (op[0].op_name == OP::BARRIER)
+            {
+                for (const Gate &piece : op)
+                {
+                    if (piece.qubit != wire)
+                        drain(piece.qubit, x, mapping, out);
+                }
+            }
+            for (Gate piece : op)
+            {
+                head[piece.qubit]++;
+                piece.qubit = mapping[piece.qubit];
+                out.push_back(piece);
+            }
+        }
+    }
+
+    // Emit what is in front of the 2-qubit gate, which the caller then emits
+    void execute(IdxType k, IdxType ctrl, IdxType qubit, const vector<IdxType> &mapping, vector<Gate> &out)
+    {
+        for (IdxType wire : {ctrl, qubit})
+        {
+            drain(wire, k, mapping, out);
+            if (wires[wire][head[wire]] == k)
+                head[wire]++;
+            else
+                done[k] = 1;
+        }
+    }
+
+    // Emit the remaining wire ops (after the last 2-qubit gates)
+    void finish(const vector<IdxType> &mapping, vector<Gate> &out)
+    {
+        for (IdxType wire = 0; wire < (IdxType)wires.size(); wire++)
+            drain(wire, -(IdxType)ops.size() - 1, mapping, out);
+    }
+};
+
+inline IdxType one_round_optimization(vector<IdxType> &initial_mapping, vector<Gate> circuit_gate, vector<vector<IdxType>> distance_mat,
+                               vector<Gate> gate_info, shared_ptr<Chip> chip, vector<vector<IdxType>> gate_qubit, vector<Gate> &return_circuit, IdxType debug_level,
+                                      RoutingStats *stats = nullptr, const SabreOptions &options = SabreOptions(),
+                                      const RunControl *control = nullptr, IdxType round = 2)
+{
+    QASMTRANS_TRACE_SCOPE("sabre_round");
     IdxType swap_num = 0;
     vector<IdxType> mapping = initial_mapping;
 
@@ -315,7 +809,11 @@ IdxType one_round_optimization(vector<IdxType> &initial_mapping, vector<Gate> ci
     vector<IdxType> qubit_state(qubit_num, 0);
     vector<vector<IdxType>> following_gates_idx;
     vector<IdxType> first_layer_gates_idx;
-    DAG_generator(qubit_num, circuit, gate_state, qubit_state, gate_dependency, following_gates_idx, first_layer_gates_idx);
+    if (options.commutation_block > 1)
+        commutation_DAG_generator(gate_info, qubit_num, circuit, gate_state, qubit_state, gate_dependency, following_gates_idx, first_layer_gates_idx,
+                                  options.commutation_block);
+    else
+        DAG_generator(qubit_num, circuit, gate_state, qubit_state, gate_dependency, following_gates_idx, first_layer_gates_idx);
     vector<IdxType> current_layer;
     for (IdxType gate_idx : first_layer_gates_idx)
     {
@@ -324,136 +822,222 @@ IdxType one_round_optimization(vector<IdxType> &initial_mapping, vector<Gate> ci
     vector<IdxType> future_layer;
     set<IdxType> gate_execute_idx_list;
     vector<IdxType> updated_layer_gates_idx;
-    maintain_layer(current_layer, gate_execute_idx_list, circuit, gate_state, following_gates_idx, qubit_state, gate_dependency, updated_layer_gates_idx, future_layer, 0);
+    maintain_layer(current_layer, gate_execute_idx_list, circuit, gate_state, following_gates_idx, qubit_state, gate_dependency, updated_layer_gates_idx, future_layer, options.extended_size);
     current_layer = updated_layer_gates_idx;
     IdxType layer_index = 0;
-    IdxType single_gate_count = 0;
-    vector<IdxType> num_single_before;
-    vector<Gate> single_gate_info;
-    for (IdxType i = 0; i < gate_info.size(); i++)
-    {
-        // cout << OP_NAMES[gate_info[i].op_name] << " (" << gate_info[i].ctrl << ", " << gate_info[i].qubit <<")"<< endl;
-        if (gate_info[i].ctrl == -1 && strcmp(OP_NAMES[gate_info[i].op_name], "MA") != 0)
-        {
-            single_gate_count++;
-            single_gate_info.push_back(gate_info[i]);
-        }
-        else
-        {
-            num_single_before.push_back(single_gate_count);
-        }
-    }
-    map<IdxType, vector<IdxType>> qubit_to_gate_indices;
-    vector<vector<IdxType>> dependency_vector(gate_num);
-
-    IdxType two_qubit_gate_index = 0;
-    IdxType single_qubit_index = 0;
-
-    for (IdxType i = 0; i < gate_info.size(); ++i)
+    WireSchedule schedule(gate_info, qubit_num);
+    // SABRE decay factor per physical qubit, reset on progress
+    vector<double> decay(qubit_num, 1.0);
+    IdxType swaps_since_reset = 0;
+    // SWAPs since a gate was last executed; beyond the stagnation limit, or
+    // once the SWAPs of the round reach the budget, the release valve routes
+    // a gate along a shortest path and the gate executes in the next step, so
+    // a round inserts at most
+    // gate_num * (min(stagnation_limit, max_swaps_per_gate) + chip diameter) SWAPs
+    IdxType stagnation = 0;
+    IdxType swap_budget = options.max_swaps_per_gate * gate_num;
+    // layer at which each physical qubit is free (2-qubit gates take one
+    // layer, SWAPs SWAP_LAYERS), for the depth-aware SWAP choice
+    vector<IdxType> qubit_time(qubit_num, 0);
+    // past the deadline: every SWAP step goes through the release valve
+    bool rushing = false;
+    double total_maIdxTypeainlayer_time = 0;
+    double total_pickone_time = 0;
+    vector<IdxType> ready_layer;
+    while (executed_gates_num < gate_num)
     {
-        const auto &gate = gate_info[i];
-        // If it's a two-qubit gate, we check whether the involved qubits were touched by a single-qubit gate before
-        if (gate.ctrl != -1)
+        if (control)
         {
-            // We look at all the previous single-qubit gates involving the control or target qubits
-            if (qubit_to_gate_indices.count(gate.ctrl))
+            control->check_cancelled();
+            if (!rushing && control->past_deadline())
             {
-                for (const auto &idx : qubit_to_gate_indices[gate.ctrl])
+                // a layout round gives up and leaves the layout of the previous one
+                if (round < 2)
                 {
-                    dependency_vector[two_qubit_gate_index].push_back(idx);
+                    if (stats)
+                        stats->rounds_skipped++;
+                    return -1;
                 }
-                qubit_to_gate_indices.erase(gate.ctrl);
+                rushing = true;
+                if (stats)
+                    stats->deadline_reached = true;
             }
-            if (qubit_to_gate_indices.count(gate.qubit))
+            // three rounds over the 2-qubit gates
+            control->report("routing", round * gate_num + executed_gates_num, 3 * gate_num, control->pass_start_ns);
+        }
+        if (stats)
+        {
+            stats->steps++;
+            stats->record_front_layer(current_layer.size());
+            if (stats->observer)
+                stats->observer({layer_index, mapping, current_layer, future_layer, gate_state, circuit});
+        }
+        // gates of the front layer still held back by a barrier wait
+        const vector<IdxType> *layer = &current_layer;
+        if (schedule.has_barriers)
+        {
+            ready_layer.clear();
+            for (IdxType gate_idx : current_layer)
             {
-                for (const auto &idx : qubit_to_gate_indices[gate.qubit])
-                {
-                    dependency_vector[two_qubit_gate_index].push_back(idx);
-                }
-                qubit_to_gate_indices.erase(gate.qubit);
+                if (schedule.ready(gate_idx, circuit[gate_idx][0], circuit[gate_idx][1]))
+                    ready_layer.push_back(gate_idx);
             }
-            two_qubit_gate_index++;
+            if (ready_layer.empty())
+                throw logic_error("Routing: every gate of the front layer waits for a barrier");
+            layer = &ready_layer;
         }
-        // We assume any other gate is a single-qubit gate
-        else
+        set<IdxType> execute_gates_idx = find_executable_gates(mapping, *layer, circuit, distance_mat);
+        IdxType bridge_gate = -1, bridge_middle = -1;
+        // only in the output round: in the layout rounds a bridge leaves the
+        // qubits where a SWAP would refine the layout
+        if (execute_gates_idx.empty() && options.bridge && round == 2 && !rushing && stagnation < options.stagnation_limit && swap_num < swap_budget)
         {
-            if (strcmp(OP_NAMES[gate_info[i].op_name], "MA") != 0)
+            bridge_gate = pick_bridge(mapping, *layer, future_layer, circuit, circuit_gate, chip, options.extended_weight, bridge_middle);
+            if (bridge_gate >= 0)
             {
-                qubit_to_gate_indices[gate.qubit].push_back(single_qubit_index++);
+                execute_gates_idx.insert(bridge_gate);
+                if (stats)
+                    stats->bridges++;
             }
         }
-    }
-    double total_maIdxTypeainlayer_time = 0;
-    double total_pickone_time = 0;
-    set<IdxType> visited_gate;
-    IdxType cur = 0;
-    while (executed_gates_num < gate_num)
-    {
-        set<IdxType> execute_gates_idx = find_executable_gates(mapping, current_layer, circuit, distance_mat);
         // cout << current_layer.size()<<endl;
         for (IdxType ee : execute_gates_idx)
         {
-            vector<IdxType> cur_index_vector = dependency_vector[ee];
-            for (IdxType cur_index : cur_index_vector)
-            {
-                //^ push back all the single qubit gate
-                Gate cur_gate = single_gate_info[cur_index];
-                IdxType q_qubit = mapping[single_gate_info[cur_index].qubit];
-                cur_gate.qubit = q_qubit;
-                // Gate new_gate = Gate(cur_gate.op_name, mapping[single_gate_info[single_gate_index].qubit], -1, cur_gate.theta);
-                // new_gate.set_gm(cur_gate.gm_real, cur_gate.gm_imag, 2);
-                return_circuit.push_back(cur_gate);
-                visited_gate.insert(cur_index);
-            }
+            //^ push back the single qubit gates (and measurements) before it
+            schedule.execute(ee, circuit[ee][0], circuit[ee][1], mapping, return_circuit);
             Gate cur_gate = circuit_gate[ee];
             IdxType q_qubit = mapping[cur_gate.qubit];
             IdxType c_qubit = mapping[cur_gate.ctrl];
             cur_gate.qubit = q_qubit;
             cur_gate.ctrl = c_qubit;
+            if (ee == bridge_gate)
+            {
+                // CX(c,t) = CX(c,m) CX(m,t) CX(c,m) CX(m,t)
+                Gate to_middle = cur_gate, from_middle = cur_gate;
+                to_middle.qubit = bridge_middle;
+                from_middle.ctrl = bridge_middle;
+                for (IdxType k = 0; k < 2; k++)
+                {
+                    return_circuit.push_back(to_middle);
+                    return_circuit.push_back(from_middle);
+                }
+                qubit_time[q_qubit] = qubit_time[c_qubit] = qubit_time[bridge_middle] =
+                    max(max(qubit_time[q_qubit], qubit_time[c_qubit]), qubit_time[bridge_middle]) + 4;
+                continue;
+            }
+            qubit_time[q_qubit] = qubit_time[c_qubit] = max(qubit_time[q_qubit], qubit_time[c_qubit]) + 1;
             // Gate new_gate = Gate(cur_gate.op_name, mapping[cur_gate.qubit], mapping[cur_gate.ctrl], cur_gate.theta);
             // new_gate.set_gm(cur_gate.gm_real, cur_gate.gm_imag, 4);
             return_circuit.push_back(cur_gate);
         }
         if (!execute_gates_idx.empty())
         {
-            cpu_timer trans_timer;
+            QASMTRANS_TRACE_SCOPE("maintain_layer");
+            steady_timer trans_timer;
             trans_timer.start_timer();
-            maintain_layer(current_layer, execute_gates_idx, circuit, gate_state, following_gates_idx, qubit_state, gate_dependency, updated_layer_gates_idx, future_layer, 1);
+            maintain_layer(current_layer, execute_gates_idx, circuit, gate_state, following_gates_idx, qubit_state, gate_dependency, updated_layer_gates_idx, future_layer, options.extended_size);
             trans_timer.stop_timer();
             total_maIdxTypeainlayer_time += trans_timer.measure();
+            if (stats)
+            {
+                stats->maintain_layer_ns += trans_timer.measure_ns();
+                stats->executed_gates += execute_gates_idx.size();
+            }
 
             current_layer = updated_layer_gates_idx;
             executed_gates_num += execute_gates_idx.size();
+            if (swaps_since_reset > 0)
+            {
+                fill(decay.begin(), decay.end(), 1.0);
+                swaps_since_reset = 0;
+            }
+            stagnation = 0;
+        }
+        else if (rushing || stagnation >= options.stagnation_limit || swap_num >= swap_budget)
+        {
+            QASMTRANS_TRACE_SCOPE("release_valve");
+            vector<pair<IdxType, IdxType>> swaps = release_valve(mapping, *layer, circuit, chip);
+            for (auto &swap_pair : swaps)
+            {
+                return_circuit.push_back(Gate(OP::SWAP, swap_pair.second, swap_pair.first));
+                qubit_time[swap_pair.first] = qubit_time[swap_pair.second] =
+                    max(qubit_time[swap_pair.first], qubit_time[swap_pair.second]) + SWAP_LAYERS;
+            }
+            swap_num += swaps.size();
+            fill(decay.begin(), decay.end(), 1.0);
+            swaps_since_reset = 0;
+            stagnation = 0;
+            if (stats)
+            {
+                stats->releases++;
+                stats->swap_steps++;
+                stats->swaps += swaps.size();
+            }
         }
         else
         {
-            cpu_timer trans_timer;
+            QASMTRANS_TRACE_SCOPE("pick_one_movement");
+            steady_timer trans_timer;
             trans_timer.start_timer();
-            vector<IdxType> pair = pick_one_movement(mapping, current_layer, future_layer, distance_mat, qubit_num, circuit, chip);
+            vector<pair<IdxType, IdxType>> swaps;
+            if (options.beam_search)
+            {
+                IdxType nodes = 0;
+                mapping.resize(qubit_num, -1);
+                SearchContext context{*layer, future_layer, circuit, following_gates_idx, gate_dependency, chip, options.extended_weight};
+                swaps = search_swaps(mapping, *layer, context, options, &nodes);
+                for (auto &swap_pair : swaps)
+                    swap_physical_qubits(mapping, swap_pair.first, swap_pair.second);
+                if (stats)
+                {
+                    stats->search_nodes += nodes;
+                    stats->search_fallbacks += swaps.empty();
+                }
+            }
+            // SABRE, also when the search found nothing
+            if (swaps.empty() && options.parallel_swaps)
+                swaps = pick_parallel_movements(mapping, *layer, future_layer, qubit_num, circuit, chip, qubit_time, options, stats,
+                                                options.decay > 0 ? &decay : nullptr);
+            else if (swaps.empty())
+            {
+                vector<IdxType> pair = pick_one_movement(mapping, *layer, future_layer, distance_mat, qubit_num, circuit, chip, stats,
+                                                         options.extended_weight, options.decay > 0 ? &decay : nullptr);
+                swaps.push_back(make_pair(pair[0], pair[1]));
+            }
+            for (auto &swap_pair : swaps)
+            {
+                if (++swaps_since_reset % options.decay_reset == 0)
+                    fill(decay.begin(), decay.end(), 1.0);
+                else
+                {
+                    decay[swap_pair.first] += options.decay;
+                    decay[swap_pair.second] += options.decay;
+                }
+                // cout << "swap " << swap_pair.first << " " << swap_pair.second << endl;
+                Gate SWAPG = Gate(OP::SWAP, swap_pair.second, swap_pair.first);
+                return_circuit.push_back(SWAPG);
+                qubit_time[swap_pair.first] = qubit_time[swap_pair.second] =
+                    max(qubit_time[swap_pair.first], qubit_time[swap_pair.second]) + SWAP_LAYERS;
+            }
+            stagnation += swaps.size();
+            swap_num += swaps.size();
             trans_timer.stop_timer();
             total_pickone_time += trans_timer.measure();
-            // cout << "swap " << pair[0] << " " << pair[1] << endl;
-            // all_gate_output.push_back({pair[0], pair[1]});
-            Gate SWAPG = Gate(OP::SWAP, IdxType(pair[1]), IdxType(pair[0]));
-            return_circuit.push_back(SWAPG);
-            // all_gate_type.push_back(1);
-            swap_num += 1;
+            if (stats)
+            {
+                stats->pick_ns += trans_timer.measure_ns();
+                stats->swap_steps++;
+                stats->swaps += swaps.size();
+                stats->max_stagnation = max(stats->max_stagnation, stagnation);
+            }
         }
         layer_index += 1;
         // executed_gates_num += gate_num;
     }
-    single_gate_count = 0;
-    for (IdxType i = 0; i < single_gate_info.size(); i++)
-    {
-        if (single_gate_info[i].ctrl == -1 && strcmp(OP_NAMES[single_gate_info[i].op_name], "MA") != 0 && visited_gate.find(i) == visited_gate.end())
-        {
-            Gate cur_gate = single_gate_info[i];
-            IdxType q_qubit = mapping[single_gate_info[i].qubit];
-            cur_gate.qubit = q_qubit;
-            return_circuit.push_back(cur_gate);
-        }
-    }
+    schedule.finish(mapping, return_circuit);
     initial_mapping = mapping;
+    if (stats)
+        stats->rounds++;
     if (debug_level > 1)
     {
         cout << "total maIdxTypeainlayer time is: " << fixed << setprecision(1)
@@ -463,16 +1047,17 @@ IdxType one_round_optimization(vector<IdxType> &initial_mapping, vector<Gate> ci
     return swap_num;
 }
 
-void Routing(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_level)
+// Random initial layout (from the seed, or random_device if seed < 0) refined
+// by a forward and a backward SABRE round over the gates
+inline vector<IdxType> sabre_initial_layout(const vector<Gate> &gate_info, shared_ptr<Chip> chip, IdxType n_qubits,
+                                            IdxType seed, IdxType debug_level, RoutingStats *stats = nullptr,
+                                            const SabreOptions &options = SabreOptions(), const RunControl *control = nullptr)
 {
-    IdxType n_qubits = IdxType(circuit->num_qubits());
-    vector<Gate> gate_info = circuit->get_gates();
-
     vector<Gate> cx_gates;
     for (IdxType i = 0; i < gate_info.size(); i++)
     {
         Gate gate = gate_info[i];
-        if (gate.ctrl != -1 && strcmp(OP_NAMES[gate.op_name], "MA") != 0)
+        if (OP_ARITY[gate.op_name] == 2)
         {
             cx_gates.push_back(gate);
         }
@@ -481,27 +1066,21 @@ void Routing(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_l
     vector<IdxType> initial_mapping(n_qubits, 0);
     iota(initial_mapping.begin(), initial_mapping.end(), 0);
     random_device rd;
-    mt19937 g(rd());
+    mt19937 g(seed < 0 ? rd() : (unsigned int)seed);
     shuffle(initial_mapping.begin(), initial_mapping.end(), g);
     if (debug_level > 1)
         cout << "******* 1st round sabre optimization *******" << endl;
     //^ sabre optimization
-    // I need gate qubit, and also gate name
-    vector<pair<IdxType, IdxType>> cx_gates_pair;
     vector<vector<IdxType>> all_gates_index;
-    for (auto &gate : cx_gates)
-    {
-        cx_gates_pair.push_back(make_pair(gate.ctrl, gate.qubit));
-    }
     vector<Gate> return_circuit;
-    return_circuit.clear();
-    IdxType swap_num = one_round_optimization(initial_mapping, cx_gates, chip->distance_mat, gate_info, chip, all_gates_index, return_circuit, debug_level);
+    // these rounds only refine the layout, so the other operations are left out
+    one_round_optimization(initial_mapping, cx_gates, chip->distance_mat, cx_gates, chip, all_gates_index, return_circuit, debug_level, stats, options,
+                                              control, 0);
 
     // ^ second round optimization
     if (debug_level > 1)
         cout << "******* 2nd round sabre optimization *******" << endl;
     reverse(cx_gates.begin(), cx_gates.end());
-    vector<string> reverse_name;
     vector<vector<IdxType>> reverse_gate_qubit;
 
     for (IdxType i = all_gates_index.size(); i > 0; --i)
@@ -509,13 +1088,53 @@ void Routing(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_l
         reverse_gate_qubit.push_back(all_gates_index[i - 1]);
     }
     return_circuit.clear();
-    swap_num = one_round_optimization(initial_mapping, cx_gates, chip->distance_mat, gate_info, chip, reverse_gate_qubit, return_circuit, debug_level);
+    one_round_optimization(initial_mapping, cx_gates, chip->distance_mat, cx_gates, chip, reverse_gate_qubit, return_circuit, debug_level, stats, options,
+                           control, 1);
+    return initial_mapping;
+}
+
+// Set the mapping of the routed circuit (logical qubit -> physical qubit of
+// the routing), composed with the relabelling of the logical qubits by an
+// earlier pass (e.g., Remap), if any
+inline void set_routed_mapping(shared_ptr<Circuit> circuit, const vector<IdxType> &mapping)
+{
+    vector<IdxType> prior_mapping = circuit->get_mapping();
+    if (prior_mapping.empty())
+    {
+        circuit->set_mapping(mapping);
+        return;
+    }
+    vector<IdxType> composed_mapping(prior_mapping.size());
+    for (IdxType i = 0; i < (IdxType)prior_mapping.size(); i++)
+        composed_mapping[i] = mapping[prior_mapping[i]];
+    circuit->set_mapping(composed_mapping);
+}
+
+// seed < 0 draws the random initial mapping from random_device
+inline void Routing(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_level, IdxType seed = -1,
+                    RoutingStats *stats = nullptr, const SabreOptions &options = SabreOptions(), const RunControl *control = nullptr)
+{
+    steady_timer routing_timer;
+    routing_timer.start_timer();
+    IdxType n_qubits = IdxType(circuit->num_qubits());
+    vector<Gate> gate_info = circuit->get_gates();
+
+    vector<Gate> cx_gates;
+    for (IdxType i = 0; i < gate_info.size(); i++)
+    {
+        Gate gate = gate_info[i];
+        if (OP_ARITY[gate.op_name] == 2)
+        {
+            cx_gates.push_back(gate);
+        }
+    }
+    vector<IdxType> initial_mapping = sabre_initial_layout(gate_info, chip, n_qubits, seed, debug_level, stats, options, control);
+    vector<vector<IdxType>> all_gates_index;
+    vector<Gate> return_circuit;
 
     //^ third
     if (debug_level > 1)
         cout << "******* 3rd round sabre optimization *******" << endl;
-    return_circuit.clear();
-    reverse(cx_gates.begin(), cx_gates.end());
     // circuit->set_cur_mapping(initial_mapping);
     if (debug_level > 1)
     {
@@ -526,19 +1145,14 @@ void Routing(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_l
         }
         cout << endl;
     }
-    swap_num = one_round_optimization(initial_mapping, cx_gates, chip->distance_mat, gate_info, chip, all_gates_index, return_circuit, debug_level);
-    vector<Gate> gate_info_after_transpiler;
-    vector<Gate> decompose_gate_info;
-    vector<string> decompose_gate_name;
-    vector<pair<IdxType, IdxType>> decompose_gate_qubit;
-    //^ now we have all the mapping and routing, we can do the gate decompose
-    circuit->set_mapping(initial_mapping);
-    // Gate MA_gate = gate_info[gate_info.size() - 1];
-    // return_circuit.push_back(MA_gate);
-    gate_info = gate_info_after_transpiler;
-    IdxType n_gates = IdxType(gate_info_after_transpiler.size());
-    gate_info = return_circuit;
-
+    IdxType swap_num = one_round_optimization(initial_mapping, cx_gates, chip->distance_mat, gate_info, chip, all_gates_index, return_circuit, debug_level, stats, options,
+                                              control);
+    set_routed_mapping(circuit, initial_mapping);
     circuit->set_gates(return_circuit);
-    n_gates = IdxType(return_circuit.size());
+    routing_timer.stop_timer();
+    if (stats)
+    {
+        stats->final_swaps += swap_num;
+        stats->total_ns += routing_timer.measure_ns();
+    }
 }
\ No newline at end of file
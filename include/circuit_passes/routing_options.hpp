@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+
+#include "../QASMTransPrimitives.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+/***********************************************
+ * Options of the routing passes: the SABRE
+ * cost of a SWAP, the routing engine and the
+ * parallel routing modes. Set from the CLI,
+ * server requests, qasmtrans_bench and the
+ * qasmtrans_routing_options of the C API.
+ ***********************************************/
+
+// Parameters of the SABRE cost of a SWAP:
+// max(decay[a], decay[b]) * (mean front distance + extended_weight * mean extended distance)
+struct SabreOptions
+{
+    // gates in the extended set, the DAG successors of the front layer (breadth first)
+    IdxType extended_size = 20;
+    double extended_weight = 0.5;
+    // added to the decay factor of both qubits of a SWAP, so that the next
+    // SWAPs prefer other qubits; the factors go back to 1 when a gate is
+    // executed or after decay_reset SWAPs
+    double decay = 0;
+    IdxType decay_reset = 5;
+    // SWAPs without an executed gate after which the release valve moves the
+    // closest front layer gate along a shortest path
+    IdxType stagnation_limit = 100;
+    // SWAPs per 2-qubit gate a routing round may insert before it routes
+    // every gate through the release valve
+    IdxType max_swaps_per_gate = 10;
+    // depth-aware routing: each step inserts a set of SWAPs on disjoint qubits,
+    // which share a layer, and a SWAP costs depth_weight per SWAP duration it
+    // waits for its qubits beyond the earliest candidate
+    bool parallel_swaps = false;
+    double depth_weight = 0.1;
+    // up to this many commuting 2-qubit gates on a wire (e.g., the RZZ of a
+    // QAOA layer) form a block that may execute in any order, see
+    // commutation_DAG_generator; 1 keeps the circuit order. Longer blocks
+    // save SWAPs but let the router serialize pipelined circuits such as QFT.
+    IdxType commutation_block = 3;
+    // routing engine: beam search over sequences of search_depth SWAPs
+    // instead of SABRE's greedy choice (see swap_search.hpp), keeping
+    // beam_width mappings per level and at most about search_nodes per
+    // search; 0 threads: all cores
+    bool beam_search = false;
+    IdxType beam_width = 16;
+    IdxType search_depth = 3;
+    IdxType search_nodes = 100000;
+    IdxType search_threads = 0;
+    // execute a distance-2 CX through the qubit between its qubits (four CX)
+    // instead of a SWAP when the SWAP would not help the following gates,
+    // see pick_bridge
+    bool bridge = false;
+    // routing of this many consecutive slices of the circuit in parallel,
+    // joined by token swapping (see sliced_routing.hpp); 1: no slicing
+    IdxType time_slices = 1;
+
+    void validate() const
+    {
+        if (extended_size < 0 || extended_weight < 0 || decay < 0 || decay_reset < 1)
+            throw invalid_argument("SABRE options: extended set size, weight and decay must be >= 0, decay reset >= 1");
+        if (stagnation_limit < 1 || max_swaps_per_gate < 1)
+            throw invalid_argument("SABRE options: stagnation limit and SWAPs per gate must be >= 1");
+        if (depth_weight < 0)
+            throw invalid_argument("SABRE options: depth weight must be >= 0");
+        if (commutation_block < 1)
+            throw invalid_argument("SABRE options: commutation block must be >= 1");
+        if (beam_width < 1 || search_depth < 1 || search_nodes < 1 || search_threads < 0)
+            throw invalid_argument("SABRE options: beam width, search depth and nodes must be >= 1, search threads >= 0");
+        if (time_slices < 1)
+            throw invalid_argument("SABRE options: time slices must be >= 1");
+    }
+
+    // e.g., for cache keys and reports
+    string to_string() const
+    {
+        return "ext_size=" + std::to_string(extended_size) + ",ext_weight=" + std::to_string(extended_weight) +
+               ",decay=" + std::to_string(decay) + ",decay_reset=" + std::to_string(decay_reset) + ",stagnation=" + std::to_string(stagnation_limit) +
+               ",max_swaps_per_gate=" + std::to_string(max_swaps_per_gate) +
+               (parallel_swaps ? ",parallel_swaps,depth_weight=" + std::to_string(depth_weight) : "") +
+               ",commutation_block=" + std::to_string(commutation_block) +
+               (beam_search ? ",beam_width=" + std::to_string(beam_width) + ",search_depth=" + std::to_string(search_depth) +
+                                  ",search_nodes=" + std::to_string(search_nodes)
+                            : "") +
+               (bridge ? ",bridge" : "") +
+               (time_slices > 1 ? ",time_slices=" + std::to_string(time_slices) : "");
+    }
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "../QASMTransPrimitives.hpp"
+
+#include "../IR/gate.hpp"
+#include "../IR/circuit.hpp"
+#include "../IR/chip.hpp"
+#include "../run_control.hpp"
+#include "routing_options.hpp"
+#include "routing_mapping.hpp"
+#include "component_routing.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+/***********************************************
+ * Routing of time slices in parallel, selected
+ * by SabreOptions::time_slices.
+ *
+ * The gate list is cut into consecutive slices
+ * with about the same number of 2-qubit gates
+ * (never inside a barrier). Each slice is routed
+ * on its own thread as Routing does (SABRE layout
+ * rounds over the slice, then the output round),
+ * from the layout those rounds estimate for the
+ * start of the slice. Between two slices, the
+ * layout the first one ends in is turned into the
+ * layout the next one starts from by a network of
+ * SWAPs found by token swapping, unless the next
+ * slice runs without SWAPs from that layout.
+ * Slicing gives up the SWAPs of these networks
+ * (stitch_swaps of RoutingStats) for a routing
+ * time divided by up to the number of slices on
+ * as many cores.
+ ***********************************************/
+
+// 2-qubit gates per slice and logical qubit below which fewer slices are
+// used: a SWAP network costs up to about (qubits * chip diameter / 2) SWAPs
+const IdxType MIN_SLICE_GATES_PER_QUBIT = 32;
+
+// SWAPs (physical qubits) on the couplings of the chip that move each logical
+// qubit l from physical qubit from[l] to to[l], by approximate token swapping
+// (Miltzow et al., 2016): SWAPs that bring both tokens closer to their
+// destination (or move a token onto a free qubit) first, then SWAPs along a
+// cycle of tokens that each get closer, else one SWAP that moves a token
+// closer at the expense of a token in place.
+inline vector<pair<IdxType, IdxType>> token_swaps(shared_ptr<Chip> chip, const vector<IdxType> &from, const vector<IdxType> &to)
+{
+    IdxType n = chip->qubit_num;
+    const vector<vector<IdxType>> &distance_mat = chip->distance_mat;
+    // destination of the token on each physical qubit, -1 if free
+    vector<IdxType> dest(n, -1);
+    // the mappings of a routing round may be padded with -1 up to the chip size
+    for (size_t l = 0; l < min(from.size(), to.size()); l++)
+    {
+        if (from[l] >= 0)
+            dest[from[l]] = to[l];
+    }
+    vector<pair<IdxType, IdxType>> swaps;
+    auto apply_swap = [&](IdxType a, IdxType b)
+    {
+        swap(dest[a], dest[b]);
+        swaps.push_back(make_pair(a, b));
+    };
+    auto closer = [&](IdxType p, IdxType q)
+    { return dest[p] >= 0 && distance_mat[q][dest[p]] < distance_mat[p][dest[p]]; };
+    // each step reduces the total distance or moves towards a step that does
+    IdxType max_swaps = n * n * n + 1;
+    while ((IdxType)swaps.size() < max_swaps)
+    {
+        IdxType start = -1;
+        bool happy = false;
+        for (IdxType p = 0; p < n && !happy; p++)
+        {
+            if (dest[p] < 0 || dest[p] == p)
+                continue;
+            if (start < 0)
+                start = p;
+            for (IdxType q : chip->edge_list[p])
+            {
+                if (closer(p, q) && (dest[q] < 0 || closer(q, p)))
+                {
+                    apply_swap(p, q);
+                    happy = true;
+                    break;
+                }
+            }
+        }
+        if (happy)
+            continue;
+        if (start < 0)
+            return swaps;
+        // follow the moves the tokens want until a token in place or a cycle
+        vector<IdxType> path(1, start);
+        vector<IdxType> position(n, -1);
+        position[start] = 0;
+        while (true)
+        {
+            IdxType p = path.back();
+            if (dest[p] == p)
+            {
+                apply_swap(path[path.size() - 2], p);
+                break;
+            }
+            IdxType next = -1;
+            for (IdxType q : chip->edge_list[p])
+            {
+                if (closer(p, q))
+                {
+                    next = q;
+                    break;
+                }
+            }
+            if (position[next] >= 0)
+            {
+                // rotate the cycle: every token on it moves one step closer
+                for (IdxType i = path.size() - 1; i > position[next]; i--)
+                    apply_swap(path[i - 1], path[i]);
+                break;
+            }
+            position[next] = path.size();
+            path.push_back(next);
+        }
+    }
+    throw logic_error("Token swapping did not converge");
+}
+
+inline vector<Gate> two_qubit_gates(const vector<Gate> &gates)
+{
+    vector<Gate> selected;
+    for (const Gate &g : gates)
+    {
+        if (OP_ARITY[g.op_name] == 2)
+            selected.push_back(g);
+    }
+    return selected;
+}
+
+// Route the circuit in options.time_slices slices in parallel (see above);
+// seed s + i routes slice i
+inline void SlicedRouting(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, IdxType debug_level, IdxType seed = -1,
+                          RoutingStats *stats = nullptr, const SabreOptions &options = SabreOptions(),
+                          const RunControl *control = nullptr)
+{
+    steady_timer routing_timer;
+    routing_timer.start_timer();
+    IdxType n_qubits = circuit->num_qubits();
+    vector<Gate> gate_info = circuit->get_gates();
+    IdxType n_2q = 0;
+    for (const Gate &g : gate_info)
+        n_2q += OP_ARITY[g.op_name] == 2;
+    IdxType n_slices = min(options.time_slices, n_2q / (MIN_SLICE_GATES_PER_QUBIT * n_qubits));
+    if (n_slices <= 1)
+    {
+        Routing(circuit, chip, debug_level, seed, stats, options, control);
+        return;
+    }
+
+    //^ cut after every n_2q / n_slices 2-qubit gates, outside barriers
+    vector<vector<Gate>> slice_gates(1);
+    IdxType seen_2q = 0;
+    for (size_t i = 0; i < gate_info.size(); i++)
+    {
+        const Gate &g = gate_info[i];
+        if (OP_ARITY[g.op_name] == 0)
+            continue;
+        if ((IdxType)slice_gates.size() < n_slices && seen_2q >= n_2q * (IdxType)slice_gates.size() / n_slices)
+            slice_gates.emplace_back();
+        size_t width = 1;
+        if (g.op_name == OP::BARRIER)
+        {
+            // the BARRIER gates of one barrier are consecutive, see WireSchedule
+            while (width < (size_t)g.n_qubits && i + width < gate_info.size() && gate_info[i + width].op_name == OP::BARRIER)
+                width++;
+        }
+        for (size_t k = i; k < i + width; k++)
+        {
+            seen_2q += OP_ARITY[gate_info[k].op_name] == 2;
+            slice_gates.back().push_back(gate_info[k]);
+        }
+        i += width - 1;
+    }
+    if (debug_level > 0)
+        cout << "Routing " << n_slices << " time slices of about " << n_2q / n_slices << " 2-qubit gates" << endl;
+
+    //^ route the slices: layout rounds, then the output round from their layout
+    vector<vector<IdxType>> start_layout(n_slices), end_layout(n_slices);
+    vector<vector<Gate>> routed(n_slices);
+    vector<RoutingStats> slice_stats(n_slices);
+    vector<RunControl> slice_controls = worker_controls(control, n_slices);
+    run_parallel(n_slices, 0, [&](IdxType s)
+                 {
+                     const RunControl *slice_control = control ? &slice_controls[s] : nullptr;
+                     IdxType slice_seed = seed < 0 ? -1 : seed + s;
+                     start_layout[s] = sabre_initial_layout(slice_gates[s], chip, n_qubits, slice_seed, 0, &slice_stats[s], options, slice_control);
+                     end_layout[s] = start_layout[s];
+                     vector<vector<IdxType>> all_gates_index;
+                     slice_stats[s].final_swaps += one_round_optimization(end_layout[s], two_qubit_gates(slice_gates[s]), chip->distance_mat, slice_gates[s], chip,
+                                                                          all_gates_index, routed[s], 0, &slice_stats[s], options, slice_control); });
+
+    //^ stitch: join the slices with the SWAP networks between their layouts
+    vector<Gate> return_circuit = routed[0];
+    IdxType stitch_swaps = 0;
+    for (IdxType s = 1; s < n_slices; s++)
+    {
+        // a slice whose 2-qubit gates are all on couplings in the layout the
+        // previous one ends in (e.g., on a layout without SWAPs found again
+        // up to a symmetry of the chip) is routed again from that layout
+        const vector<IdxType> &previous = end_layout[s - 1];
+        bool in_place = all_of(slice_gates[s].begin(), slice_gates[s].end(), [&](const Gate &g)
+                               { return OP_ARITY[g.op_name] != 2 || chip->distance_mat[previous[g.ctrl]][previous[g.qubit]] == 1; });
+        if (in_place)
+        {
+            start_layout[s] = end_layout[s] = previous;
+            routed[s].clear();
+            // the counters of the first routing of the slice no longer apply
+            slice_stats[s] = RoutingStats();
+            vector<vector<IdxType>> all_gates_index;
+            slice_stats[s].final_swaps += one_round_optimization(end_layout[s], two_qubit_gates(slice_gates[s]), chip->distance_mat, slice_gates[s], chip,
+                                                                 all_gates_index, routed[s], 0, &slice_stats[s], options,
+                                                                 control ? &slice_controls[s] : nullptr);
+        }
+        vector<pair<IdxType, IdxType>> network = token_swaps(chip, end_layout[s - 1], start_layout[s]);
+        for (auto &swap_pair : network)
+            return_circuit.push_back(Gate(OP::SWAP, swap_pair.second, swap_pair.first));
+        stitch_swaps += network.size();
+        return_circuit.insert(return_circuit.end(), routed[s].begin(), routed[s].end());
+    }
+    if (debug_level > 0)
+        cout << "Time slices joined by " << stitch_swaps << " SWAPs" << endl;
+    set_routed_mapping(circuit, end_layout[n_slices - 1]);
+    circuit->set_gates(return_circuit);
+    routing_timer.stop_timer();
+    join_worker_controls(control, slice_controls);
+    if (stats)
+    {
+        for (IdxType s = 0; s < n_slices; s++)
+            stats->merge(slice_stats[s]);
+        stats->stitch_swaps += stitch_swaps;
+        stats->final_swaps += stitch_swaps;
+        stats->swaps += stitch_swaps;
+        stats->total_ns += routing_timer.measure_ns();
+    }
+}
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+
+#include "../QASMTransPrimitives.hpp"
+
+#include "../IR/gate.hpp"
+#include "../IR/chip.hpp"
+#include "routing_options.hpp"
+#include "swap_scoring.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+/***********************************************
+ * SABRE routing over a sliding window of gates.
+ *
+ * Gates are pushed in circuit order and kept in
+ * per-qubit queues; a 2-qubit gate is in the front
+ * layer when it heads the queues of both of its
+ * qubits, and the extended set is the next
+ * SabreOptions::extended_size pending 2-qubit
+ * gates (in circuit order, which the window
+ * already bounds, rather than DAG successors as in
+ * one_round_optimization). route() only
+ * runs while more than `keep` gates are pending,
+ * so that the front layer always sees a window of
+ * upcoming gates, and hands the routed gates
+ * (physical qubits, SWAPs inserted) back to the
+ * caller. Memory is O(pending gates + qubits).
+ * The release valve and SWAP budget of
+ * one_round_optimization also apply, the budget
+ * counting the 2-qubit gates pushed so far.
+ ***********************************************/
+
+class StreamingRouter
+{
+public:
+    StreamingRouter(shared_ptr<Chip> _chip, const vector<IdxType> &initial_mapping, const SabreOptions &_options = SabreOptions())
+        : chip(_chip), options(_options), l2p(initial_mapping), p2l(_chip->qubit_num, -1),
+          queues(initial_mapping.size()), decay(_chip->qubit_num, 1.0)
+    {
+        for (IdxType l = 0; l < (IdxType)l2p.size(); l++)
+            p2l[l2p[l]] = l;
+    }
+
+    // Append the next input gate (logical qubits, at most two); gates without
+    // qubits (measure all) are dropped as in Routing
+    void push(const Gate &g)
+    {
+        if (OP_ARITY[g.op_name] == 0)
+            return;
+        if (OP_ARITY[g.op_name] > 2)
+            throw logic_error(string("Streaming routing needs 1- and 2-qubit gates, got ") + OP_NAMES[g.op_name]);
+        if (g.op_name == OP::BARRIER || !barrier_pieces.empty())
+        {
+            // a barrier becomes one node on all its wires once its last BARRIER gate is in
+            if (g.op_name == OP::BARRIER)
+                barrier_pieces.push_back(g);
+            if (g.op_name == OP::BARRIER && (IdxType)barrier_pieces.size() < g.n_qubits)
+                return;
+            push_barrier();
+            if (g.op_name == OP::BARRIER)
+                return;
+        }
+        IdxType seq = next_seq++;
+        pending.emplace(seq, g);
+        if (OP_ARITY[g.op_name] == 2)
+        {
+            pending_two_qubit.insert(seq);
+            two_qubit_pushed++;
+            queues[g.ctrl].push_back(seq);
+            queues[g.qubit].push_back(seq);
+            if (queues[g.ctrl].front() == seq && queues[g.qubit].front() == seq)
+                front.insert(seq);
+        }
+        else
+        {
+            queues[g.qubit].push_back(seq);
+        }
+    }
+
+    // Route until at most `keep` gates are pending, appending the routed gates to out
+    void route(IdxType keep, vector<Gate> &out)
+    {
+        flush_single_qubit_heads(out);
+        while ((IdxType)pending.size() > keep && !pending_two_qubit.empty())
+        {
+            if (front.empty())
+                throw logic_error("Streaming routing: every pending 2-qubit gate waits for a barrier");
+            vector<IdxType> executable;
+            for (IdxType seq : front)
+            {
+                const Gate &g = pending.at(seq);
+                if (chip->distance_mat[l2p[g.ctrl]][l2p[g.qubit]] == 1)
+                    executable.push_back(seq);
+            }
+            if (executable.empty())
+            {
+                if (stagnation >= options.stagnation_limit || swaps >= options.max_swaps_per_gate * two_qubit_pushed)
+                    release_valve(out);
+                else
+                {
+                    apply_swap(pick_swap(), out);
+                    stagnation++;
+                }
+                continue;
+            }
+            for (IdxType seq : executable)
+                execute(seq, out);
+            flush_single_qubit_heads(out);
+        }
+    }
+
+    // Route all pending gates
+    void finish(vector<Gate> &out)
+    {
+        if (!barrier_pieces.empty())
+            push_barrier();
+        route(0, out);
+        flush_single_qubit_heads(out);
+    }
+
+    // current logical-to-physical mapping
+    const vector<IdxType> &mapping() const { return l2p; }
+    IdxType num_pending() const { return pending.size(); }
+    IdxType num_swaps() const { return swaps; }
+    IdxType num_releases() const { return releases; }
+
+private:
+    shared_ptr<Chip> chip;
+    SabreOptions options;
+    vector<IdxType> l2p;
+    vector<IdxType> p2l;
+    // pending gates by sequence number, and the pending sequence per qubit
+    map<IdxType, Gate> pending;
+    set<IdxType> pending_two_qubit;
+    vector<deque<IdxType>> queues;
+    set<IdxType> front;
+    vector<IdxType> dirty_qubits;
+    // BARRIER gates of each pending barrier node, and of the barrier being pushed
+    map<IdxType, vector<Gate>> barriers;
+    vector<Gate> barrier_pieces;
+    IdxType next_seq = 0;
+    IdxType swaps = 0;
+    // SABRE decay factor per physical qubit, reset on progress
+    vector<double> decay;
+    IdxType swaps_since_reset = 0;
+    // SWAPs since the last executed gate, and the release valve uses
+    IdxType stagnation = 0;
+    IdxType two_qubit_pushed = 0;
+    IdxType releases = 0;
+
+    void push_barrier()
+    {
+        IdxType seq = next_seq++;
+        pending.emplace(seq, barrier_pieces.front());
+        for (const Gate &piece : barrier_pieces)
+            queues[piece.qubit].push_back(seq);
+        barriers[seq].swap(barrier_pieces);
+        barrier_pieces.clear();
+    }
+
+    void emit_mapped(const Gate &g, vector<Gate> &out)
+    {
+        Gate mapped = g;
+        mapped.qubit = l2p[g.qubit];
+        if (OP_ARITY[g.op_name] == 2)
+            mapped.ctrl = l2p[g.ctrl];
+        out.push_back(mapped);
+    }
+
+    void execute(IdxType seq, vector<Gate> &out)
+    {
+        if (swaps_since_reset > 0)
+        {
+            fill(decay.begin(), decay.end(), 1.0);
+            swaps_since_reset = 0;
+        }
+        stagnation = 0;
+        auto it = pending.find(seq);
+        const Gate &g = it->second;
+        emit_mapped(g, out);
+        queues[g.ctrl].pop_front();
+        queues[g.qubit].pop_front();
+        dirty_qubits.push_back(g.ctrl);
+        dirty_qubits.push_back(g.qubit);
+        front.erase(seq);
+        pending_two_qubit.erase(seq);
+        pending.erase(it);
+    }
+
+    // Emit single-qubit gates (and barriers) that head their queues and
+    // refresh the front layer on the qubits whose queue head changed
+    void flush_single_qubit_heads(vector<Gate> &out)
+    {
+        if (dirty_qubits.empty())
+            for (IdxType q = 0; q < (IdxType)queues.size(); q++)
+                dirty_qubits.push_back(q);
+        while (!dirty_qubits.empty())
+        {
+            IdxType q = dirty_qubits.back();
+            dirty_qubits.pop_back();
+            deque<IdxType> &queue = queues[q];
+            while (!queue.empty())
+            {
+                auto it = pending.find(queue.front());
+                if (OP_ARITY[it->second.op_name] == 2)
+                {
+                    const Gate &g = it->second;
+                    if (queues[g.ctrl].front() == it->first && queues[g.qubit].front() == it->first)
+                        front.insert(it->first);
+                    break;
+                }
+                if (it->second.op_name == OP::BARRIER)
+                {
+                    auto pieces = barriers.find(it->first);
+                    bool heads_all = true;
+                    for (const Gate &piece : pieces->second)
+                        heads_all = heads_all && queues[piece.qubit].front() == it->first;
+                    if (!heads_all)
+                        break;
+                    for (const Gate &piece : pieces->second)
+                    {
+                        emit_mapped(piece, out);
+                        queues[piece.qubit].pop_front();
+                        if (piece.qubit != q)
+                            dirty_qubits.push_back(piece.qubit);
+                    }
+                    barriers.erase(pieces);
+                    pending.erase(it);
+                    continue;
+                }
+                emit_mapped(it->second, out);
+                queue.pop_front();
+                pending.erase(it);
+            }
+        }
+    }
+
+    // Same cost as heuristic(): mean distance of the front layer plus the
+    // weighted mean distance of the extended set
+    double score(const vector<pair<IdxType, IdxType>> &front_pairs, const vector<pair<IdxType, IdxType>> &extended_pairs) const
+    {
+        const vector<vector<IdxType>> &distance_mat = chip->distance_mat;
+        double first_cost = 0;
+        for (auto &p : front_pairs)
+            first_cost += distance_mat[l2p[p.first]][l2p[p.second]];
+        first_cost /= front_pairs.size();
+        if (extended_pairs.empty())
+            return first_cost;
+        double second_cost = 0;
+        for (auto &p : extended_pairs)
+            second_cost += distance_mat[l2p[p.first]][l2p[p.second]];
+        second_cost /= extended_pairs.size();
+        return first_cost + options.extended_weight * second_cost;
+    }
+
+    // Best SWAP (physical qubits) among the couplings of the front layer qubits
+    pair<IdxType, IdxType> pick_swap()
+    {
+        vector<pair<IdxType, IdxType>> front_pairs, extended_pairs;
+        for (IdxType seq : front)
+        {
+            const Gate &g = pending.at(seq);
+            front_pairs.push_back(make_pair(g.ctrl, g.qubit));
+        }
+        for (IdxType seq : pending_two_qubit)
+        {
+            if ((IdxType)extended_pairs.size() >= options.extended_size)
+                break;
+            if (front.count(seq))
+                continue;
+            const Gate &g = pending.at(seq);
+            extended_pairs.push_back(make_pair(g.ctrl, g.qubit));
+        }
+        pair<IdxType, IdxType> best(-1, -1);
+        double best_score = 0;
+        for (auto &fp : front_pairs)
+        {
+            for (IdxType p : {l2p[fp.first], l2p[fp.second]})
+            {
+                for (IdxType target : chip->edge_list[p])
+                {
+                    swap_physical(p, target);
+                    double s = score(front_pairs, extended_pairs) * std::max(decay[p], decay[target]);
+                    swap_physical(p, target);
+                    if (best.first < 0 || s < best_score)
+                    {
+                        best = make_pair(p, target);
+                        best_score = s;
+                    }
+                }
+            }
+        }
+        if (best.first < 0)
+            throw runtime_error("Streaming routing found no SWAP candidate; the device may be disconnected");
+        return best;
+    }
+
+    // Move the front layer gate with the shortest distance along a shortest
+    // path until it can execute
+    void release_valve(vector<Gate> &out)
+    {
+        const vector<vector<IdxType>> &distance_mat = chip->distance_mat;
+        IdxType from = -1, to = -1;
+        for (IdxType seq : front)
+        {
+            const Gate &g = pending.at(seq);
+            if (from < 0 || distance_mat[l2p[g.ctrl]][l2p[g.qubit]] < distance_mat[from][to])
+            {
+                from = l2p[g.ctrl];
+                to = l2p[g.qubit];
+            }
+        }
+        while (distance_mat[from][to] > 1)
+        {
+            IdxType next = -1;
+            for (IdxType neighbor : chip->edge_list[from])
+            {
+                if (distance_mat[neighbor][to] == distance_mat[from][to] - 1)
+                {
+                    next = neighbor;
+                    break;
+                }
+            }
+            if (next < 0)
+                throw runtime_error("Streaming routing: no path between physical qubits " + to_string(from) + " and " +
+                                    to_string(to) + "; the device may be disconnected");
+            apply_swap(make_pair(from, next), out);
+            from = next;
+        }
+        fill(decay.begin(), decay.end(), 1.0);
+        swaps_since_reset = 0;
+        stagnation = 0;
+        releases++;
+    }
+
+    void swap_physical(IdxType p, IdxType q)
+    {
+        IdxType lp = p2l[p], lq = p2l[q];
+        if (lp >= 0)
+            l2p[lp] = q;
+        if (lq >= 0)
+            l2p[lq] = p;
+        p2l[p] = lq;
+        p2l[q] = lp;
+    }
+
+    void apply_swap(pair<IdxType, IdxType> physical, vector<Gate> &out)
+    {
+        swap_physical(physical.first, physical.second);
+        out.push_back(Gate(OP::SWAP, physical.second, physical.first));
+        swaps++;
+        if (++swaps_since_reset % options.decay_reset == 0)
+            fill(decay.begin(), decay.end(), 1.0);
+        else
+        {
+            decay[physical.first] += options.decay;
+            decay[physical.second] += options.decay;
+        }
+    }
+};
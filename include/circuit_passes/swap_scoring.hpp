@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "../QASMTransPrimitives.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+/***********************************************
+ * Batch scoring of the SWAP candidates of one
+ * routing step.
+ *
+ * The physical endpoints of the front layer and
+ * extended set gates are gathered once per step;
+ * each candidate SWAP (a, b) then exchanges a and
+ * b among the endpoints and sums the distances
+ * from the compact uint16 distance matrix of the
+ * chip (Chip::distance16). With AVX-512 or AVX2
+ * enabled at compile time (e.g., CMake option
+ * QASMTRANS_NATIVE_ARCH) 16 or 8 gates are done
+ * per gather; otherwise a scalar loop is used.
+ * Without decay, the scores and the argmin
+ * (first minimum on ties) are those of
+ * heuristic().
+ ***********************************************/
+
+// Gates per vector step; the endpoint arrays are padded to a multiple of it
+constexpr size_t SWAP_SCORE_LANES = 16;
+
+// Physical endpoints of the 2-qubit gates of a layer, padded with (0, 0)
+// pairs, whose distance stays 0 under any SWAP
+struct SwapScoreLayer
+{
+    vector<int32_t> p0, p1;
+    size_t count = 0;
+
+    SwapScoreLayer(const vector<IdxType> &layer, const vector<vector<IdxType>> &circuit, const vector<IdxType> &mapping)
+        : count(layer.size())
+    {
+        size_t padded = (count + SWAP_SCORE_LANES - 1) / SWAP_SCORE_LANES * SWAP_SCORE_LANES;
+        p0.assign(padded, 0);
+        p1.assign(padded, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            p0[i] = (int32_t)mapping[circuit[layer[i]][0]];
+            p1[i] = (int32_t)mapping[circuit[layer[i]][1]];
+        }
+    }
+};
+
+// Sum of the distances of the layer gates with physical qubits a and b exchanged
+inline int64_t swapped_distance_sum(const SwapScoreLayer &layer, int32_t a, int32_t b, const uint16_t *dist, int32_t n)
+{
+    const int32_t *p0 = layer.p0.data();
+    const int32_t *p1 = layer.p1.data();
+    size_t padded = layer.p0.size();
+#if defined(__AVX512F__)
+    const __m512i va = _mm512_set1_epi32(a), vb = _mm512_set1_epi32(b);
+    const __m512i vn = _mm512_set1_epi32(n), low16 = _mm512_set1_epi32(0xFFFF);
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < padded; i += 16)
+    {
+        __m512i x = _mm512_loadu_si512(p0 + i);
+        __m512i y = _mm512_loadu_si512(p1 + i);
+        __mmask16 xa = _mm512_cmpeq_epi32_mask(x, va), xb = _mm512_cmpeq_epi32_mask(x, vb);
+        __mmask16 ya = _mm512_cmpeq_epi32_mask(y, va), yb = _mm512_cmpeq_epi32_mask(y, vb);
+        x = _mm512_mask_mov_epi32(_mm512_mask_mov_epi32(x, xa, vb), xb, va);
+        y = _mm512_mask_mov_epi32(_mm512_mask_mov_epi32(y, ya, vb), yb, va);
+        __m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(x, vn), y);
+        // 32-bit gather of 16-bit entries: keep the low half (distance16 has one entry of padding)
+        __m512i d = _mm512_i32gather_epi32(idx, (const void *)dist, 2);
+        acc = _mm512_add_epi32(acc, _mm512_and_si512(d, low16));
+    }
+    return _mm512_reduce_add_epi32(acc);
+#elif defined(__AVX2__)
+    const __m256i va = _mm256_set1_epi32(a), vb = _mm256_set1_epi32(b);
+    const __m256i vn = _mm256_set1_epi32(n), low16 = _mm256_set1_epi32(0xFFFF);
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < padded; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p0 + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(p1 + i));
+        __m256i xa = _mm256_cmpeq_epi32(x, va), xb = _mm256_cmpeq_epi32(x, vb);
+        __m256i ya = _mm256_cmpeq_epi32(y, va), yb = _mm256_cmpeq_epi32(y, vb);
+        x = _mm256_blendv_epi8(_mm256_blendv_epi8(x, vb, xa), va, xb);
+        y = _mm256_blendv_epi8(_mm256_blendv_epi8(y, vb, ya), va, yb);
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(x, vn), y);
+        __m256i d = _mm256_i32gather_epi32((const int *)dist, idx, 2);
+        acc = _mm256_add_epi32(acc, _mm256_and_si256(d, low16));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int64_t sum = 0;
+    for (size_t i = 0; i < padded; i++)
+    {
+        int32_t x = p0[i] == a ? b : (p0[i] == b ? a : p0[i]);
+        int32_t y = p1[i] == a ? b : (p1[i] == b ? a : p1[i]);
+        sum += dist[x * n + y];
+    }
+    return sum;
+#endif
+}
+
+// Index of the candidate SWAP (physical qubits) with the lowest SABRE cost
+// (see SabreOptions); decay holds the factor of each physical qubit, if any
+inline size_t best_swap_candidate(const vector<pair<IdxType, IdxType>> &candidates, const SwapScoreLayer &front,
+                                  const SwapScoreLayer &future, const vector<uint16_t> &distance16, IdxType n,
+                                  double extended_weight = 0.5, const vector<double> *decay = nullptr)
+{
+    size_t best = 0;
+    double best_score = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        int32_t a = (int32_t)candidates[i].first, b = (int32_t)candidates[i].second;
+        double score = 0;
+        if (front.count > 0)
+        {
+            score = (double)swapped_distance_sum(front, a, b, distance16.data(), (int32_t)n) / front.count;
+            if (future.count > 0)
+                score += extended_weight * ((double)swapped_distance_sum(future, a, b, distance16.data(), (int32_t)n) / future.count);
+            if (decay)
+                score *= std::max((*decay)[a], (*decay)[b]);
+        }
+        if (i == 0 || score < best_score)
+        {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
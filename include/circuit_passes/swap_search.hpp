@@ -0,0 +1,221 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <unordered_set>
+#include <string>
+
+#include "../QASMTransPrimitives.hpp"
+
+#include "../IR/chip.hpp"
+#include "routing_options.hpp"
+#include "swap_scoring.hpp"
+
+using namespace QASMTrans;
+using namespace std;
+
+/***********************************************
+ * Beam search over SWAP sequences, the routing
+ * engine selected by SabreOptions::beam_search.
+ *
+ * Where SABRE commits to the best single SWAP of
+ * each step, the search looks search_depth SWAPs
+ * ahead: level d holds the mappings reached with
+ * d SWAPs, with the gates that became executable
+ * on the way executed (which advances the front
+ * layer of the node). A level keeps the
+ * beam_width distinct mappings with the lowest
+ * SABRE cost of the front layer and extended set
+ * of the step, executed gates counting 0. The
+ * SWAPs towards the best node of the last level
+ * are applied up to the first one that executes
+ * a gate, and the next step searches again. A
+ * search stops early after search_nodes nodes;
+ * large levels are expanded on search_threads
+ * threads.
+ ***********************************************/
+
+// Levels with fewer children than this are expanded serially
+const IdxType PARALLEL_SEARCH_MIN_CHILDREN = 1 << 12;
+
+struct SearchNode
+{
+    vector<IdxType> mapping; // logical to physical
+    vector<IdxType> front;
+    vector<IdxType> executed;
+    // (gate, executed predecessors) for gates with some but not all predecessors executed
+    vector<pair<IdxType, IdxType>> waiting;
+    vector<pair<IdxType, IdxType>> swaps;
+    // SWAPs until the first gate executed, 0 if none did
+    IdxType progress_swaps = 0;
+    double cost = 0;
+};
+
+// Routing state shared by the nodes of one search
+struct SearchContext
+{
+    const vector<IdxType> &front;
+    const vector<IdxType> &extended;
+    const vector<vector<IdxType>> &circuit;
+    const vector<vector<IdxType>> &following_gate_idx;
+    const vector<IdxType> &gate_dependency; // predecessors not executed yet
+    shared_ptr<Chip> chip;
+    double extended_weight;
+};
+
+inline IdxType gate_distance(const vector<IdxType> &mapping, const vector<IdxType> &gate, const vector<vector<IdxType>> &distance_mat)
+{
+    return distance_mat[mapping[gate[0]]][mapping[gate[1]]];
+}
+
+// Execute the front gates that became adjacent, repeatedly, and score the node
+inline void settle_search_node(SearchNode &node, const SearchContext &ctx)
+{
+    const vector<vector<IdxType>> &distance_mat = ctx.chip->distance_mat;
+    for (size_t i = 0; i < node.front.size(); i++)
+    {
+        IdxType gate_idx = node.front[i];
+        if (gate_distance(node.mapping, ctx.circuit[gate_idx], distance_mat) != 1)
+            continue;
+        node.executed.push_back(gate_idx);
+        node.front.erase(node.front.begin() + i);
+        i = -1;
+        for (IdxType next_gate_idx : ctx.following_gate_idx[gate_idx])
+        {
+            // 0: no following gate on the qubit (gate 0 follows no gate)
+            if (next_gate_idx == 0)
+                continue;
+            auto it = find_if(node.waiting.begin(), node.waiting.end(), [&](const pair<IdxType, IdxType> &w)
+                              { return w.first == next_gate_idx; });
+            if (it == node.waiting.end())
+            {
+                node.waiting.push_back(make_pair(next_gate_idx, 0));
+                it = node.waiting.end() - 1;
+            }
+            if (++it->second == ctx.gate_dependency[next_gate_idx])
+            {
+                node.front.push_back(next_gate_idx);
+                node.waiting.erase(it);
+            }
+        }
+    }
+    // SABRE cost over the front layer and extended set of the search root,
+    // executed gates counting 0
+    auto layer_cost = [&](const vector<IdxType> &layer)
+    {
+        double total = 0;
+        for (IdxType gate_idx : layer)
+        {
+            if (find(node.executed.begin(), node.executed.end(), gate_idx) == node.executed.end())
+                total += gate_distance(node.mapping, ctx.circuit[gate_idx], distance_mat);
+        }
+        return layer.empty() ? 0.0 : total / layer.size();
+    };
+    node.cost = layer_cost(ctx.front) + ctx.extended_weight * layer_cost(ctx.extended);
+}
+
+// Children of one node: a SWAP on each coupling of the qubits of its front gates
+inline void expand_search_node(const SearchNode &node, const SearchContext &ctx, vector<SearchNode> &children)
+{
+    for (IdxType gate_idx : node.front)
+    {
+        for (IdxType p : {node.mapping[ctx.circuit[gate_idx][0]], node.mapping[ctx.circuit[gate_idx][1]]})
+        {
+            for (IdxType target : ctx.chip->edge_list[p])
+            {
+                SearchNode child = node;
+                for (IdxType &q : child.mapping)
+                {
+                    if (q == p)
+                        q = target;
+                    else if (q == target)
+                        q = p;
+                }
+                child.swaps.push_back(make_pair(p, target));
+                settle_search_node(child, ctx);
+                if (child.progress_swaps == 0 && !child.executed.empty())
+                    child.progress_swaps = child.swaps.size();
+                children.push_back(move(child));
+            }
+        }
+    }
+}
+
+// SWAPs (physical qubits) towards the best node found, up to the first that
+// executes a gate, none if there is no node; `nodes` counts the generated
+// nodes. No gate of the front layer may be executable.
+inline vector<pair<IdxType, IdxType>> search_swaps(const vector<IdxType> &mapping, const vector<IdxType> &front_layer, const SearchContext &ctx,
+                                          const SabreOptions &options, IdxType *nodes = nullptr)
+{
+    vector<SearchNode> beam(1);
+    beam[0].mapping = mapping;
+    beam[0].front = front_layer;
+    IdxType generated = 0;
+    IdxType n_threads = options.search_threads > 0 ? options.search_threads : max(1u, thread::hardware_concurrency());
+    auto key = [](const vector<IdxType> &m)
+    { return string((const char *)m.data(), m.size() * sizeof(IdxType)); };
+    unordered_set<string> seen;
+    seen.insert(key(mapping));
+    auto better = [](const SearchNode &a, const SearchNode &b)
+    { return a.cost < b.cost; };
+    for (IdxType level = 0; level < options.search_depth && generated < options.search_nodes; level++)
+    {
+        //^ expand the beam, in parallel when the level is large
+        IdxType beam_size = beam.size();
+        IdxType estimate = 0;
+        for (const SearchNode &node : beam)
+            // two qubits per front gate, of about four couplings each
+            estimate += node.front.size() * 8;
+        IdxType workers = estimate >= PARALLEL_SEARCH_MIN_CHILDREN ? min(n_threads, beam_size) : 1;
+        vector<vector<SearchNode>> expanded(workers);
+        auto expand_range = [&](IdxType t)
+        {
+            for (IdxType i = t; i < beam_size; i += workers)
+                expand_search_node(beam[i], ctx, expanded[t]);
+        };
+        if (workers > 1)
+        {
+            vector<thread> threads;
+            for (IdxType t = 0; t < workers; t++)
+                threads.emplace_back(expand_range, t);
+            for (auto &t : threads)
+                t.join();
+        }
+        else
+            expand_range(0);
+
+        //^ keep the best distinct mappings; nodes that routed their whole
+        // front layer have no children and stay in the beam
+        vector<SearchNode> children;
+        for (auto &part : expanded)
+        {
+            for (SearchNode &child : part)
+            {
+                generated++;
+                if (seen.insert(key(child.mapping)).second)
+                    children.push_back(move(child));
+            }
+        }
+        for (SearchNode &node : beam)
+        {
+            if (node.front.empty())
+                children.push_back(move(node));
+        }
+        if (children.empty())
+            break;
+        if ((IdxType)children.size() > options.beam_width)
+        {
+            nth_element(children.begin(), children.begin() + options.beam_width, children.end(), better);
+            children.resize(options.beam_width);
+        }
+        sort(children.begin(), children.end(), better);
+        beam.swap(children);
+    }
+    if (nodes)
+        *nodes += generated;
+    vector<pair<IdxType, IdxType>> &swaps = beam[0].swaps;
+    if (beam[0].progress_swaps > 0)
+        swaps.resize(beam[0].progress_swaps);
+    return swaps;
+}
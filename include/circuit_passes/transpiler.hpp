@@ -17,14 +17,33 @@
 
 #include "../dump_qasm.hpp"
 
-#include "routing_mapping.hpp"
-#include "decompose.hpp"
-#include "remapping.hpp"
+#include "pass_manager.hpp"
 
 using namespace QASMTrans;
 using namespace std;
 
-void transpiler(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, map<string, creg> list_cregs, IdxType debug_level, IdxType mode)
+// Basis gate mode for a vendor name (the -m option), -1 if unknown
+inline IdxType mode_from_name(const string &mode_name)
+{
+    if (mode_name == "ibmq" || mode_name == "IBMQ")
+        return 0;
+    if (mode_name == "ionq" || mode_name == "IonQ")
+        return 1;
+    if (mode_name == "Quantinuum" || mode_name == "quantinuum")
+        return 2;
+    if (mode_name == "Rigetti" || mode_name == "rigetti")
+        return 3;
+    if (mode_name == "Quafu" || mode_name == "quafu")
+        return 4;
+    return -1;
+}
+
+// Run the pass pipeline (default: three_to_two, routing, cx_cancellation,
+// decompose) on the circuit and return the statistics of each pass; control
+// sets a deadline, a cancellation token and a progress callback
+inline vector<PassStats> transpiler(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, map<string, creg> list_cregs, IdxType debug_level, IdxType mode,
+                                    IdxType seed = -1, const vector<string> &pipeline = default_pipeline(),
+                                    const SabreOptions &sabre = SabreOptions(), const RunControl *control = nullptr)
 {
     circuit->set_creg(list_cregs);
     IdxType n_qubits = IdxType(circuit->num_qubits());
@@ -38,34 +57,20 @@ void transpiler(shared_ptr<Circuit> circuit, shared_ptr<Chip> chip, map<string,
         std::exit(1);
     }
 
-    //======================================== STEP-1: Initial Gate Decomposition =====================================
-    cpu_timer initial_decompose_timer;
-    initial_decompose_timer.start_timer();
-    Decompose_three_to_two(circuit);
-    initial_decompose_timer.stop_timer();
-    double initial_decompose_time = initial_decompose_timer.measure();
-    if (debug_level > 0)
-        cout << "STEP-1. Initial gate decomposition time: " << (IdxType)initial_decompose_time << "ms" << endl;
-
-    //======================================== STEP-2: Routing and Mapping ============================================
-    cpu_timer routing_timer;
-    routing_timer.start_timer();
-    Routing(circuit, chip, debug_level);
-    routing_timer.stop_timer();
-    double routing_time = routing_timer.measure();
-    if (debug_level > 0)
-        cout << "STEP-2. Routing and mapping time: " << (IdxType)routing_time << "ms" << endl;
-    if (debug_level > 1)
-        cout << circuit->to_string() << endl;
-    //======================================== STEP-3: Basis Gate Decomposition =======================================
-    cpu_timer decompose_timer;
-    decompose_timer.start_timer();
-    Decompose(circuit, mode);
-    decompose_timer.stop_timer();
-    double decompose_time = decompose_timer.measure();
+    PassContext ctx;
+    ctx.chip = chip;
+    ctx.mode = mode;
+    ctx.debug_level = debug_level;
+    ctx.seed = seed;
+    ctx.sabre = sabre;
+    ctx.control = control;
+    vector<PassStats> pass_stats = run_pipeline(circuit, pipeline, ctx);
     if (debug_level > 0)
     {
-        cout << "STEP-3. Basis gate decomposition time: " << (IdxType)decompose_time << "ms" << endl;
-        cout << " total QASMTrans time: " << (IdxType)(initial_decompose_time + routing_time + decompose_time) << "ms" << endl;
+        double total_time = 0;
+        for (auto &stats : pass_stats)
+            total_time += stats.time_ms;
+        cout << " total QASMTrans time: " << (IdxType)total_time << "ms" << endl;
     }
-}
\ No newline at end of file
+    return pass_stats;
+}
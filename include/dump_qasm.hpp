@@ -4,16 +4,18 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include <stdexcept>
 #include <utility>   // for std::make_pair
 #include <algorithm> // for toLowerCase
 
 #include "QASMTransPrimitives.hpp"
 #include "IR/gate.hpp"
 #include "IR/circuit.hpp"
+#include "trace.hpp"
 
 using namespace QASMTrans;
 
-std::string toLowerCase(const std::string &str)
+inline std::string toLowerCase(const std::string &str)
 {
     std::string result = str;
     std::transform(result.begin(), result.end(), result.begin(), 
@@ -21,96 +23,142 @@ std::string toLowerCase(const std::string &str)
             { return std::tolower(c); });
     return result;
 }
-// Function to write QASM file
-void dumpQASM(std::shared_ptr<QASMTrans::Circuit> circuit, const char *filename, std::string &output_path, IdxType debug_level, IdxType mode)
+inline void writeQASMHeader(std::ostream &qasm_file, IdxType n_qubits, const map<string, creg> &cregs)
 {
-    std::string p(filename);
-    std::size_t pos = p.find_last_of("/\\");
-    std::string new_file = p.substr(pos + 1);
-    IdxType n_qubits = IdxType(circuit->num_qubits());
-    std::vector<QASMTrans::Gate> gate_info = circuit->get_gates();
-    map<string, creg> cregs = circuit->get_cregs();
-    std::vector<IdxType> initial_mapping = circuit->get_mapping();
-    // std::cout<<"final mapping is"<<std::endl;
-    // for (auto& qubit : initial_mapping) {
-    //     std::cout<<qubit<<std::endl;
-    // }
-    std::stringstream file_name;
-    std::map<std::string, IdxType> basis_gate_counts;
-    std::ofstream qasm_file;
-    if (output_path == "../data/output_qasm_file/")
+    qasm_file << "OPENQASM 2.0;\n";
+    qasm_file << "include \"qelib1.inc\";\n";
+    qasm_file << "qreg q[" << n_qubits << "];\n";
+    for (auto &creg : cregs)
     {
-        switch (mode)
-        {
-            case 0: //IBMQ
-                file_name << output_path << "transpiled_IBMQ_" << new_file;
-                output_path = output_path + "transpiled_IBMQ_" + new_file;
-                break;
-            case 1: //IonQ
-                file_name << output_path << "transpiled_IonQ_" << new_file;
-                output_path = output_path + "transpiled_IonQ_" + new_file;
-                break;
-            case 2: //Quantinuum
-                file_name << output_path << "transpiled_Quantinuum_" << new_file;
-                output_path = output_path + "transpiled_Quantinuum_" + new_file;
-                break;
-            case 3: //Rigetti
-                file_name << output_path << "transpiled_Rigetti_" << new_file;
-                output_path = output_path + "transpiled_Rigetti_" + new_file;
-                break;
-            case 4: //Quafu
-                file_name << output_path << "transpiled_Quafu_" << new_file;
-                output_path = output_path + "transpiled_Quafu_" + new_file;
-                break;
-            default:
-                std::cerr << "Error: unspecified mode!" << endl;
-                exit(1);
-        }
-        qasm_file.open(file_name.str());
+        qasm_file << "creg " << toLowerCase(creg.first) << "[" << creg.second.width << "];\n";
     }
-    else
+}
+// Register name and bit index of a classical bit (see Gate::cbit)
+inline std::pair<std::string, IdxType> creg_bit(const map<string, creg> &cregs, IdxType cbit)
+{
+    for (auto &creg : cregs)
     {
-        qasm_file.open(output_path);
+        if (cbit >= creg.second.offset && cbit < creg.second.offset + creg.second.width)
+            return std::make_pair(creg.first, cbit - creg.second.offset);
     }
-    // std::cout<<"output path is: "<<filename.str()<<std::endl;
-    if (qasm_file.is_open())
+    throw std::out_of_range("No classical register holds bit " + std::to_string(cbit));
+}
+// The gates measure into classical bits themselves, so the final
+// measurements are not synthesized
+inline bool has_measurements(const std::vector<QASMTrans::Gate> &gates)
+{
+    for (const auto &g : gates)
+    {
+        if (g.op_name == OP::M && g.cbit >= 0)
+            return true;
+    }
+    return false;
+}
+inline void writeQASMGates(std::vector<QASMTrans::Gate> &gates, std::ostream &qasm_file,
+                           std::map<std::string, IdxType> &basis_gate_counts, const map<string, creg> &cregs)
+{
+    for (size_t i = 0; i < gates.size(); i++)
     {
-        qasm_file << "OPENQASM 2.0;\n";
-        qasm_file << "include \"qelib1.inc\";\n";
-        qasm_file << "qreg q[" << n_qubits << "];\n";
-        for (auto &creg : cregs)
+        QASMTrans::Gate &g = gates[i];
+        if (g.op_name == OP::M)
         {
-            qasm_file << "creg " << toLowerCase(creg.first) << "[" << creg.second.width << "];\n";
+            if (g.cbit < 0)
+                continue;
+            auto bit = creg_bit(cregs, g.cbit);
+            qasm_file << "measure q[" << g.qubit << "] -> " << toLowerCase(bit.first) << "[" << bit.second << "];\n";
+            basis_gate_counts["measure"] += 1;
         }
-        for (auto g : gate_info)
+        else if (g.op_name == OP::BARRIER)
         {
-            if (std::strcmp(QASMTrans::OP_NAMES[g.op_name], "MA") != 0)
-            {
-                if (g.gateToString() != "")
-                {
-                    qasm_file << toLowerCase(g.gateToString()) << "; \n";
-                    // add gate name and count to map
-                    std::string gate_name = toLowerCase(QASMTrans::OP_NAMES[g.op_name]);
-                    if (basis_gate_counts.find(gate_name) == basis_gate_counts.end())
-                    {
-                        basis_gate_counts.insert(std::make_pair(gate_name, 1));
-                    }
-                    else
-                    {
-                        basis_gate_counts[gate_name] += 1;
-                    }
-                }
-            }
+            // one statement for the consecutive BARRIER gates of a barrier
+            size_t width = 1;
+            while (width < (size_t)g.n_qubits && i + width < gates.size() && gates[i + width].op_name == OP::BARRIER)
+                width++;
+            qasm_file << "barrier ";
+            for (size_t j = i; j < i + width; j++)
+                qasm_file << (j > i ? "," : "") << "q[" << gates[j].qubit << "]";
+            qasm_file << ";\n";
+            basis_gate_counts["barrier"] += 1;
+            i += width - 1;
         }
-        IdxType creg_index = 0;
-        for (auto &creg : cregs)
+        else if (g.op_name != OP::MA)
         {
-            for (auto &qubit : creg.second.qubit_indices)
+            std::string gate_str = g.gateToString();
+            if (gate_str != "")
             {
-                qasm_file << "measure q[" << circuit->initial_mapping[creg_index] << "] -> " << toLowerCase(creg.first) << "[" << creg_index << "];\n";
-                ++creg_index;
+                qasm_file << toLowerCase(gate_str) << "; \n";
+                // add gate name and count to map
+                basis_gate_counts[toLowerCase(QASMTrans::OP_NAMES[g.op_name])] += 1;
             }
         }
+    }
+}
+// Measurements of all classical bits, through the final logical-to-physical
+// mapping, for circuits without measurements of their own
+inline void writeQASMMeasure(std::ostream &qasm_file, const map<string, creg> &cregs, const std::vector<IdxType> &mapping)
+{
+    IdxType creg_index = 0;
+    for (auto &creg : cregs)
+    {
+        for (size_t i = 0; i < creg.second.qubit_indices.size(); i++)
+        {
+            // circuits that were not routed keep the identity mapping
+            IdxType measured = creg_index < (IdxType)mapping.size() ? mapping[creg_index] : creg_index;
+            qasm_file << "measure q[" << measured << "] -> " << toLowerCase(creg.first) << "[" << creg_index << "];\n";
+            ++creg_index;
+        }
+    }
+}
+// Write the circuit as OpenQASM 2.0, counting the emitted gates per name
+inline void writeQASM(std::shared_ptr<QASMTrans::Circuit> circuit, std::ostream &qasm_file,
+                      std::map<std::string, IdxType> &basis_gate_counts)
+{
+    QASMTRANS_TRACE_SCOPE("write_qasm");
+    map<string, creg> cregs = circuit->get_cregs();
+    writeQASMHeader(qasm_file, circuit->num_qubits(), cregs);
+    writeQASMGates(*circuit->gates, qasm_file, basis_gate_counts, cregs);
+    if (!has_measurements(*circuit->gates))
+        writeQASMMeasure(qasm_file, cregs, circuit->initial_mapping);
+}
+
+// Output file for the input `filename`: output_path itself, or the default
+// directory with a transpiled_<vendor>_ prefix
+inline std::string output_file_path(const char *filename, const std::string &output_path, IdxType mode)
+{
+    if (output_path != "../data/output_qasm_file/")
+        return output_path;
+    std::string p(filename);
+    std::size_t pos = p.find_last_of("/\\");
+    std::string new_file = p.substr(pos + 1);
+    switch (mode)
+    {
+        case 0: //IBMQ
+            return output_path + "transpiled_IBMQ_" + new_file;
+        case 1: //IonQ
+            return output_path + "transpiled_IonQ_" + new_file;
+        case 2: //Quantinuum
+            return output_path + "transpiled_Quantinuum_" + new_file;
+        case 3: //Rigetti
+            return output_path + "transpiled_Rigetti_" + new_file;
+        case 4: //Quafu
+            return output_path + "transpiled_Quafu_" + new_file;
+        default:
+            std::cerr << "Error: unspecified mode!" << endl;
+            exit(1);
+    }
+}
+
+// Function to write QASM file
+inline void dumpQASM(std::shared_ptr<QASMTrans::Circuit> circuit, const char *filename, std::string &output_path, IdxType debug_level, IdxType mode)
+{
+    std::map<std::string, IdxType> basis_gate_counts;
+    std::ofstream qasm_file;
+    output_path = output_file_path(filename, output_path, mode);
+    qasm_file.open(output_path);
+    // std::cout<<"output path is: "<<filename.str()<<std::endl;
+    if (qasm_file.is_open())
+    {
+        writeQASM(circuit, qasm_file, basis_gate_counts);
         // Close the file
         qasm_file.close();
     }
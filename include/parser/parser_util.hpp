@@ -41,7 +41,7 @@ typedef struct inst_indicies
 
 const IdxType UN_DEF = -1;
 
-string DEFAULT_GATES[] = {
+const string DEFAULT_GATES[] = {
     "U", "U3", "U2", "U1", "X", "Y", "Z", "H",
     "S", "SDG", "T", "TDG", "SX",
     "RX", "RY", "RZ",
@@ -58,12 +58,15 @@ const string GATE("GATE");
 const string IF("IF");
 const string MEASURE("MEASURE");
 const string BARRIER("BARRIER");
+const string INPUT("INPUT");
 
 struct qasm_gate
 {
     // Common qasm_gate fields
     string name;
     vector<ValType> params;
+    // symbolic form of params, only set when they depend on circuit parameters
+    vector<AffineExpr> param_exprs;
     vector<IdxType> qubits;
     IdxType repetation = 1;
 
@@ -98,18 +101,20 @@ struct creg
 {
     string name;
     IdxType width;
+    // first classical bit of the register, in declaration order
+    IdxType offset = 0;
     vector<IdxType> qubit_indices;
     IdxType val = 0;
 };
 
-IdxType get_last_rbraket(vector<token> &inst, IdxType start, IdxType end)
+inline IdxType get_last_rbraket(vector<token> &inst, IdxType start, IdxType end)
 {
     for (IdxType i = end - 1; i > start; i--)
         if (inst[i].type == token::e_rbracket)
             return i;
     return -1;
 }
-inst_indicies get_indices(vector<token> &inst, IdxType start, IdxType end)
+inline inst_indicies get_indices(vector<token> &inst, IdxType start, IdxType end)
 {
     inst_indicies indices;
 
@@ -130,25 +135,51 @@ inst_indicies get_indices(vector<token> &inst, IdxType start, IdxType end)
     return indices;
 }
 
-vector<ValType> get_params(vector<token> &inst, IdxType start, IdxType end)
+// [start, end) token range of each comma-separated parameter
+inline vector<pair<IdxType, IdxType>> get_param_ranges(vector<token> &inst, IdxType start, IdxType end)
 {
-    vector<ValType> params;
+    vector<pair<IdxType, IdxType>> ranges;
     if (start == -1)
-        return params;
+        return ranges;
     IdxType cur_start = start;
     for (IdxType i = start; i < end; ++i)
     {
         if (inst[i].type == token::e_comma)
         {
-            params.push_back(parse_expr(inst, cur_start, i));
+            ranges.push_back({cur_start, i});
             cur_start = i + 1;
         }
     }
-    params.push_back(parse_expr(inst, cur_start, end));
+    ranges.push_back({cur_start, end});
+    return ranges;
+}
+
+inline vector<ValType> get_params(vector<token> &inst, IdxType start, IdxType end)
+{
+    vector<ValType> params;
+    for (auto range : get_param_ranges(inst, start, end))
+        params.push_back(parse_expr(inst, range.first, range.second));
     return params;
 }
 
-pair<IdxType, vector<vector<IdxType>>> get_qubits(vector<token> &inst, IdxType start, IdxType end, map<string, qreg> &list_qregs)
+// True if the token range refers to a circuit parameter
+inline bool has_symbols(vector<token> &inst, IdxType start, IdxType end)
+{
+    for (IdxType i = max(start, IdxType(0)); i < end; ++i)
+        if (inst[i].type == token::e_symbol)
+            return true;
+    return false;
+}
+
+inline vector<AffineExpr> get_param_exprs(vector<token> &inst, IdxType start, IdxType end, ParameterTable &table)
+{
+    vector<AffineExpr> param_exprs;
+    for (auto range : get_param_ranges(inst, start, end))
+        param_exprs.push_back(parse_affine_expr(inst, range.first, range.second, table));
+    return param_exprs;
+}
+
+inline pair<IdxType, vector<vector<IdxType>>> get_qubits(vector<token> &inst, IdxType start, IdxType end, map<string, qreg> &list_qregs)
 {
     vector<vector<IdxType>> qubits;
     IdxType repetition = 1;
@@ -168,7 +199,10 @@ pair<IdxType, vector<vector<IdxType>>> get_qubits(vector<token> &inst, IdxType s
 
             if (inst[i + 1].type == token::e_lsqrbracket)
             {
-                sub_qubits.push_back(sub_qubit_offset + stoll(inst[i + 2].value));
+                IdxType index = stoll(inst[i + 2].value);
+                if (index >= list_qregs.at(inst[i].value).width)
+                    throw runtime_error("Qubit index out of range: " + inst[i].value + "[" + inst[i + 2].value + "]");
+                sub_qubits.push_back(sub_qubit_offset + index);
 
                 i += 4;
             }
@@ -200,13 +234,13 @@ vector<T> slices(vector<T> const &v, int m, int n)
     return vec;
 }
 
-IdxType modifyBit(IdxType n, IdxType p, IdxType b)
+inline IdxType modifyBit(IdxType n, IdxType p, IdxType b)
 {
     IdxType mask = 1 << p;
     return ((n & ~mask) | (b << p));
 }
 
-string convert_outcome(IdxType original_out, map<string, creg> &cregs)
+inline string convert_outcome(IdxType original_out, map<string, creg> &cregs)
 {
     stringstream ss;
     IdxType cur_index = 0;
@@ -230,7 +264,7 @@ string convert_outcome(IdxType original_out, map<string, creg> &cregs)
     return ss.str();
 }
 
-map<string, IdxType> *convert_dictionary(map<IdxType, IdxType> &counts, map<string, creg> &cregs)
+inline map<string, IdxType> *convert_dictionary(map<IdxType, IdxType> &counts, map<string, creg> &cregs)
 {
     map<string, IdxType> *converted_counts = new map<string, IdxType>;
     for (const auto &entry : counts)
@@ -250,7 +284,7 @@ map<string, IdxType> *convert_dictionary(map<IdxType, IdxType> &counts, map<stri
     return converted_counts;
 }
 
-map<string, IdxType> *to_binary_dictionary(IdxType num_qubits, map<IdxType, IdxType> &counts)
+inline map<string, IdxType> *to_binary_dictionary(IdxType num_qubits, map<IdxType, IdxType> &counts)
 {
     map<string, IdxType> *binary_counts = new map<string, IdxType>;
     stringstream ss;
@@ -268,7 +302,7 @@ map<string, IdxType> *to_binary_dictionary(IdxType num_qubits, map<IdxType, IdxT
     return binary_counts;
 }
 
-map<string, IdxType> *outcome_to_dict(IdxType *results, IdxType num_qubits, IdxType repetition)
+inline map<string, IdxType> *outcome_to_dict(IdxType *results, IdxType num_qubits, IdxType repetition)
 {
     map<IdxType, IdxType> result_dict;
     for (IdxType i = 0; i < repetition; i++)
@@ -290,7 +324,7 @@ map<string, IdxType> *outcome_to_dict(IdxType *results, IdxType num_qubits, IdxT
  * @param delim
  * @return vector<string>
  */
-vector<string> split(const string &s, char delim);
+inline vector<string> split(const string &s, char delim);
 
 /**
  * @brief Get the index of the target in the vector
@@ -299,7 +333,7 @@ vector<string> split(const string &s, char delim);
  * @param target Target to look for
  * @return int The found index of the target in the list
  */
-int get_index(vector<string> vec, string target);
+inline int get_index(vector<string> vec, string target);
 
 /**
  * @brief Print measurement outcomes
@@ -307,14 +341,14 @@ int get_index(vector<string> vec, string target);
  * @param counts Pointer to the counts dictionary.
  * @param repetition Number of shots performed.
  */
-void print_counts(map<string, IdxType> *counts, IdxType repetition);
+inline void print_counts(map<string, IdxType> *counts, IdxType repetition);
 
-char *getCmdOption(char **begin, char **end, const std::string &option);
-bool cmdOptionExists(char **begin, char **end, const std::string &option);
+inline char *getCmdOption(char **begin, char **end, const std::string &option);
+inline bool cmdOptionExists(char **begin, char **end, const std::string &option);
 
 /************************** IMPLEMENTATION OF UTILITY FUNCTIONS **************************/
 
-vector<string> split(const string &s, char delim)
+inline vector<string> split(const string &s, char delim)
 {
     vector<string> elems;
     stringstream ss(s);
@@ -326,7 +360,7 @@ vector<string> split(const string &s, char delim)
     return elems;
 }
 
-int get_index(vector<string> vec, string target)
+inline int get_index(vector<string> vec, string target)
 {
     for (size_t i = 0; i < vec.size(); i++)
     {
@@ -338,7 +372,7 @@ int get_index(vector<string> vec, string target)
     return -1;
 }
 
-void print_counts(map<string, IdxType> *counts, IdxType repetition)
+inline void print_counts(map<string, IdxType> *counts, IdxType repetition)
 {
     assert(counts != NULL);
     printf("\n===============  Measurement (tests=%lld) ================\n", repetition);
@@ -350,7 +384,7 @@ void print_counts(map<string, IdxType> *counts, IdxType repetition)
     }
 }
 
-char *getCmdOption(char **begin, char **end, const string &option)
+inline char *getCmdOption(char **begin, char **end, const string &option)
 {
     char **itr = find(begin, end, option);
     if (itr != end && ++itr != end)
@@ -360,7 +394,7 @@ char *getCmdOption(char **begin, char **end, const string &option)
     return 0;
 }
 
-bool cmdOptionExists(char **begin, char **end, const string &option)
+inline bool cmdOptionExists(char **begin, char **end, const string &option)
 {
     return find(begin, end, option) != end;
 }
@@ -15,6 +15,7 @@
 
 #include "../QASMTransPrimitives.hpp"
 #include "../IR/circuit.hpp"
+#include "../trace.hpp"
 
 using namespace std;
 using namespace QASMTrans;
@@ -31,23 +32,36 @@ private:
     //vector<qasm_gate> *list_conditional_gates = NULL;
     vector<qasm_gate> list_buffered_measure;
     IdxType global_qubit_offset = 0;
+    IdxType global_clbit_offset = 0;
     vector<token> cur_inst;
     bool contains_if = false;
     bool measure_all = true;
     bool skip_if = false;
+    /* Free parameters of the circuit */
+    shared_ptr<ParameterTable> params = make_shared<ParameterTable>();
     /* Lexer Object */
     generator gen;
     helper::symbol_replacer sr;
     /* File Loading Util */
     ifstream qasmFile;
+    istream *input = NULL;
     string line;
     stringstream ss;
+    /* Streaming state, see stream_gates() */
+    bool streaming = false;
+    bool has_pending_inst = false;
     /* Helper Functions */
+    void parse();
+    void parse_header();
+    void process_instruction();
     void load_instruction();
+    void load_gate(shared_ptr<Circuit> circuit, qasm_gate &gate);
     void parse_gate_defination();
     void generate_circuit(shared_ptr<Circuit> circuit, qasm_gate gate);
+    void generate_parametric_gate(shared_ptr<Circuit> circuit, qasm_gate gate);
     void parse_gate(vector<token> &inst, vector<qasm_gate> *gates);
     void parse_native_gate(vector<token> &inst, vector<qasm_gate> *gates);
+    void parse_barrier(vector<token> &inst, vector<qasm_gate> *gates);
     void parse_defined_gate(vector<token> &inst, vector<qasm_gate> *gates);
     void dump_defined_gates();
     void dump_cur_inst();
@@ -55,15 +69,26 @@ private:
 
 public:
     qasm_parser(const char *filename);
+    // parse an in-memory QASM program
+    qasm_parser(istream &qasm_stream);
+    // with streaming set, only the declarations before the first gate are
+    // parsed; the gates are then read in chunks by stream_gates()
+    qasm_parser(const char *filename, bool streaming);
     const char *filename;
     string sim_method;
+    /* Version of the OPENQASM header, empty if the program has none */
+    string qasm_version;
     IdxType num_qubits();
     void loadin_circuit(shared_ptr<Circuit> circuit);
+    // Append the next gates of a streaming parser to the circuit until it
+    // holds at least max_gates gates; returns false once the input is exhausted
+    bool stream_gates(shared_ptr<Circuit> circuit, IdxType max_gates);
+    bool is_parametric() { return !params->empty(); }
     map<string, creg> get_list_cregs();
     map<string, qreg> get_list_qregs();
     ~qasm_parser();
 };
-string intToBitString(int num, int digitCount)
+inline string intToBitString(int num, int digitCount)
 {
     bitset<32> bitset(num); // Adjust size as needed
     string bitString = bitset.to_string();
@@ -71,96 +96,167 @@ string intToBitString(int num, int digitCount)
     return bitString.substr(bitString.length() - digitCount);
 }
 
-map<string, creg> qasm_parser::get_list_cregs()
+inline map<string, creg> qasm_parser::get_list_cregs()
 {
     return list_cregs;
 }
-map<string, qreg> qasm_parser::get_list_qregs()
+inline map<string, qreg> qasm_parser::get_list_qregs()
 {
     return list_qregs;
 }
 
-qasm_parser::qasm_parser(const char *filename)
+inline qasm_parser::qasm_parser(const char *filename)
 {
     qasmFile.open(filename);
     if (!qasmFile)
         throw runtime_error(string("Could not open qasm file at:") + filename);
     this->filename = filename;
+    input = &qasmFile;
+    parse();
+}
+
+inline qasm_parser::qasm_parser(istream &qasm_stream)
+{
+    this->filename = "<memory>";
+    input = &qasm_stream;
+    parse();
+}
+
+inline qasm_parser::qasm_parser(const char *filename, bool streaming)
+{
+    qasmFile.open(filename);
+    if (!qasmFile)
+        throw runtime_error(string("Could not open qasm file at:") + filename);
+    this->filename = filename;
+    this->streaming = streaming;
+    input = &qasmFile;
+    if (streaming)
+        parse_header();
+    else
+        parse();
+}
+
+inline void qasm_parser::parse()
+{
+    QASMTRANS_TRACE_SCOPE("parse");
     sr.add_replace("pi", "pi", token::e_pi);
     sr.add_replace("sin", "sin", token::e_func);
     sr.add_replace("cos", "cos", token::e_func);
 
     list_gates = new vector<qasm_gate>;
     //list_conditional_gates = new vector<qasm_gate>;
-    while (!qasmFile.eof())
+    while (!input->eof())
     {
         load_instruction();
         // dump_cur_inst();
         if (cur_inst.size() > 0)
+            process_instruction();
+    }
+    // dump_defined_gates();
+    // dump_gates();
+}
+
+inline void qasm_parser::process_instruction()
+{
+    if (cur_inst[INST_NAME].value == OPENQASM)
+    // parse OpenQASM version
+    {
+        // cout << "Executing with OpenQASM " << cur_inst[INST_QASM_VERSION].value << endl;
+        if (cur_inst.size() > INST_QASM_VERSION)
+            qasm_version = cur_inst[INST_QASM_VERSION].value;
+    }
+    else if (cur_inst[INST_NAME].value == QREG)
+    // parse qubit registers
+    {
+        qreg qreg;
+        qreg.name = cur_inst[INST_REG_NAME].value;
+        qreg.width = stoi(cur_inst[INST_REG_WIDTH].value);
+        qreg.offset = global_qubit_offset;
+        global_qubit_offset += qreg.width;
+        list_qregs.insert({qreg.name, qreg});
+        if (global_qubit_offset > 63)
+            skip_if = true;
+    }
+    else if (cur_inst[INST_NAME].value == CREG)
+    // parse classical registers
+    {
+        creg creg;
+        creg.name = cur_inst[INST_REG_NAME].value;
+        creg.width = stoi(cur_inst[INST_REG_WIDTH].value);
+        creg.offset = global_clbit_offset;
+        global_clbit_offset += creg.width;
+        creg.qubit_indices.insert(creg.qubit_indices.end(), creg.width, UN_DEF);
+        list_cregs.insert({creg.name, creg});
+    }
+    else if (cur_inst[INST_NAME].value == INPUT)
+    // declare a circuit parameter, e.g., input float[64] theta;
+    {
+        for (IdxType i = cur_inst.size() - 1; i > 0; i--)
         {
-            if (cur_inst[INST_NAME].value == OPENQASM)
-            // parse OpenQASM version
+            if (cur_inst[i].type == token::e_symbol)
             {
-                // cout << "Executing with OpenQASM " << cur_inst[INST_QASM_VERSION].value << endl;
-            }
-            else if (cur_inst[INST_NAME].value == QREG)
-            // parse qubit registers
-            {
-                qreg qreg;
-                qreg.name = cur_inst[INST_REG_NAME].value;
-                qreg.width = stoi(cur_inst[INST_REG_WIDTH].value);
-                qreg.offset = global_qubit_offset;
-                global_qubit_offset += qreg.width;
-                list_qregs.insert({qreg.name, qreg});
-                if (global_qubit_offset > 63)
-                    skip_if = true;
-            }
-            else if (cur_inst[INST_NAME].value == CREG)
-            // parse classical registers
-            {
-                creg creg;
-                creg.name = cur_inst[INST_REG_NAME].value;
-                creg.width = stoi(cur_inst[INST_REG_WIDTH].value);
-                creg.qubit_indices.insert(creg.qubit_indices.end(), creg.width, UN_DEF);
-                list_cregs.insert({creg.name, creg});
-            }
-            else if (cur_inst[INST_NAME].value == GATE)
-            // parse custom gate definations
-            {
-                parse_gate_defination();
-            }
-            else if (cur_inst[INST_NAME].value == IF)
-            // parse if statement
-            {
-                if (!skip_if)
-                {
-                    qasm_gate cur_gate;
-                    cur_gate.name = IF;
-                    cur_gate.creg_name = cur_inst[INST_IF_CREG].value;
-                    cur_gate.if_creg_val = stoll(cur_inst[INST_IF_VAL].value);
-                    cur_gate.conditional_inst = new vector<qasm_gate>;
-                    auto c_inst = slices(cur_inst, INST_IF_INST_START, cur_inst.size() - 1);
-                    parse_gate(c_inst, cur_gate.conditional_inst);
-                    list_gates->push_back(cur_gate);
-                    contains_if = true;
-                }
-            }
-            else
-            // parse quantum gates
-            {
-                parse_gate(cur_inst, list_gates);
+                params->symbol_index(cur_inst[i].value, true);
+                break;
             }
         }
     }
-    // dump_defined_gates();
-    // dump_gates();
+    else if (cur_inst[INST_NAME].value == GATE)
+    // parse custom gate definations
+    {
+        parse_gate_defination();
+    }
+    else if (cur_inst[INST_NAME].value == IF)
+    // parse if statement
+    {
+        if (!skip_if)
+        {
+            qasm_gate cur_gate;
+            cur_gate.name = IF;
+            cur_gate.creg_name = cur_inst[INST_IF_CREG].value;
+            cur_gate.if_creg_val = stoll(cur_inst[INST_IF_VAL].value);
+            cur_gate.conditional_inst = new vector<qasm_gate>;
+            auto c_inst = slices(cur_inst, INST_IF_INST_START, cur_inst.size() - 1);
+            parse_gate(c_inst, cur_gate.conditional_inst);
+            list_gates->push_back(cur_gate);
+            contains_if = true;
+        }
+    }
+    else
+    // parse quantum gates
+    {
+        parse_gate(cur_inst, list_gates);
+    }
 }
 
-void qasm_parser::load_instruction()
+// Declarations up to the first gate, which is kept in cur_inst for stream_gates()
+inline void qasm_parser::parse_header()
+{
+    QASMTRANS_TRACE_SCOPE("parse");
+    sr.add_replace("pi", "pi", token::e_pi);
+    sr.add_replace("sin", "sin", token::e_func);
+    sr.add_replace("cos", "cos", token::e_func);
+
+    list_gates = new vector<qasm_gate>;
+    while (!input->eof())
+    {
+        load_instruction();
+        if (cur_inst.size() == 0)
+            continue;
+        const string &name = cur_inst[INST_NAME].value;
+        if (name != OPENQASM && name != QREG && name != CREG && name != INPUT && name != GATE)
+        {
+            has_pending_inst = true;
+            return;
+        }
+        process_instruction();
+    }
+}
+
+inline void qasm_parser::load_instruction()
 {
     bool has_eof = false, has_lcurly = false, has_rcurly = false;
     cur_inst.clear();
-    getline(qasmFile, line);
+    getline(*input, line);
     transform(line.begin(), line.end(), line.begin(), ::toupper);
     if (!gen.process(line))
         return;
@@ -193,24 +289,21 @@ void qasm_parser::load_instruction()
         }
         else if (has_lcurly)
         {
-            while (ss.str().find('}') == string::npos)
+            while (ss.str().find('}') == string::npos && getline(*input, line))
             {
-                getline(qasmFile, line);
                 ss << line;
             }
         }
         else
         {
-            while (ss.str().find(';') == string::npos)
+            while (ss.str().find(';') == string::npos && getline(*input, line))
             {
-                getline(qasmFile, line);
                 ss << line;
             }
             if (ss.str().find('{') != string::npos)
             {
-                while (ss.str().find('}') == string::npos)
+                while (ss.str().find('}') == string::npos && getline(*input, line))
                 {
-                    getline(qasmFile, line);
                     ss << line;
                 }
             }
@@ -229,7 +322,7 @@ void qasm_parser::load_instruction()
     }
 }
 
-void qasm_parser::dump_cur_inst()
+inline void qasm_parser::dump_cur_inst()
 {
     for (size_t i = 0; i < cur_inst.size(); ++i)
     {
@@ -238,7 +331,7 @@ void qasm_parser::dump_cur_inst()
     cout << endl;
 }
 
-void qasm_parser::parse_gate_defination()
+inline void qasm_parser::parse_gate_defination()
 {
     defined_gate defined_gate;
     defined_gate.name = cur_inst[INST_GATE_NAME].value;
@@ -262,7 +355,7 @@ void qasm_parser::parse_gate_defination()
             else if (p.type == token::e_symbol)
                 defined_gate.params.push_back(p.value);
             else
-                cout << "INVALID PARAM FOR GATE DEFINATION " << p.value << endl;
+                throw runtime_error("Invalid parameter in gate definition: " + p.value);
         }
     }
     for (auto q : slices(cur_inst, gate_indices.qubit_start, gate_indices.qubit_end))
@@ -272,7 +365,7 @@ void qasm_parser::parse_gate_defination()
         else if (q.type == token::e_symbol)
             defined_gate.qubits.push_back(q.value);
         else
-            cout << "INVALID PARAM FOR GATE DEFINATION " << q.value << endl;
+            throw runtime_error("Invalid parameter in gate definition: " + q.value);
     }
     IdxType cur_start = lcurly_pos + 1;
     for (size_t i = lcurly_pos + 1; i < cur_inst.size(); i++)
@@ -284,7 +377,7 @@ void qasm_parser::parse_gate_defination()
     list_defined_gates.insert({defined_gate.name, defined_gate});
 }
 
-void qasm_parser::parse_gate(vector<token> &inst, vector<qasm_gate> *gates)
+inline void qasm_parser::parse_gate(vector<token> &inst, vector<qasm_gate> *gates)
 {
     if (inst[INST_NAME].value == MEASURE)
     {
@@ -319,21 +412,44 @@ void qasm_parser::parse_gate(vector<token> &inst, vector<qasm_gate> *gates)
             parse_defined_gate(inst, gates);
         else if (find(begin(DEFAULT_GATES), end(DEFAULT_GATES), inst[INST_NAME].value) != end(DEFAULT_GATES))
             parse_native_gate(inst, gates);
-        else if (inst[INST_NAME].value != BARRIER)
+        else if (inst[INST_NAME].value == ::BARRIER)
+            parse_barrier(inst, gates);
+        else
         {
-            cout << "Undefined instruction: ";
+            string text;
             for (auto t : inst)
-                cout << t.value << " ";
-            cout << endl;
+                text += " " + t.value;
+            throw runtime_error("Undefined instruction:" + text);
         }
     }
 }
 
-void qasm_parser::parse_native_gate(vector<token> &inst, vector<qasm_gate> *gates)
+// One gate over all qubits of the barrier operands (a register stands for all its qubits)
+inline void qasm_parser::parse_barrier(vector<token> &inst, vector<qasm_gate> *gates)
+{
+    auto qubits = get_qubits(inst, 1, inst.size(), list_qregs);
+    qasm_gate gate;
+    gate.name = ::BARRIER;
+    for (auto &operand : qubits.second)
+        for (IdxType q : operand)
+            if (find(gate.qubits.begin(), gate.qubits.end(), q) == gate.qubits.end())
+                gate.qubits.push_back(q);
+    gates->push_back(gate);
+}
+
+inline void qasm_parser::parse_native_gate(vector<token> &inst, vector<qasm_gate> *gates)
 {
     inst_indicies indices = get_indices(inst, 0, inst.size());
 
-    auto params = get_params(inst, indices.param_start, indices.param_end);
+    vector<ValType> params;
+    vector<AffineExpr> param_exprs;
+    if (has_symbols(inst, indices.param_start, indices.param_end))
+    {
+        param_exprs = get_param_exprs(inst, indices.param_start, indices.param_end, *this->params);
+        params.assign(param_exprs.size(), 0);
+    }
+    else
+        params = get_params(inst, indices.param_start, indices.param_end);
     auto qubits = get_qubits(inst, indices.qubit_start, indices.qubit_end, list_qregs);
 
     for (IdxType i = 0; i < qubits.first; i++)
@@ -343,6 +459,7 @@ void qasm_parser::parse_native_gate(vector<token> &inst, vector<qasm_gate> *gate
 
         for (auto p : params)
             gate.params.push_back(p);
+        gate.param_exprs = param_exprs;
 
         for (size_t j = 0; j < qubits.second.size(); j++)
         {
@@ -355,7 +472,7 @@ void qasm_parser::parse_native_gate(vector<token> &inst, vector<qasm_gate> *gate
     }
 }
 
-IdxType find_index(vector<string> &vec, string target)
+inline IdxType find_index(vector<string> &vec, string target)
 {
     for (size_t i = 0; i < vec.size(); i++)
         if (vec[i] == target)
@@ -363,7 +480,7 @@ IdxType find_index(vector<string> &vec, string target)
     return -1;
 }
 
-void dump_inst(vector<token> &inst)
+inline void dump_inst(vector<token> &inst)
 {
     for (size_t i = 0; i < inst.size(); ++i)
     {
@@ -372,11 +489,24 @@ void dump_inst(vector<token> &inst)
     cout << endl;
 }
 
-void qasm_parser::parse_defined_gate(vector<token> &inst, vector<qasm_gate> *gates)
+inline void qasm_parser::parse_defined_gate(vector<token> &inst, vector<qasm_gate> *gates)
 {
     auto gate_def = list_defined_gates.at(inst[INST_NAME].value);
     auto indices = get_indices(inst, 0, inst.size());
-    auto params = get_params(inst, indices.param_start, indices.param_end);
+    // symbolic arguments are substituted as bracketed token sequences
+    auto param_ranges = get_param_ranges(inst, indices.param_start, indices.param_end);
+    vector<ValType> params;
+    vector<bool> symbolic;
+    for (auto range : param_ranges)
+    {
+        symbolic.push_back(has_symbols(inst, range.first, range.second));
+        params.push_back(symbolic.back() ? 0 : parse_expr(inst, range.first, range.second));
+    }
+    token lbracket, rbracket;
+    lbracket.type = token::e_lbracket;
+    lbracket.value = "(";
+    rbracket.type = token::e_rbracket;
+    rbracket.value = ")";
     auto qubits = get_qubits(inst, indices.qubit_start, indices.qubit_end, list_qregs);
     for (IdxType i = 0; i < qubits.first; i++)
     {
@@ -388,14 +518,22 @@ void qasm_parser::parse_defined_gate(vector<token> &inst, vector<qasm_gate> *gat
                 cur_qubits.push_back(qubits.second[j][i]);
         for (auto sub_inst : gate_def.instructions)
         {
-            vector<token> dup_inst(sub_inst);
-            for (auto &t : dup_inst)
+            vector<token> dup_inst;
+            for (auto t : sub_inst)
             {
                 IdxType param_idx = find_index(gate_def.params, t.value);
                 IdxType qubit_idx = find_index(gate_def.qubits, t.value);
                 if (param_idx != -1 && qubit_idx != -1)
                     throw runtime_error("Can't use same symbol for both parameter and qubits");
 
+                if (param_idx != -1 && symbolic[param_idx])
+                {
+                    dup_inst.push_back(lbracket);
+                    for (IdxType k = param_ranges[param_idx].first; k < param_ranges[param_idx].second; k++)
+                        dup_inst.push_back(inst[k]);
+                    dup_inst.push_back(rbracket);
+                    continue;
+                }
                 if (param_idx != -1)
                 {
                     t.type = token::e_number;
@@ -406,13 +544,14 @@ void qasm_parser::parse_defined_gate(vector<token> &inst, vector<qasm_gate> *gat
                     t.type = token::e_number;
                     t.value = to_string(cur_qubits[qubit_idx]);
                 }
+                dup_inst.push_back(t);
             }
             parse_gate(dup_inst, gates);
         }
     }
 }
 
-void qasm_parser::dump_defined_gates()
+inline void qasm_parser::dump_defined_gates()
 {
     for (const auto &entry : list_defined_gates)
     {
@@ -439,7 +578,7 @@ void qasm_parser::dump_defined_gates()
     }
 }
 
-void print_gate(qasm_gate gate, bool indent = false)
+inline void print_gate(qasm_gate gate, bool indent = false)
 {
     if (indent)
         cout << "\t";
@@ -462,26 +601,56 @@ void print_gate(qasm_gate gate, bool indent = false)
         cout << "\b;\n";
     }
 }
-void qasm_parser::loadin_circuit(shared_ptr<Circuit> circuit)
+inline void qasm_parser::loadin_circuit(shared_ptr<Circuit> circuit)
 {
-    for (auto gate : *list_gates)
+    QASMTRANS_TRACE_SCOPE("load_circuit");
+    for (auto &gate : *list_gates)
+        load_gate(circuit, gate);
+    if (!params->empty())
+        circuit->params = params;
+}
+inline void qasm_parser::load_gate(shared_ptr<Circuit> circuit, qasm_gate &gate)
+{
+    if (gate.name == IF)
     {
-        if (gate.name == IF)
+        creg creg = list_cregs.at(gate.creg_name);
+        if (creg.val == gate.if_creg_val)
         {
-            creg creg = list_cregs.at(gate.creg_name);
-            if (creg.val == gate.if_creg_val)
-            {
-                for (auto c_gate : *gate.conditional_inst)
-                    generate_circuit(circuit, c_gate);
-            }
+            for (auto c_gate : *gate.conditional_inst)
+                generate_circuit(circuit, c_gate);
         }
-        else
+    }
+    else
+    {
+        generate_circuit(circuit, gate);
+    }
+}
+inline bool qasm_parser::stream_gates(shared_ptr<Circuit> circuit, IdxType max_gates)
+{
+    if (!streaming)
+        throw logic_error("stream_gates() needs a parser constructed for streaming");
+    while (circuit->num_gates() < max_gates)
+    {
+        if (!has_pending_inst)
         {
-            generate_circuit(circuit, gate);
+            if (input->eof())
+                return false;
+            load_instruction();
+            if (cur_inst.size() == 0)
+                continue;
         }
+        has_pending_inst = false;
+        const string &name = cur_inst[INST_NAME].value;
+        if (name == QREG)
+            throw runtime_error("Streaming needs all qreg declarations before the first gate");
+        process_instruction();
+        for (auto &gate : *list_gates)
+            load_gate(circuit, gate);
+        list_gates->clear();
     }
+    return true;
 }
-void qasm_parser::dump_gates()
+inline void qasm_parser::dump_gates()
 {
     for (auto gate : *list_gates)
     {
@@ -500,19 +669,22 @@ void qasm_parser::dump_gates()
     }
 }
 
-IdxType qasm_parser::num_qubits()
+inline IdxType qasm_parser::num_qubits()
 {
     return global_qubit_offset;
 }
 
-void qasm_parser::generate_circuit(shared_ptr<Circuit> circuit, qasm_gate gate)
+inline void qasm_parser::generate_circuit(shared_ptr<Circuit> circuit, qasm_gate gate)
 {
     auto gate_name = gate.name;
     auto params = gate.params;
     auto qubits = gate.qubits;
-    if (gate.name == MEASURE)
-    {
-    }
+    if (!gate.param_exprs.empty())
+        generate_parametric_gate(circuit, gate);
+    else if (gate.name == MEASURE)
+        circuit->M(gate.measured_qubit_index, list_cregs.at(gate.creg_name).offset + gate.creg_index);
+    else if (gate.name == ::BARRIER)
+        circuit->BARRIER(qubits);
     else if (gate_name == "U")
         circuit->U(params[0], params[1], params[2], qubits[0]);
     else if (gate_name == "U1")
@@ -604,7 +776,46 @@ void qasm_parser::generate_circuit(shared_ptr<Circuit> circuit, qasm_gate gate)
     else
         throw logic_error("Undefined gate is called!");
 }
-qasm_parser::~qasm_parser()
+// Emit a gate whose parameters depend on circuit parameters. The angle slots
+// of the generated gate are affine in the QASM parameters (e.g., U2 places
+// them at U(pi/2, phi, lam)); the map is recovered by generating the gate at
+// zero and at each unit parameter, then composed with the parameter exprs.
+inline void qasm_parser::generate_parametric_gate(shared_ptr<Circuit> circuit, qasm_gate gate)
+{
+    shared_ptr<Circuit> scratch = make_shared<Circuit>(num_qubits());
+    qasm_gate probe = gate;
+    probe.param_exprs.clear();
+    probe.params.assign(gate.param_exprs.size(), 0);
+    generate_circuit(scratch, probe);
+    Gate g = scratch->gates->back();
+    GateAngleExpr expr;
+    for (IdxType slot = 0; slot < NUM_ANGLE_SLOTS; slot++)
+        expr[slot] = AffineExpr(angle_slot(g, slot));
+    for (size_t j = 0; j < gate.param_exprs.size(); j++)
+    {
+        probe.params.assign(gate.param_exprs.size(), 0);
+        probe.params[j] = 1;
+        scratch->clear();
+        generate_circuit(scratch, probe);
+        Gate unit = scratch->gates->back();
+        for (IdxType slot = 0; slot < NUM_ANGLE_SLOTS; slot++)
+        {
+            ValType coef = angle_slot(unit, slot) - angle_slot(g, slot);
+            if (coef != 0)
+                expr[slot].add_scaled(gate.param_exprs[j], coef);
+        }
+    }
+    bool is_symbolic = false;
+    for (IdxType slot = 0; slot < NUM_ANGLE_SLOTS; slot++)
+    {
+        angle_slot(g, slot) = expr[slot].evaluate(params->values);
+        is_symbolic = is_symbolic || !expr[slot].is_constant();
+    }
+    if (is_symbolic)
+        g.param_id = params->add_expr(expr);
+    circuit->gates->push_back(g);
+}
+inline qasm_parser::~qasm_parser()
 {
     if (list_gates != NULL)
     {
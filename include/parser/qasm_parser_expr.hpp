@@ -6,11 +6,13 @@
 #include <cmath>
 #include "lexer.hpp"
 #include "../QASMTransPrimitives.hpp"
+#include "../IR/parameter.hpp"
 
 using namespace std;
+using namespace QASMTrans;
 using namespace lexertk;
 
-int get_precedence(token::token_type op)
+inline int get_precedence(token::token_type op)
 {
     switch (op)
     {
@@ -29,7 +31,7 @@ int get_precedence(token::token_type op)
     }
 }
 
-int compare_operators(token::token_type op1, token::token_type op2)
+inline int compare_operators(token::token_type op1, token::token_type op2)
 {
     int op1_precedence = get_precedence(op1);
     int op2_precedence = get_precedence(op2);
@@ -41,7 +43,7 @@ int compare_operators(token::token_type op1, token::token_type op2)
                                                                                  : 0;
 }
 
-bool is_operator(token::token_type op)
+inline bool is_operator(token::token_type op)
 {
     return (op == token::e_pow) ||
            (op == token::e_mul) ||
@@ -52,9 +54,9 @@ bool is_operator(token::token_type op)
 }
 
 /**
- * Parse the expression token using Shunting Yard Algorithm
+ * Convert the expression tokens to postfix order using Shunting Yard Algorithm
  */
-double parse_expr(vector<token> tokens, int start, int end)
+inline queue<token> to_postfix(const vector<token> &tokens, int start, int end)
 {
     stack<token> op_stack;
     queue<token> op_queue;
@@ -67,6 +69,7 @@ double parse_expr(vector<token> tokens, int start, int end)
         {
         case token::e_number:
         case token::e_pi:
+        case token::e_symbol:
             op_queue.push(t);
             break;
 
@@ -96,7 +99,7 @@ double parse_expr(vector<token> tokens, int start, int end)
             break;
 
         case token::e_sub:
-            if (i == 0 || !(tokens[i - 1].type == token::e_number || tokens[i - 1].type == token::e_pi || tokens[i - 1].type == token::e_rbracket))
+            if (i == 0 || !(tokens[i - 1].type == token::e_number || tokens[i - 1].type == token::e_pi || tokens[i - 1].type == token::e_symbol || tokens[i - 1].type == token::e_rbracket))
             {
                 t.type = token::e_negative;
                 t.value = "NEG";
@@ -123,8 +126,7 @@ double parse_expr(vector<token> tokens, int start, int end)
             break;
 
         default:
-            cout << "Unknown token type: " << t.to_str(t.type).c_str() << " " << t.value << endl;
-            break;
+            throw runtime_error("Error: Unknown token type " + t.to_str(t.type) + " " + t.value);
         }
     }
 
@@ -145,7 +147,15 @@ double parse_expr(vector<token> tokens, int start, int end)
     //     num_token--;
     // }
     // cout << endl;
+    return op_queue;
+}
 
+/**
+ * Parse the expression token using Shunting Yard Algorithm
+ */
+inline double parse_expr(vector<token> tokens, int start, int end)
+{
+    queue<token> op_queue = to_postfix(tokens, start, end);
     stack<double> val_stack;
     double val1, val2;
     while (!op_queue.empty())
@@ -162,6 +172,8 @@ double parse_expr(vector<token> tokens, int start, int end)
             val_stack.push(PI);
             // cout << "Pushed PI" << endl;
             break;
+        case token::e_symbol:
+            throw runtime_error("Error: Unbound parameter " + t.value + " in constant expression");
         case token::e_add:
             val2 = val_stack.top();
             val_stack.pop();
@@ -234,11 +246,116 @@ double parse_expr(vector<token> tokens, int start, int end)
                 val_stack.push(-val1);
             }
             else
-                cout << "UNRECOGNIZED FUNCTION: " << t.value << endl;
+                throw runtime_error("Error: Unrecognized function " + t.value);
             break;
         default:
-            cout << "UNRECOGNIZED TOKEN: " << t.value << endl;
+            throw runtime_error("Error: Unrecognized token " + t.value);
+        }
+    }
+    return val_stack.top();
+}
+
+/**
+ * Parse the expression tokens into an affine function of the circuit
+ * parameters. Free symbols are registered in `table` on first use.
+ * Only operations that keep the result affine are accepted.
+ */
+inline AffineExpr parse_affine_expr(vector<token> tokens, int start, int end, ParameterTable &table)
+{
+    queue<token> op_queue = to_postfix(tokens, start, end);
+    stack<AffineExpr> val_stack;
+    AffineExpr val1, val2;
+    auto non_affine = [](const token &t)
+    {
+        return runtime_error("Error: Operation " + t.value + " on a circuit parameter is not affine");
+    };
+    while (!op_queue.empty())
+    {
+        token t = op_queue.front();
+        op_queue.pop();
+        switch (t.type)
+        {
+        case token::e_number:
+            val_stack.push(AffineExpr(stod(t.value)));
+            break;
+        case token::e_pi:
+            val_stack.push(AffineExpr(PI));
+            break;
+        case token::e_symbol:
+            val_stack.push(AffineExpr::symbol(table.symbol_index(t.value, true)));
+            break;
+        case token::e_add:
+        case token::e_sub:
+            val2 = val_stack.top();
+            val_stack.pop();
+            if (val_stack.empty())
+                val1 = AffineExpr(0);
+            else
+            {
+                val1 = val_stack.top();
+                val_stack.pop();
+            }
+            val1.add_scaled(val2, t.type == token::e_add ? 1 : -1);
+            val_stack.push(val1);
+            break;
+        case token::e_mul:
+            val2 = val_stack.top();
+            val_stack.pop();
+            val1 = val_stack.top();
+            val_stack.pop();
+            if (!val1.is_constant() && !val2.is_constant())
+                throw non_affine(t);
+            if (val1.is_constant())
+                swap(val1, val2);
+            // val2 is the constant factor
+            {
+                AffineExpr product(0);
+                product.add_scaled(val1, val2.offset);
+                val_stack.push(product);
+            }
+            break;
+        case token::e_div:
+            val2 = val_stack.top();
+            val_stack.pop();
+            val1 = val_stack.top();
+            val_stack.pop();
+            if (!val2.is_constant())
+                throw non_affine(t);
+            {
+                AffineExpr quotient(0);
+                quotient.add_scaled(val1, 1 / val2.offset);
+                val_stack.push(quotient);
+            }
             break;
+        case token::e_pow:
+            val2 = val_stack.top();
+            val_stack.pop();
+            val1 = val_stack.top();
+            val_stack.pop();
+            if (!val1.is_constant() || !val2.is_constant())
+                throw non_affine(t);
+            val_stack.push(AffineExpr(pow(val1.offset, val2.offset)));
+            break;
+        case token::e_negative:
+            val1 = AffineExpr(0);
+            val1.add_scaled(val_stack.top(), -1);
+            val_stack.pop();
+            val_stack.push(val1);
+            break;
+        case token::e_func:
+            val1 = val_stack.top();
+            val_stack.pop();
+            if (!val1.is_constant())
+                throw non_affine(t);
+            if (t.value == "cos")
+                val_stack.push(AffineExpr(cos(val1.offset)));
+            else if (t.value == "sin")
+                val_stack.push(AffineExpr(sin(val1.offset)));
+            else
+                throw runtime_error("Error: Unrecognized function " + t.value);
+            break;
+        default:
+            throw runtime_error("Error: Unrecognized token " + t.value);
         }
     }
     return val_stack.top();
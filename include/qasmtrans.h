@@ -0,0 +1,198 @@
+#ifndef QASMTRANS_H
+#define QASMTRANS_H
+
+/***********************************************
+ * C API of the qasmtrans library.
+ *
+ * A chip is created once from a device
+ * configuration (data/devices/<name>.json format) and
+ * can be shared by concurrent transpilations.
+ * A circuit is loaded from QASM text, transpiled
+ * in place, and its gates are then read back
+ * directly, without a QASM text round trip.
+ *
+ * Every call returns a status code; on failure
+ * qasmtrans_last_error() describes the error of
+ * the last failed call on the calling thread.
+ ***********************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(QASMTRANS_BUILDING_LIBRARY)
+#define QASMTRANS_API __declspec(dllexport)
+#else
+#define QASMTRANS_API
+#endif
+#else
+#define QASMTRANS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum
+    {
+        QASMTRANS_OK = 0,
+        QASMTRANS_ERR_INVALID_ARGUMENT = 1, /* null handle, bad index or bad option */
+        QASMTRANS_ERR_IO = 2,               /* file cannot be read */
+        QASMTRANS_ERR_PARSE = 3,            /* malformed QASM or device configuration */
+        QASMTRANS_ERR_TRANSPILE = 4,        /* e.g., circuit does not fit on the chip */
+        QASMTRANS_ERR_INTERNAL = 5,
+        QASMTRANS_ERR_CANCELLED = 6         /* cancelled through a qasmtrans_cancel_token */
+    } qasmtrans_status;
+
+    /* Target basis gate set, same as the -m option of the CLI */
+    typedef enum
+    {
+        QASMTRANS_MODE_IBMQ = 0,
+        QASMTRANS_MODE_IONQ = 1,
+        QASMTRANS_MODE_QUANTINUUM = 2,
+        QASMTRANS_MODE_RIGETTI = 3,
+        QASMTRANS_MODE_QUAFU = 4
+    } qasmtrans_mode;
+
+    typedef struct qasmtrans_chip qasmtrans_chip;
+    typedef struct qasmtrans_circuit qasmtrans_circuit;
+
+    /* One gate of a circuit. Unused qubit fields are -1. */
+    typedef struct
+    {
+        const char *name; /* lower-case QASM name, e.g., "cx"; static storage */
+        int32_t op;       /* QASMTrans::OP value */
+        int64_t qubit;    /* target qubit */
+        int64_t ctrl;     /* control (or second) qubit */
+        int64_t extra;    /* third qubit */
+        double theta;
+        double phi;
+        double lam;
+        double gamma;
+        int64_t cbit;     /* bit written by a measure (see num_clbits), -1 otherwise */
+    } qasmtrans_gate;
+
+    /* Message of the last failed call on this thread, "" if none */
+    QASMTRANS_API const char *qasmtrans_last_error(void);
+
+    /*------------------------------ Chip ------------------------------*/
+    /* limited != 0 restricts the chip to the first n physical qubits of
+     * each circuit it transpiles (the -limited option of the CLI) */
+    QASMTRANS_API qasmtrans_status qasmtrans_chip_from_file(const char *path, int limited,
+                                                            qasmtrans_chip **chip);
+    QASMTRANS_API qasmtrans_status qasmtrans_chip_from_json(const char *json, size_t len, int limited,
+                                                            qasmtrans_chip **chip);
+    QASMTRANS_API int64_t qasmtrans_chip_num_qubits(const qasmtrans_chip *chip);
+    QASMTRANS_API void qasmtrans_chip_free(qasmtrans_chip *chip);
+
+    /*----------------------------- Circuit ----------------------------*/
+    /* QASMTRANS_ERR_PARSE for an empty program, a missing OPENQASM header,
+       qubits outside the declared registers or a gate using a qubit twice */
+    QASMTRANS_API qasmtrans_status qasmtrans_circuit_from_qasm(const char *qasm, size_t len,
+                                                               qasmtrans_circuit **circuit);
+    QASMTRANS_API qasmtrans_status qasmtrans_circuit_from_file(const char *path,
+                                                               qasmtrans_circuit **circuit);
+    QASMTRANS_API void qasmtrans_circuit_free(qasmtrans_circuit *circuit);
+
+    /* Route and decompose the circuit in place for the given chip */
+    QASMTRANS_API qasmtrans_status qasmtrans_transpile(qasmtrans_circuit *circuit, const qasmtrans_chip *chip,
+                                                       qasmtrans_mode mode, int debug_level);
+
+    /* SABRE routing parameters, see the -ext_size, -ext_weight, -decay,
+     * -decay_reset, -stagnation, -max_swaps_per_gate, -parallel_swaps,
+     * -depth_weight, -commutation_block, -router (beam_search), -beam_width,
+     * -search_depth, -search_nodes, -search_threads, -bridge and -time_slices
+     * options of the CLI. Start from qasmtrans_routing_options_default, which
+     * sets struct_size: fields added by later versions are appended, and the
+     * library gives the fields beyond struct_size their default. */
+    typedef struct
+    {
+        size_t struct_size;     /* sizeof(qasmtrans_routing_options) of the caller */
+        int64_t extended_size;  /* gates in the extended set (lookahead) */
+        double extended_weight; /* weight of the extended set in the SWAP cost */
+        double decay;           /* added to the qubits of each SWAP, 0 disables it */
+        int64_t decay_reset;    /* SWAPs after which the decay is reset */
+        int64_t seed;           /* seed of the initial mapping, < 0 for a random one */
+        int64_t stagnation_limit;   /* SWAPs without progress before the release valve */
+        int64_t max_swaps_per_gate; /* SWAP budget per 2-qubit gate of a routing round */
+        int parallel_swaps;         /* non-zero for depth-aware routing */
+        double depth_weight;        /* cost per SWAP duration a SWAP waits for its qubits */
+        int64_t commutation_block;  /* commuting 2-qubit gates per qubit that may be reordered */
+        int beam_search;            /* non-zero for the beam search router */
+        int64_t beam_width;         /* mappings kept per search level */
+        int64_t search_depth;       /* SWAPs a search looks ahead */
+        int64_t search_nodes;       /* nodes after which a search stops */
+        int64_t search_threads;     /* threads of the search, 0 for all cores */
+        int bridge;                 /* non-zero to route distance-2 CX through the middle qubit */
+        int64_t time_slices;        /* slices of the circuit routed in parallel, 1 for none */
+    } qasmtrans_routing_options;
+
+    /* Fill in the defaults used by qasmtrans_transpile */
+    QASMTRANS_API void qasmtrans_routing_options_default(qasmtrans_routing_options *options);
+    QASMTRANS_API qasmtrans_status qasmtrans_transpile_with_options(qasmtrans_circuit *circuit, const qasmtrans_chip *chip,
+                                                                    qasmtrans_mode mode, int debug_level,
+                                                                    const qasmtrans_routing_options *options);
+
+    /*--------------------- Deadline and cancellation --------------------*/
+    /* A cancellation token may be set from any thread, e.g., while another
+     * thread is in qasmtrans_transpile_controlled with it */
+    typedef struct qasmtrans_cancel_token qasmtrans_cancel_token;
+    QASMTRANS_API qasmtrans_status qasmtrans_cancel_token_create(qasmtrans_cancel_token **token);
+    QASMTRANS_API void qasmtrans_cancel(qasmtrans_cancel_token *token);
+    QASMTRANS_API void qasmtrans_cancel_token_free(qasmtrans_cancel_token *token);
+
+    /* Progress of a stage: "routing" counts the 2-qubit gates routed over
+     * the three SABRE rounds, "pipeline" the passes done. eta_ms is -1 if
+     * unknown. Called on the transpiling thread. */
+    typedef void (*qasmtrans_progress_fn)(const char *stage, int64_t done, int64_t total, double elapsed_ms,
+                                          double eta_ms, void *user_data);
+
+    /* See the -deadline and -progress options of the CLI. Past the
+     * deadline the result is complete but less optimized; on cancellation
+     * the call returns QASMTRANS_ERR_CANCELLED and the circuit must be freed. */
+    typedef struct
+    {
+        double deadline_ms;             /* from the call, <= 0 for none */
+        qasmtrans_cancel_token *cancel; /* may be NULL */
+        qasmtrans_progress_fn progress; /* may be NULL */
+        void *user_data;                /* passed to progress */
+        double progress_interval_ms;    /* minimum time between two reports of a stage */
+        int deadline_hit;               /* output: non-zero if the deadline cut work short */
+    } qasmtrans_run_control;
+
+    /* qasmtrans_transpile_with_options under a run control (may be NULL) */
+    QASMTRANS_API qasmtrans_status qasmtrans_transpile_controlled(qasmtrans_circuit *circuit, const qasmtrans_chip *chip,
+                                                                  qasmtrans_mode mode, int debug_level,
+                                                                  const qasmtrans_routing_options *options,
+                                                                  qasmtrans_run_control *control);
+
+    QASMTRANS_API int64_t qasmtrans_circuit_num_qubits(const qasmtrans_circuit *circuit);
+    QASMTRANS_API size_t qasmtrans_circuit_num_gates(const qasmtrans_circuit *circuit);
+    QASMTRANS_API qasmtrans_status qasmtrans_circuit_get_gate(const qasmtrans_circuit *circuit, size_t index,
+                                                              qasmtrans_gate *gate);
+    /* Classical bits are numbered like qasmtrans_gate.cbit: registers in
+     * declaration order, so creg b[1]; creg a[2]; makes a[1] bit 2. After
+     * transpilation, bit i holds the measurement of the physical qubit
+     * returned here: the qubit of the last measure into the bit, -1 if
+     * there is none. Circuits without any measure are measured at the
+     * end, bit i reading the qubit that holds logical qubit i. */
+    QASMTRANS_API size_t qasmtrans_circuit_num_clbits(const qasmtrans_circuit *circuit);
+    QASMTRANS_API qasmtrans_status qasmtrans_circuit_measured_qubit(const qasmtrans_circuit *circuit, size_t clbit,
+                                                                    int64_t *qubit);
+
+    /* Free parameters of a parametric circuit (see README), in binding order */
+    QASMTRANS_API size_t qasmtrans_circuit_num_params(const qasmtrans_circuit *circuit);
+    QASMTRANS_API qasmtrans_status qasmtrans_circuit_bind(qasmtrans_circuit *circuit, const double *values,
+                                                          size_t n_values);
+
+    /* OpenQASM 2.0 text of the circuit. The buffer is owned by the circuit
+     * and stays valid until the next call on it or qasmtrans_circuit_free. */
+    QASMTRANS_API qasmtrans_status qasmtrans_circuit_to_qasm(qasmtrans_circuit *circuit, const char **qasm,
+                                                             size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QASMTRANS_H
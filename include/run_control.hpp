@@ -0,0 +1,134 @@
+#pragma once
+
+/***********************************************
+ * Deadline, cancellation and progress reporting
+ * of one transpilation.
+ *
+ * Routing and the pass pipeline poll the
+ * RunControl between units of work (a routing
+ * step, a pass):
+ *  - cancellation throws TranspileCancelled and
+ *    leaves the circuit unusable;
+ *  - past the deadline the result stays complete
+ *    but less optimized: routing skips the layout
+ *    rounds left and finishes its round with the
+ *    release valve, and the pipeline skips the
+ *    passes registered as optional;
+ *  - progress goes to a callback, at most every
+ *    progress_interval_ms except for the report
+ *    after each pass.
+ * Work inside a step (e.g., one beam search) and
+ * non-optional passes are not interrupted.
+ ***********************************************/
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+#include "QASMTransPrimitives.hpp"
+
+namespace QASMTrans
+{
+    struct TranspileProgress
+    {
+        std::string stage; // e.g., "routing" (2-qubit gates of all rounds) or "pipeline" (passes)
+        IdxType done;
+        IdxType total;
+        double elapsed_ms; // since the start of the transpilation
+        double eta_ms;     // of the stage, extrapolated from its rate; -1 if unknown
+    };
+
+    class TranspileCancelled : public std::runtime_error
+    {
+    public:
+        TranspileCancelled() : std::runtime_error("Transpilation cancelled") {}
+    };
+
+    struct RunControl
+    {
+        long long start_ns = get_steady_ns();
+        long long deadline_ns = -1; // steady clock, -1 for none
+        const std::atomic<bool> *cancel = nullptr;
+        std::function<void(const TranspileProgress &)> progress;
+        double progress_interval_ms = 500;
+        // set by run_pipeline when a pass starts
+        mutable long long pass_start_ns = get_steady_ns();
+        // set when the deadline cut some work short
+        mutable bool deadline_hit = false;
+        mutable long long last_report_ns = 0;
+
+        // ms from now (e.g., the start of the job)
+        void set_deadline_ms(double ms) { deadline_ns = get_steady_ns() + (long long)(ms * 1e6); }
+
+        bool past_deadline() const
+        {
+            if (deadline_ns < 0 || get_steady_ns() < deadline_ns)
+                return false;
+            deadline_hit = true;
+            return true;
+        }
+
+        void check_cancelled() const
+        {
+            if (cancel && cancel->load(std::memory_order_relaxed))
+                throw TranspileCancelled();
+        }
+
+        // Report done of total units of the stage that started at stage_start_ns
+        // (-1: no ETA); rate-limited unless forced
+        void report(const std::string &stage, IdxType done, IdxType total, long long stage_start_ns, bool force = false) const
+        {
+            if (!progress)
+                return;
+            long long now = get_steady_ns();
+            if (!force && now - last_report_ns < progress_interval_ms * 1e6)
+                return;
+            last_report_ns = now;
+            double stage_ms = (now - stage_start_ns) / 1e6;
+            double eta = done > 0 && stage_start_ns >= 0 ? stage_ms * (total - done) / done : -1;
+            progress({stage, done, total, (now - start_ns) / 1e6, eta});
+        }
+    };
+
+    // Copies of control for n worker threads (none if control is null),
+    // without the progress callback, which is not thread-safe
+    inline std::vector<RunControl> worker_controls(const RunControl *control, IdxType n)
+    {
+        std::vector<RunControl> controls;
+        for (IdxType i = 0; i < n && control; i++)
+        {
+            controls.push_back(*control);
+            controls.back().progress = nullptr;
+        }
+        return controls;
+    }
+
+    // Pass on to control the deadline hits of its worker copies
+    inline void join_worker_controls(const RunControl *control, const std::vector<RunControl> &controls)
+    {
+        for (const RunControl &worker : controls)
+        {
+            if (worker.deadline_hit)
+                control->deadline_hit = true;
+        }
+    }
+
+    // Progress callback printing one line per report to stderr
+    inline std::function<void(const TranspileProgress &)> stderr_progress()
+    {
+        return [](const TranspileProgress &p)
+        {
+            std::cerr << "progress: " << p.stage << " " << p.done << "/" << p.total << std::fixed << std::setprecision(1);
+            if (p.total > 0)
+                std::cerr << " (" << 100.0 * p.done / p.total << "%)";
+            std::cerr << ", elapsed " << p.elapsed_ms / 1000 << "s";
+            if (p.eta_ms >= 0)
+                std::cerr << ", ETA " << p.eta_ms / 1000 << "s";
+            std::cerr << std::defaultfloat << std::endl;
+        };
+    }
+} // namespace QASMTrans
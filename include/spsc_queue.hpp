@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+/***********************************************
+ * Bounded single-producer single-consumer queue.
+ *
+ * A ring buffer with one atomic index per side,
+ * so push and pop never take a lock. Both block
+ * (yielding the thread) while the queue is full
+ * or empty. The producer calls close() after its
+ * last push; cancel() wakes both sides up, e.g.,
+ * when a pipeline stage failed.
+ ***********************************************/
+
+namespace QASMTrans
+{
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+
+        // Blocks while the queue is full; returns false if it was cancelled
+        bool push(T &&value)
+        {
+            size_t tail = tail_idx.load(std::memory_order_relaxed);
+            size_t next = (tail + 1) % slots.size();
+            while (next == head_idx.load(std::memory_order_acquire))
+            {
+                if (cancelled.load(std::memory_order_relaxed))
+                    return false;
+                std::this_thread::yield();
+            }
+            slots[tail] = std::move(value);
+            tail_idx.store(next, std::memory_order_release);
+            return true;
+        }
+
+        // Blocks while the queue is empty; returns false once it is closed
+        // and drained, or cancelled
+        bool pop(T &value)
+        {
+            size_t head = head_idx.load(std::memory_order_relaxed);
+            while (head == tail_idx.load(std::memory_order_acquire))
+            {
+                if (cancelled.load(std::memory_order_relaxed))
+                    return false;
+                // the last push happens before close(), so check once more
+                if (closed.load(std::memory_order_acquire) && head == tail_idx.load(std::memory_order_acquire))
+                    return false;
+                std::this_thread::yield();
+            }
+            value = std::move(slots[head]);
+            slots[head] = T();
+            head_idx.store((head + 1) % slots.size(), std::memory_order_release);
+            return true;
+        }
+
+        void close() { closed.store(true, std::memory_order_release); }
+        void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    private:
+        std::vector<T> slots;
+        // producer and consumer indices on separate cache lines
+        alignas(64) std::atomic<size_t> head_idx{0};
+        alignas(64) std::atomic<size_t> tail_idx{0};
+        std::atomic<bool> closed{false};
+        std::atomic<bool> cancelled{false};
+    };
+} // namespace QASMTrans
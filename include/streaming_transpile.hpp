@@ -0,0 +1,355 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <set>
+
+#include "QASMTransPrimitives.hpp"
+#include "IR/circuit.hpp"
+#include "IR/chip.hpp"
+#include "parser/qasm_parser.hpp"
+#include "circuit_passes/routing_mapping.hpp"
+#include "circuit_passes/streaming_routing.hpp"
+#include "circuit_passes/decompose.hpp"
+#include "circuit_passes/gate_cancellation.hpp"
+#include "dump_qasm.hpp"
+#include "spsc_queue.hpp"
+#include "trace.hpp"
+#include "nlomann/json.hpp"
+
+using namespace QASMTrans;
+using json = nlohmann::json;
+
+/***********************************************
+ * Streaming transpilation for circuits too large
+ * to hold in memory: gates are read from the
+ * parser in chunks of window/2, routed by the
+ * StreamingRouter with up to window/2 gates kept
+ * pending as lookahead, and each chunk of routed
+ * gates is cancelled, decomposed and written out
+ * right away. The initial layout is refined by
+ * the forward and backward SABRE rounds on a
+ * prefix of `sample` gates. Memory is
+ * O(window + sample + qubits) instead of O(gates).
+ *
+ * The pipeline must contain routing; the other
+ * passes may be three_to_two, cx_cancellation and
+ * decompose, which then work per chunk (CX pairs
+ * across a chunk boundary are not cancelled).
+ *
+ * Pipelined, the four stages (parse, route,
+ * cancel/decompose, write) run on their own
+ * threads connected by bounded SPSC queues of
+ * gate batches; the output is the same as the
+ * serial run and the wall time approaches that of
+ * the slowest stage.
+ ***********************************************/
+
+struct StreamingStats
+{
+    IdxType input_gates = 0;
+    IdxType output_gates = 0;
+    IdxType swaps = 0;
+    IdxType chunks = 0;
+    IdxType sample_gates = 0;
+    IdxType max_pending = 0;
+    bool pipelined = false;
+    // busy time of each stage
+    long long parse_ns = 0;
+    long long layout_ns = 0;
+    long long route_ns = 0;
+    long long post_ns = 0;
+    long long write_ns = 0;
+
+    json to_json() const
+    {
+        return {{"input_gates", input_gates},
+                {"output_gates", output_gates},
+                {"swaps", swaps},
+                {"chunks", chunks},
+                {"sample_gates", sample_gates},
+                {"max_pending", max_pending},
+                {"pipelined", pipelined},
+                {"parse_ns", parse_ns},
+                {"layout_ns", layout_ns},
+                {"route_ns", route_ns},
+                {"post_ns", post_ns},
+                {"write_ns", write_ns}};
+    }
+};
+
+// Gate batches in flight between two pipeline stages
+constexpr size_t STREAM_QUEUE_BATCHES = 4;
+
+// Transpile the gates of a streaming parser (see qasm_parser(filename, true))
+// and write the output QASM to `out`, counting the written gates per name.
+// `pipelined` runs the stages on separate threads.
+inline StreamingStats stream_transpile(qasm_parser &parser, shared_ptr<Chip> chip, std::ostream &out, IdxType mode,
+                                       IdxType seed, IdxType window, IdxType sample, const vector<string> &pipeline,
+                                       IdxType debug_level, std::map<std::string, IdxType> &gate_counts,
+                                       bool pipelined = false, const SabreOptions &sabre = SabreOptions())
+{
+    bool three_to_two = false, routing = false, cx_cancellation = false, decompose = false;
+    for (const string &name : pipeline)
+    {
+        if (name == "three_to_two")
+            three_to_two = true;
+        else if (name == "routing")
+            routing = true;
+        else if (name == "cx_cancellation")
+            cx_cancellation = true;
+        else if (name == "decompose")
+            decompose = true;
+        else
+            throw std::invalid_argument("Pass " + name + " is not supported in streaming mode");
+    }
+    if (!routing)
+        throw std::invalid_argument("Streaming mode needs the routing pass");
+
+    StreamingStats stats;
+    stats.pipelined = pipelined;
+    IdxType n_qubits = parser.num_qubits();
+    IdxType half_window = std::max<IdxType>(1, window / 2);
+    map<string, creg> cregs = parser.get_list_cregs();
+    // registers declared so far, as seen by the write stage
+    std::mutex creg_lock;
+    map<string, creg> known_cregs = cregs;
+    std::set<string> declared_cregs;
+    for (auto &entry : cregs)
+        declared_cregs.insert(entry.first);
+    bool measured = false;
+
+    // Each stage below touches only its own counters, so that the stages
+    // can run on different threads.
+
+    // read the next chunk of input gates; `more` is false at the end of the input
+    auto read_chunk = [&](IdxType max_gates, bool &more)
+    {
+        QASMTRANS_TRACE_SCOPE("stream_parse");
+        steady_timer timer;
+        timer.start_timer();
+        shared_ptr<Circuit> chunk = make_shared<Circuit>(n_qubits);
+        more = parser.stream_gates(chunk, max_gates);
+        if (parser.is_parametric())
+            throw std::invalid_argument("Streaming mode does not support parametric circuits");
+        if (parser.get_list_cregs().size() != known_cregs.size())
+        {
+            std::lock_guard<std::mutex> guard(creg_lock);
+            known_cregs = parser.get_list_cregs();
+        }
+        stats.input_gates += chunk->num_gates();
+        if (three_to_two)
+            Decompose_three_to_two(chunk);
+        stats.chunks++;
+        timer.stop_timer();
+        stats.parse_ns += timer.measure_ns();
+        return chunk;
+    };
+
+    // initial layout from the prefix sample, which is then routed as the first chunk
+    bool more = false;
+    shared_ptr<Circuit> first_chunk = read_chunk(std::max<IdxType>(1, sample), more);
+    stats.sample_gates = first_chunk->num_gates();
+    vector<IdxType> layout;
+    {
+        QASMTRANS_TRACE_SCOPE("stream_layout");
+        steady_timer timer;
+        timer.start_timer();
+        layout = sabre_initial_layout(*first_chunk->gates, chip, n_qubits, seed, debug_level, nullptr, sabre);
+        // the SABRE rounds return one (possibly -1) entry per physical qubit
+        layout.resize(n_qubits);
+        timer.stop_timer();
+        stats.layout_ns = timer.measure_ns();
+    }
+    if (debug_level > 1)
+    {
+        cout << "Streaming initial layout from " << stats.sample_gates << " gates:";
+        for (IdxType q : layout)
+            cout << " " << q;
+        cout << endl;
+    }
+
+    StreamingRouter router(chip, layout, sabre);
+    vector<Gate> routed_gates;
+    // route a chunk; returns a batch of routed gates once at least
+    // half a window has accumulated (or at the end), otherwise nullptr
+    auto route_chunk = [&](const Circuit &chunk, bool last) -> shared_ptr<vector<Gate>>
+    {
+        QASMTRANS_TRACE_SCOPE("stream_route");
+        steady_timer timer;
+        timer.start_timer();
+        for (const Gate &g : *chunk.gates)
+            router.push(g);
+        stats.max_pending = std::max(stats.max_pending, router.num_pending());
+        if (last)
+            router.finish(routed_gates);
+        else
+            router.route(half_window, routed_gates);
+        shared_ptr<vector<Gate>> batch;
+        if (last || (IdxType)routed_gates.size() >= half_window)
+        {
+            batch = make_shared<vector<Gate>>();
+            batch->swap(routed_gates);
+        }
+        timer.stop_timer();
+        stats.route_ns += timer.measure_ns();
+        return batch;
+    };
+
+    // cancel and decompose a batch of routed gates
+    auto post_process = [&](shared_ptr<vector<Gate>> batch)
+    {
+        QASMTRANS_TRACE_SCOPE("stream_post");
+        steady_timer timer;
+        timer.start_timer();
+        shared_ptr<Circuit> routed = make_shared<Circuit>(n_qubits);
+        routed->set_gates(*batch);
+        batch.reset();
+        if (cx_cancellation)
+            CX_cancellation(routed, 0);
+        if (decompose)
+            Decompose(routed, mode);
+        timer.stop_timer();
+        stats.post_ns += timer.measure_ns();
+        return routed;
+    };
+
+    auto write_batch = [&](Circuit &routed)
+    {
+        QASMTRANS_TRACE_SCOPE("stream_write");
+        steady_timer timer;
+        timer.start_timer();
+        map<string, creg> cregs_now;
+        {
+            std::lock_guard<std::mutex> guard(creg_lock);
+            cregs_now = known_cregs;
+        }
+        // a register declared after the first gate is declared before its first measurement
+        for (const Gate &g : *routed.gates)
+        {
+            if (g.op_name != OP::M || g.cbit < 0)
+                continue;
+            measured = true;
+            string name = creg_bit(cregs_now, g.cbit).first;
+            if (declared_cregs.insert(name).second)
+                out << "creg " << toLowerCase(name) << "[" << cregs_now.at(name).width << "];\n";
+        }
+        writeQASMGates(*routed.gates, out, gate_counts, cregs_now);
+        stats.output_gates += routed.num_gates();
+        timer.stop_timer();
+        stats.write_ns += timer.measure_ns();
+    };
+
+    writeQASMHeader(out, n_qubits, cregs);
+    if (!pipelined)
+    {
+        shared_ptr<Circuit> chunk = first_chunk;
+        while (true)
+        {
+            shared_ptr<vector<Gate>> batch = route_chunk(*chunk, !more);
+            if (batch)
+                write_batch(*post_process(batch));
+            if (!more)
+                break;
+            chunk = read_chunk(half_window, more);
+        }
+    }
+    else
+    {
+        SpscQueue<shared_ptr<Circuit>> parsed(STREAM_QUEUE_BATCHES);
+        SpscQueue<shared_ptr<vector<Gate>>> routed(STREAM_QUEUE_BATCHES);
+        SpscQueue<shared_ptr<Circuit>> processed(STREAM_QUEUE_BATCHES);
+        std::exception_ptr failures[4];
+        // run a stage, cancelling all queues if it throws so no stage blocks forever
+        auto run_stage = [&](int idx, std::function<void()> stage)
+        {
+            return std::thread([&, idx, stage]()
+                               {
+                try
+                {
+                    stage();
+                }
+                catch (...)
+                {
+                    failures[idx] = std::current_exception();
+                    parsed.cancel();
+                    routed.cancel();
+                    processed.cancel();
+                } });
+        };
+        bool first_more = more;
+        std::thread threads[4] = {
+            run_stage(0, [&]()
+                      {
+                if (!parsed.push(std::move(first_chunk)))
+                    return;
+                bool more_input = first_more;
+                while (more_input)
+                {
+                    if (!parsed.push(read_chunk(half_window, more_input)))
+                        return;
+                }
+                parsed.close(); }),
+            run_stage(1, [&]()
+                      {
+                shared_ptr<Circuit> chunk, next;
+                if (!parsed.pop(chunk))
+                    return;
+                while (chunk)
+                {
+                    // look one chunk ahead to know whether this is the last one
+                    bool last = !parsed.pop(next);
+                    shared_ptr<vector<Gate>> batch = route_chunk(*chunk, last);
+                    if (batch && !routed.push(std::move(batch)))
+                        return;
+                    chunk = last ? nullptr : std::move(next);
+                }
+                routed.close(); }),
+            run_stage(2, [&]()
+                      {
+                shared_ptr<vector<Gate>> batch;
+                while (routed.pop(batch))
+                {
+                    if (!processed.push(post_process(std::move(batch))))
+                        return;
+                }
+                processed.close(); }),
+            run_stage(3, [&]()
+                      {
+                shared_ptr<Circuit> batch;
+                while (processed.pop(batch))
+                    write_batch(*batch); })};
+        for (std::thread &t : threads)
+            t.join();
+        for (std::exception_ptr &failure : failures)
+        {
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+    }
+
+    // classical registers declared after the first gate and never measured
+    map<string, creg> all_cregs = parser.get_list_cregs();
+    for (auto &entry : all_cregs)
+        if (declared_cregs.find(entry.first) == declared_cregs.end())
+            out << "creg " << toLowerCase(entry.first) << "[" << entry.second.width << "];\n";
+    if (!measured)
+        writeQASMMeasure(out, all_cregs, router.mapping());
+    stats.swaps = router.num_swaps();
+    if (debug_level > 0)
+    {
+        cout << "Streaming" << (pipelined ? " (pipelined)" : "") << ": " << stats.input_gates << " gates in "
+             << stats.chunks << " chunks (window " << window << ", at most " << stats.max_pending
+             << " pending), " << stats.swaps << " swaps, parse " << stats.parse_ns * 1e-6 << "ms, layout "
+             << stats.layout_ns * 1e-6 << "ms, routing " << stats.route_ns * 1e-6 << "ms, cancel/decompose "
+             << stats.post_ns * 1e-6 << "ms, write " << stats.write_ns * 1e-6 << "ms" << endl;
+    }
+    return stats;
+}
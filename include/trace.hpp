@@ -0,0 +1,182 @@
+#pragma once
+
+/***********************************************
+ * Optional tracing of the transpile pipeline in
+ * the Chrome/Perfetto trace-event JSON format
+ * (load the file in chrome://tracing or
+ * ui.perfetto.dev).
+ *
+ * Compiled in only with -DQASMTRANS_TRACE (CMake
+ * option QASMTRANS_TRACE); otherwise the macros
+ * below expand to nothing. When compiled in,
+ * spans are recorded only after trace_start().
+ *
+ *   QASMTRANS_TRACE_SCOPE("routing");   // span until end of scope
+ *   QASMTRANS_TRACE_CIRCUIT(id);        // tag spans of this thread
+ *   QASMTRANS_TRACE_CURRENT_CIRCUIT()   // tag to pass on to worker threads
+ ***********************************************/
+
+#ifdef QASMTRANS_TRACE
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+
+#include "QASMTransPrimitives.hpp"
+#include "nlomann/json.hpp"
+
+namespace QASMTrans
+{
+    struct TraceEvent
+    {
+        const char *name; // string literal
+        long long start_ns;
+        long long dur_ns;
+        long long circuit;
+    };
+
+    // Events of one thread; only that thread appends, under an uncontended lock
+    struct TraceBuffer
+    {
+        long long tid;
+        std::mutex lock;
+        std::vector<TraceEvent> events;
+    };
+
+    class Tracer
+    {
+    public:
+        static Tracer &instance()
+        {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        void start()
+        {
+            origin_ns = get_steady_ns();
+            enabled = true;
+        }
+        bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        TraceBuffer &thread_buffer()
+        {
+            thread_local std::shared_ptr<TraceBuffer> buffer;
+            if (!buffer)
+            {
+                buffer = std::make_shared<TraceBuffer>();
+                std::lock_guard<std::mutex> guard(lock);
+                buffer->tid = buffers.size();
+                buffers.push_back(buffer);
+            }
+            return *buffer;
+        }
+
+        // Write all events recorded so far; returns false if the file cannot be written
+        bool write(const std::string &path)
+        {
+            std::ofstream out(path);
+            if (!out)
+                return false;
+            std::lock_guard<std::mutex> guard(lock);
+            out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+            bool first = true;
+            for (auto &buffer : buffers)
+            {
+                std::lock_guard<std::mutex> buffer_guard(buffer->lock);
+                nlohmann::json meta = {{"ph", "M"},
+                                       {"pid", 1},
+                                       {"tid", buffer->tid},
+                                       {"name", "thread_name"},
+                                       {"args", {{"name", "thread " + std::to_string(buffer->tid)}}}};
+                out << (first ? "" : ",\n") << meta.dump();
+                first = false;
+                for (const TraceEvent &e : buffer->events)
+                {
+                    nlohmann::json event = {{"ph", "X"},
+                                            {"pid", 1},
+                                            {"tid", buffer->tid},
+                                            {"name", e.name},
+                                            {"ts", (e.start_ns - origin_ns) * 1e-3},
+                                            {"dur", e.dur_ns * 1e-3},
+                                            {"args", {{"circuit", e.circuit}}}};
+                    out << ",\n"
+                        << event.dump();
+                }
+            }
+            out << "\n]}\n";
+            return bool(out);
+        }
+
+    private:
+        std::atomic<bool> enabled{false};
+        long long origin_ns = 0;
+        std::mutex lock;
+        std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    };
+
+    // Circuit id attached to spans of the calling thread
+    inline long long &trace_circuit_id()
+    {
+        thread_local long long circuit_id = 0;
+        return circuit_id;
+    }
+
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char *_name) : name(_name), start_ns(0)
+        {
+            if (Tracer::instance().is_enabled())
+                start_ns = get_steady_ns();
+        }
+        ~TraceScope()
+        {
+            if (start_ns == 0)
+                return;
+            long long end_ns = get_steady_ns();
+            TraceBuffer &buffer = Tracer::instance().thread_buffer();
+            std::lock_guard<std::mutex> guard(buffer.lock);
+            buffer.events.push_back({name, start_ns, end_ns - start_ns, trace_circuit_id()});
+        }
+
+    private:
+        const char *name;
+        long long start_ns;
+    };
+
+    class TraceCircuitScope
+    {
+    public:
+        explicit TraceCircuitScope(long long circuit_id) : previous(trace_circuit_id())
+        {
+            trace_circuit_id() = circuit_id;
+        }
+        ~TraceCircuitScope() { trace_circuit_id() = previous; }
+
+    private:
+        long long previous;
+    };
+
+    inline void trace_start() { Tracer::instance().start(); }
+    inline bool trace_write(const std::string &path) { return Tracer::instance().write(path); }
+} // namespace QASMTrans
+
+#define QASMTRANS_TRACE_CONCAT_(a, b) a##b
+#define QASMTRANS_TRACE_CONCAT(a, b) QASMTRANS_TRACE_CONCAT_(a, b)
+#define QASMTRANS_TRACE_SCOPE(name) \
+    QASMTrans::TraceScope QASMTRANS_TRACE_CONCAT(qasmtrans_trace_scope_, __LINE__)(name)
+#define QASMTRANS_TRACE_CIRCUIT(id) \
+    QASMTrans::TraceCircuitScope QASMTRANS_TRACE_CONCAT(qasmtrans_trace_circuit_, __LINE__)(id)
+#define QASMTRANS_TRACE_CURRENT_CIRCUIT() (QASMTrans::trace_circuit_id())
+
+#else
+
+#define QASMTRANS_TRACE_SCOPE(name) ((void)0)
+#define QASMTRANS_TRACE_CIRCUIT(id) ((void)0)
+#define QASMTRANS_TRACE_CURRENT_CIRCUIT() (0LL)
+
+#endif
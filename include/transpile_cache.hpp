@@ -0,0 +1,272 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <random>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "QASMTransPrimitives.hpp"
+#include "IR/gate.hpp"
+#include "IR/circuit.hpp"
+
+using namespace QASMTrans;
+
+/***********************************************
+ * On-disk cache of transpiled circuits.
+ *
+ * Entries are content addressed: the file name is
+ * a 128-bit hash of the parsed input circuit, the
+ * device configuration text, the mode, the seed
+ * and the pass options. An entry stores the
+ * transpiled gates and final mapping in a compact
+ * binary form. The directory is capped in size and
+ * evicts the least recently used entries (entry
+ * mtime is refreshed on every hit).
+ ***********************************************/
+
+// Bump when a pass changes its output so that old entries are not reused
+const uint32_t TRANSPILE_CACHE_VERSION = 2;
+const char TRANSPILE_CACHE_MAGIC[4] = {'Q', 'T', 'C', 'E'};
+const char TRANSPILE_CACHE_SUFFIX[] = ".qtc";
+
+// Two independent 64-bit FNV-1a streams
+struct CacheHasher
+{
+    uint64_t lo = 0xcbf29ce484222325ULL;
+    uint64_t hi = 0x84222325cbf29ce4ULL;
+
+    void add_bytes(const void *data, size_t len)
+    {
+        const unsigned char *bytes = (const unsigned char *)data;
+        for (size_t i = 0; i < len; i++)
+        {
+            lo = (lo ^ bytes[i]) * 0x100000001b3ULL;
+            hi = (hi ^ bytes[i]) * 0x100000001b3ULL;
+            hi ^= hi >> 29;
+        }
+    }
+    template <typename T>
+    void add(const T &value) { add_bytes(&value, sizeof(T)); }
+    void add(const std::string &value)
+    {
+        add<uint64_t>(value.size());
+        add_bytes(value.data(), value.size());
+    }
+    std::string hex() const
+    {
+        char buffer[33];
+        snprintf(buffer, sizeof(buffer), "%016llx%016llx", (unsigned long long)hi, (unsigned long long)lo);
+        return std::string(buffer);
+    }
+};
+
+// Canonical content of a parsed circuit: width, classical registers and the
+// gate list field by field (angles by bit pattern, so -0.0 and 0.0 differ).
+inline void hash_circuit(CacheHasher &hasher, shared_ptr<Circuit> circuit)
+{
+    hasher.add<int64_t>(circuit->num_qubits());
+    for (auto &entry : circuit->list_cregs)
+    {
+        hasher.add(entry.first);
+        hasher.add<int64_t>(entry.second.width);
+    }
+    hasher.add<uint64_t>(circuit->gates->size());
+    for (const Gate &g : *circuit->gates)
+    {
+        hasher.add<int32_t>(g.op_name);
+        hasher.add<int64_t>(g.qubit);
+        hasher.add<int64_t>(g.ctrl);
+        hasher.add<int64_t>(g.extra);
+        hasher.add<int64_t>(g.n_qubits);
+        hasher.add<int64_t>(g.repetition);
+        hasher.add<int64_t>(g.cbit);
+        hasher.add<ValType>(g.theta);
+        hasher.add<ValType>(g.phi);
+        hasher.add<ValType>(g.lam);
+        hasher.add<ValType>(g.gamma);
+    }
+}
+
+// Cache key for transpiling `circuit` (cregs already set) on the device whose
+// JSON text is `device_config`. `options` holds any further pass options.
+inline std::string transpile_cache_key(shared_ptr<Circuit> circuit, const std::string &device_config,
+                                       bool limited, IdxType mode, IdxType seed, const std::string &options = "")
+{
+    CacheHasher hasher;
+    hasher.add(TRANSPILE_CACHE_VERSION);
+    hash_circuit(hasher, circuit);
+    hasher.add(device_config);
+    hasher.add<uint8_t>(limited);
+    hasher.add<int64_t>(mode);
+    hasher.add<int64_t>(seed);
+    hasher.add(options);
+    return hasher.hex();
+}
+
+class TranspileCache
+{
+public:
+    TranspileCache(const std::string &_cache_dir, uint64_t _max_bytes)
+        : cache_dir(_cache_dir), max_bytes(_max_bytes)
+    {
+        std::filesystem::create_directories(cache_dir);
+    }
+
+    // On a hit, replaces the gates and mapping of `circuit` with the cached
+    // transpiled ones and returns true
+    bool load(const std::string &key, shared_ptr<Circuit> circuit)
+    {
+        std::filesystem::path path = entry_path(key);
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        char magic[4];
+        uint32_t version = 0;
+        int64_t n_qubits = 0;
+        in.read(magic, 4);
+        read(in, version);
+        read(in, n_qubits);
+        if (!in || memcmp(magic, TRANSPILE_CACHE_MAGIC, 4) != 0 || version != TRANSPILE_CACHE_VERSION ||
+            n_qubits != circuit->num_qubits())
+            return false;
+        uint64_t n_mapping = 0;
+        read(in, n_mapping);
+        if (!in || n_mapping > (uint64_t(1) << 24))
+            return false;
+        std::vector<IdxType> mapping(n_mapping);
+        for (auto &q : mapping)
+            q = read_index(in);
+        uint64_t n_gates = 0;
+        read(in, n_gates);
+        if (!in)
+            return false;
+        std::vector<Gate> gates;
+        gates.reserve(std::min<uint64_t>(n_gates, 1 << 24));
+        for (uint64_t i = 0; i < n_gates && in; i++)
+        {
+            int32_t op = 0;
+            read(in, op);
+            if (op < 0 || op >= NUM_OPS)
+                return false;
+            Gate g((OP)op, read_index(in));
+            g.ctrl = read_index(in);
+            g.extra = read_index(in);
+            g.n_qubits = read_index(in);
+            g.repetition = read_index(in);
+            g.cbit = read_index(in);
+            read(in, g.theta);
+            read(in, g.phi);
+            read(in, g.lam);
+            read(in, g.gamma);
+            gates.push_back(g);
+        }
+        if (!in)
+            return false;
+        circuit->set_gates(gates);
+        circuit->set_mapping(mapping);
+        // refresh the entry for LRU eviction
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        return true;
+    }
+
+    // Store the transpiled circuit; written to a temporary file and renamed
+    // so that concurrent readers never see a partial entry
+    void store(const std::string &key, shared_ptr<Circuit> circuit)
+    {
+        std::filesystem::path path = entry_path(key);
+        std::filesystem::path tmp_path =
+            std::filesystem::path(cache_dir) / (key + ".tmp" + std::to_string(std::random_device()()));
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return;
+            out.write(TRANSPILE_CACHE_MAGIC, 4);
+            write(out, TRANSPILE_CACHE_VERSION);
+            write<int64_t>(out, circuit->num_qubits());
+            write<uint64_t>(out, circuit->initial_mapping.size());
+            for (IdxType q : circuit->initial_mapping)
+                write_index(out, q);
+            write<uint64_t>(out, circuit->gates->size());
+            for (const Gate &g : *circuit->gates)
+            {
+                write<int32_t>(out, g.op_name);
+                write_index(out, g.qubit);
+                write_index(out, g.ctrl);
+                write_index(out, g.extra);
+                write_index(out, g.n_qubits);
+                write_index(out, g.repetition);
+                write_index(out, g.cbit);
+                write(out, g.theta);
+                write(out, g.phi);
+                write(out, g.lam);
+                write(out, g.gamma);
+            }
+            if (!out)
+            {
+                out.close();
+                std::error_code ec;
+                std::filesystem::remove(tmp_path, ec);
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec)
+            std::filesystem::remove(tmp_path, ec);
+        evict();
+    }
+
+    // Remove least recently used entries until the cache fits in max_bytes
+    void evict()
+    {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+        uint64_t total_bytes = 0;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(cache_dir, ec))
+        {
+            if (!entry.is_regular_file(ec) || entry.path().extension() != TRANSPILE_CACHE_SUFFIX)
+                continue;
+            total_bytes += entry.file_size(ec);
+            entries.push_back(make_pair(entry.last_write_time(ec), entry.path()));
+        }
+        if (total_bytes <= max_bytes)
+            return;
+        sort(entries.begin(), entries.end());
+        for (auto &entry : entries)
+        {
+            if (total_bytes <= max_bytes)
+                break;
+            uint64_t size = std::filesystem::file_size(entry.second, ec);
+            if (!ec && std::filesystem::remove(entry.second, ec))
+                total_bytes -= size;
+        }
+    }
+
+private:
+    std::string cache_dir;
+    uint64_t max_bytes;
+
+    std::filesystem::path entry_path(const std::string &key)
+    {
+        return std::filesystem::path(cache_dir) / (key + TRANSPILE_CACHE_SUFFIX);
+    }
+    // qubit indices and small counts are stored as 32-bit values
+    static void write_index(std::ostream &out, IdxType value) { write<int32_t>(out, (int32_t)value); }
+    static IdxType read_index(std::istream &in)
+    {
+        int32_t value = 0;
+        read(in, value);
+        return value;
+    }
+    template <typename T>
+    static void write(std::ostream &out, const T &value) { out.write((const char *)&value, sizeof(T)); }
+    template <typename T>
+    static void read(std::istream &in, T &value) { in.read((char *)&value, sizeof(T)); }
+};
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <csignal>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "QASMTransPrimitives.hpp"
+#include "IR/circuit.hpp"
+#include "IR/chip.hpp"
+#include "parser/qasm_parser.hpp"
+#include "circuit_passes/transpiler.hpp"
+#include "dump_qasm.hpp"
+#include "nlomann/json.hpp"
+#include "trace.hpp"
+
+using namespace QASMTrans;
+using json = nlohmann::json;
+
+/***********************************************
+ * Transpile server: a long-running process that
+ * listens on a Unix domain socket and keeps the
+ * device models resident between requests.
+ *
+ * Protocol: one JSON object per line each way.
+ * Request:
+ *   {"id": any, "qasm": "...", "device": "ibmq_toronto",
+ *    "mode": "ibmq", "limited": false, "params": [..],
+ *    "passes": "fast" or ["three_to_two", ...],
+ *    "deadline_ms": 500}
+ * Response:
+ *   {"id": any, "status": "ok", "qasm": "...", "stats": {...}}
+ *   {"id": any, "status": "error", "error": "..."}
+ * A device id is the file stem of a JSON file in
+ * the devices directory. Past deadline_ms (from
+ * the arrival of the request) the result is less
+ * optimized, see run_control.hpp; server shutdown
+ * cancels the requests in progress.
+ ***********************************************/
+
+// Resident device models. A device is reloaded when its JSON file changes
+// on disk; requests that already hold the old Chip keep using it.
+class DeviceRegistry
+{
+public:
+    DeviceRegistry(const std::string &_devices_dir) : devices_dir(_devices_dir) {}
+
+    // Chip for the device, built for n_qubits circuit qubits in limited mode
+    shared_ptr<Chip> get(const std::string &device_id, IdxType n_qubits, bool limited, bool &reloaded)
+    {
+        for (char c : device_id)
+        {
+            if (!isalnum((unsigned char)c) && c != '_' && c != '-' && c != '.')
+                throw std::invalid_argument("Invalid device id: " + device_id);
+        }
+        if (device_id.empty() || device_id[0] == '.')
+            throw std::invalid_argument("Invalid device id: " + device_id);
+        std::string path = devices_dir + "/" + device_id + ".json";
+        struct stat file_stat;
+        if (stat(path.c_str(), &file_stat) != 0)
+            throw std::invalid_argument("Unknown device: " + device_id);
+        IdxType mtime = IdxType(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+
+        std::lock_guard<std::mutex> guard(lock);
+        Device &device = devices[device_id];
+        reloaded = false;
+        if (device.mtime != mtime || device.size != file_stat.st_size)
+        {
+            ifstream f(path);
+            if (f.fail())
+                throw std::runtime_error("Device config file not found at " + path);
+            device.config = json::parse(f);
+            device.mtime = mtime;
+            device.size = file_stat.st_size;
+            device.chips.clear();
+            reloaded = true;
+        }
+        IdxType key = limited ? n_qubits : 0;
+        auto it = device.chips.find(key);
+        if (it != device.chips.end())
+            return it->second;
+        shared_ptr<Chip> chip = constructChipFromConfig(n_qubits, device.config, limited, 0);
+        device.chips[key] = chip;
+        return chip;
+    }
+
+private:
+    struct Device
+    {
+        IdxType mtime = -1;
+        IdxType size = -1;
+        json config;
+        // limited chips depend on the circuit width, full chips use key 0
+        std::map<IdxType, shared_ptr<Chip>> chips;
+    };
+    std::string devices_dir;
+    std::mutex lock;
+    std::map<std::string, Device> devices;
+};
+
+// Set on SIGINT/SIGTERM; also cancels the transpilations in progress
+inline std::atomic<bool> &server_stop_flag()
+{
+    static std::atomic<bool> stop(false);
+    return stop;
+}
+
+inline json handle_transpile_request(const json &request, DeviceRegistry &registry)
+{
+    static std::atomic<long long> request_count(0);
+    QASMTRANS_TRACE_CIRCUIT(++request_count);
+    QASMTRANS_TRACE_SCOPE("request");
+    json response;
+    response["id"] = request.contains("id") ? request["id"] : json();
+    RunControl control;
+    control.cancel = &server_stop_flag();
+    if (request.contains("deadline_ms"))
+        control.set_deadline_ms(request["deadline_ms"].get<double>());
+    cpu_timer timer;
+    timer.start_timer();
+    std::istringstream qasm_stream(request.at("qasm").get<std::string>());
+    qasm_parser parser(qasm_stream);
+    shared_ptr<Circuit> circuit = make_shared<Circuit>(parser.num_qubits());
+    parser.loadin_circuit(circuit);
+    if (circuit->is_empty())
+        throw std::invalid_argument("Circuit is empty");
+    circuit->check_operands();
+    timer.stop_timer();
+    double parse_time = timer.measure();
+
+    IdxType mode = mode_from_name(request.value("mode", std::string("ibmq")));
+    if (mode < 0)
+        throw std::invalid_argument("Invalid mode name: " + request.value("mode", std::string()));
+    bool reloaded = false;
+    shared_ptr<Chip> chip = registry.get(request.at("device").get<std::string>(), circuit->num_qubits(),
+                                         request.value("limited", false), reloaded);
+
+    vector<string> pipeline = default_pipeline();
+    if (request.contains("passes"))
+        pipeline = request["passes"].is_string() ? parse_pipeline(request["passes"].get<std::string>())
+                                                 : pipeline_from_json(request["passes"]);
+
+    SabreOptions sabre;
+    sabre.extended_size = request.value("ext_size", sabre.extended_size);
+    sabre.extended_weight = request.value("ext_weight", sabre.extended_weight);
+    sabre.decay = request.value("decay", sabre.decay);
+    sabre.decay_reset = request.value("decay_reset", sabre.decay_reset);
+    sabre.stagnation_limit = request.value("stagnation", sabre.stagnation_limit);
+    sabre.max_swaps_per_gate = request.value("max_swaps_per_gate", sabre.max_swaps_per_gate);
+    sabre.parallel_swaps = request.value("parallel_swaps", sabre.parallel_swaps);
+    sabre.depth_weight = request.value("depth_weight", sabre.depth_weight);
+    sabre.commutation_block = request.value("commutation_block", sabre.commutation_block);
+    std::string router = request.value("router", std::string("sabre"));
+    if (router != "sabre" && router != "beam")
+        throw std::invalid_argument("Unknown router " + router + ", use sabre or beam");
+    sabre.beam_search = router == "beam";
+    sabre.beam_width = request.value("beam_width", sabre.beam_width);
+    sabre.search_depth = request.value("search_depth", sabre.search_depth);
+    sabre.search_nodes = request.value("search_nodes", sabre.search_nodes);
+    sabre.search_threads = request.value("search_threads", sabre.search_threads);
+    sabre.bridge = request.value("bridge", sabre.bridge);
+    sabre.time_slices = request.value("time_slices", sabre.time_slices);
+    sabre.validate();
+
+    timer.start_timer();
+    vector<PassStats> pass_stats = transpiler(circuit, chip, parser.get_list_cregs(), 0, mode, -1, pipeline, sabre, &control);
+    if (request.contains("params"))
+        circuit->bind(request["params"].get<std::vector<ValType>>());
+    timer.stop_timer();
+    double transpile_time = timer.measure();
+
+    std::ostringstream qasm_out;
+    std::map<std::string, IdxType> basis_gate_counts;
+    writeQASM(circuit, qasm_out, basis_gate_counts);
+    response["status"] = "ok";
+    response["qasm"] = qasm_out.str();
+    response["stats"] = {{"n_qubits", circuit->num_qubits()},
+                         {"n_gates", circuit->num_gates()},
+                         {"gate_counts", basis_gate_counts},
+                         {"parse_ms", parse_time},
+                         {"transpile_ms", transpile_time},
+                         {"device_reloaded", reloaded},
+                         {"deadline_hit", control.deadline_hit},
+                         {"passes", json::array()}};
+    for (auto &stats : pass_stats)
+        response["stats"]["passes"].push_back(pass_stats_to_json(stats));
+    return response;
+}
+
+// Never throws: errors are reported in the response
+inline std::string handle_request_line(const std::string &line, DeviceRegistry &registry)
+{
+    json response;
+    try
+    {
+        json request = json::parse(line);
+        try
+        {
+            response = handle_transpile_request(request, registry);
+        }
+        catch (const std::exception &e)
+        {
+            response = {{"id", request.contains("id") ? request["id"] : json()},
+                        {"status", "error"},
+                        {"error", e.what()}};
+        }
+    }
+    catch (const std::exception &e)
+    {
+        response = {{"id", nullptr}, {"status", "error"}, {"error", e.what()}};
+    }
+    return response.dump() + "\n";
+}
+
+inline bool send_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+inline void request_server_stop(int)
+{
+    server_stop_flag() = true;
+}
+
+// Requests larger than this close the connection
+const size_t MAX_REQUEST_BYTES = size_t(1) << 28;
+
+// Serve requests on one connection until the client disconnects
+inline void serve_connection(int fd, DeviceRegistry &registry)
+{
+    std::string buffer;
+    char chunk[1 << 16];
+    pollfd client_poll = {fd, POLLIN, 0};
+    while (true)
+    {
+        // wake up periodically so that idle connections do not block shutdown
+        int ready = poll(&client_poll, 1, 200);
+        if (server_stop_flag())
+            break;
+        if (ready <= 0)
+            continue;
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            break;
+        buffer.append(chunk, n);
+        size_t line_start = 0;
+        size_t newline;
+        bool alive = true;
+        while ((newline = buffer.find('\n', line_start)) != std::string::npos)
+        {
+            std::string line = buffer.substr(line_start, newline - line_start);
+            line_start = newline + 1;
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            if (!send_all(fd, handle_request_line(line, registry)))
+            {
+                alive = false;
+                break;
+            }
+        }
+        buffer.erase(0, line_start);
+        if (!alive || buffer.size() > MAX_REQUEST_BYTES)
+            break;
+    }
+    close(fd);
+}
+
+// Listen on socket_path until SIGINT/SIGTERM. Accepted connections are
+// queued and served by n_workers threads, one connection per worker at a time.
+inline void run_transpile_server(const std::string &socket_path, const std::string &devices_dir,
+                                 IdxType n_workers, IdxType debug_level)
+{
+    DeviceRegistry registry(devices_dir);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+        throw std::runtime_error("Cannot create socket: " + std::string(strerror(errno)));
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("Socket path too long: " + socket_path);
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0)
+    {
+        close(listen_fd);
+        throw std::runtime_error("Cannot listen on " + socket_path + ": " + strerror(errno));
+    }
+
+    std::deque<int> pending;
+    std::mutex pending_lock;
+    std::condition_variable pending_cv;
+    std::vector<std::thread> workers;
+    for (IdxType i = 0; i < n_workers; i++)
+    {
+        workers.emplace_back([&]()
+                             {
+            while (true)
+            {
+                int fd;
+                {
+                    std::unique_lock<std::mutex> guard(pending_lock);
+                    pending_cv.wait(guard, [&]()
+                                    { return !pending.empty() || server_stop_flag(); });
+                    if (pending.empty())
+                        return;
+                    fd = pending.front();
+                    pending.pop_front();
+                }
+                serve_connection(fd, registry);
+            } });
+    }
+
+    signal(SIGINT, request_server_stop);
+    signal(SIGTERM, request_server_stop);
+    if (debug_level > 0)
+        cout << "QASMTrans server listening on " << socket_path << " with " << n_workers << " workers" << endl;
+    pollfd listen_poll = {listen_fd, POLLIN, 0};
+    while (!server_stop_flag())
+    {
+        if (poll(&listen_poll, 1, 200) <= 0)
+            continue;
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0)
+            continue;
+        {
+            std::lock_guard<std::mutex> guard(pending_lock);
+            pending.push_back(client_fd);
+        }
+        pending_cv.notify_one();
+    }
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    pending_cv.notify_all();
+    for (auto &w : workers)
+        w.join();
+    // connections that were never picked up
+    for (int fd : pending)
+        close(fd);
+}
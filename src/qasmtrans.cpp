@@ -4,15 +4,148 @@
 #include <cctype>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <csignal>
 
 #include "../include/QASMTransPrimitives.hpp"
 #include "../include/IR/chip.hpp"
 #include "../include/parser/parser_util.hpp"
 #include "../include/parser/qasm_parser.hpp"
 #include "../include/circuit_passes/transpiler.hpp"
+#include "../include/transpile_server.hpp"
+#include "../include/transpile_cache.hpp"
+#include "../include/streaming_transpile.hpp"
 
 using namespace QASMTrans;
 
+// Count heap allocations for the per-pass statistics of -report. The
+// counters are process-wide: a pass that runs while other threads allocate
+// (e.g., -server workers) also counts their allocations. Every replaceable
+// form is defined, so that memory is always released by the matching
+// function; they are kept out of line, as inlining free() into callers of
+// new trips -Wmismatched-new-delete.
+#if defined(_MSC_VER)
+#define QASMTRANS_ALLOC_HOOK __declspec(noinline)
+#else
+#define QASMTRANS_ALLOC_HOOK __attribute__((noinline))
+#endif
+
+static void *counted_alloc(std::size_t size, std::size_t alignment)
+{
+    AllocationCounters &counters = allocation_counters();
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    if (alignment == 0)
+        return std::malloc(size);
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, alignment);
+#else
+    // aligned_alloc needs a size that is a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+static void aligned_free(void *ptr)
+{
+#if defined(_MSC_VER)
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+static void *counted_new(std::size_t size, std::size_t alignment)
+{
+    if (void *ptr = counted_alloc(size, alignment))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+QASMTRANS_ALLOC_HOOK void *operator new(std::size_t size)
+{
+    return counted_new(size, 0);
+}
+QASMTRANS_ALLOC_HOOK void *operator new[](std::size_t size)
+{
+    return counted_new(size, 0);
+}
+QASMTRANS_ALLOC_HOOK void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return counted_new(size, static_cast<std::size_t>(alignment));
+}
+QASMTRANS_ALLOC_HOOK void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return counted_new(size, static_cast<std::size_t>(alignment));
+}
+QASMTRANS_ALLOC_HOOK void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size, 0);
+}
+QASMTRANS_ALLOC_HOOK void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size, 0);
+}
+QASMTRANS_ALLOC_HOOK void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+QASMTRANS_ALLOC_HOOK void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+
+QASMTRANS_ALLOC_HOOK void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    aligned_free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    aligned_free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+    aligned_free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+    aligned_free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    aligned_free(ptr);
+}
+QASMTRANS_ALLOC_HOOK void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    aligned_free(ptr);
+}
+
 void print_help()
 {
     // print the help function for all the options
@@ -28,15 +161,102 @@ void print_help()
     std::cout << "-v <0/1/2>        Set the output level, default is 0" << std::endl;
     std::cout << "-o <path>         Set the output file, "
         << "default is data/output/transpiled_modename_filename.qasm" << std::endl;
+    std::cout << "-bind <path>      Bind the circuit parameters to each line of values in the file, "
+        << "writing one output per line with suffix _<line index>" << std::endl;
+    std::cout << "-passes <spec>    Pass pipeline: preset name, comma separated pass names or a .json file, "
+        << "default is \"default\"" << std::endl;
+    std::cout << "-pass_list        Print the available passes and pipeline presets" << std::endl;
+    std::cout << "-report <path>    Write a JSON performance report (also --report)" << std::endl;
+    std::cout << "-trace <path>     Write a Chrome trace-event JSON file (needs a build with QASMTRANS_TRACE=ON)" << std::endl;
+    std::cout << "-seed <n>         Seed of the random initial mapping, default is a random seed" << std::endl;
+    std::cout << "-ext_size <n>     Gates in the SABRE extended set (lookahead), default is 20" << std::endl;
+    std::cout << "-ext_weight <w>   Weight of the extended set in the SWAP cost, default is 0.5" << std::endl;
+    std::cout << "-decay <d>        Decay added to the qubits of each SWAP, 0 disables it (default)" << std::endl;
+    std::cout << "-decay_reset <n>  SWAPs after which the decay is reset, default is 5" << std::endl;
+    std::cout << "-stagnation <n>   SWAPs without progress before routing a gate along a shortest path, default is 100" << std::endl;
+    std::cout << "-max_swaps_per_gate <n>  SWAP budget per 2-qubit gate of a routing round, default is 10" << std::endl;
+    std::cout << "-parallel_swaps   Depth-aware routing: insert SWAPs on disjoint qubits in the same step" << std::endl;
+    std::cout << "-depth_weight <w>  Cost per SWAP duration a SWAP waits for its qubits, default is 0.1" << std::endl;
+    std::cout << "-commutation_block <n>  Commuting 2-qubit gates per qubit the router may reorder, default is 3 (1: circuit order)" << std::endl;
+    std::cout << "-router <engine>  sabre (default) or beam: beam search over SWAP sequences, slower but fewer SWAPs" << std::endl;
+    std::cout << "-beam_width <n>   Mappings kept per search level, default is 16" << std::endl;
+    std::cout << "-search_depth <n>  SWAPs a search looks ahead, default is 3" << std::endl;
+    std::cout << "-search_nodes <n>  Nodes after which a search stops, default is 100000" << std::endl;
+    std::cout << "-search_threads <n>  Threads expanding large search levels, default is 0 (all cores)" << std::endl;
+    std::cout << "-bridge           Execute distance-2 CX through the middle qubit when a SWAP would not help later gates" << std::endl;
+    std::cout << "-time_slices <k>  Route k consecutive slices of the circuit in parallel, joined by SWAP networks, default is 1" << std::endl;
+    std::cout << "-deadline <ms>    Wall-clock budget: past it, routing finishes along shortest paths "
+        << "and optional passes are skipped" << std::endl;
+    std::cout << "-progress         Report the routing progress and ETA on stderr" << std::endl;
+    std::cout << "-stream <window>  Stream the circuit through routing and output, "
+        << "keeping about <window> gates in memory (for very large circuits)" << std::endl;
+    std::cout << "-stream_sample <n>  Gates of the prefix used to refine the initial layout "
+        << "in streaming mode, default is the window" << std::endl;
+    std::cout << "-pipeline         In streaming mode, run parsing, routing, decomposition and output "
+        << "on separate threads" << std::endl;
+    std::cout << "-cache <dir>      Reuse transpiled circuits stored in the cache directory" << std::endl;
+    std::cout << "-cache_size <MB>  Size cap of the cache directory, default is 256" << std::endl;
+    std::cout << "-server <socket>  Run as a server on a Unix domain socket (one JSON request per line)" << std::endl;
+    std::cout << "-devices <dir>    Device JSON directory for server mode, default is ../data/devices" << std::endl;
+    std::cout << "-workers <n>      Number of server worker threads, default is the number of cores" << std::endl;
     std::cout << "-h                print the help function" << std::endl;
 }
 
+// Set by SIGINT/SIGTERM; the transpilation then stops at the next routing
+// step or pass, and a second signal terminates the process
+static std::atomic<bool> cancel_requested(false);
+void request_cancel(int sig)
+{
+    cancel_requested = true;
+    signal(sig, SIG_DFL);
+}
+
+// Each non-empty line holds one set of parameter values, separated by
+// spaces or commas. Text after # is ignored.
+std::vector<std::vector<ValType>> load_bindings(const std::string &path)
+{
+    std::ifstream bind_file(path);
+    if (!bind_file)
+        throw std::runtime_error("Could not open binding file at: " + path);
+    std::vector<std::vector<ValType>> bindings;
+    std::string line;
+    while (std::getline(bind_file, line))
+    {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::stringstream ss(line);
+        std::vector<ValType> values;
+        std::string value;
+        while (ss >> value)
+        {
+            if (value[0] == '#')
+                break;
+            values.push_back(std::stod(value));
+        }
+        if (!values.empty())
+            bindings.push_back(values);
+    }
+    return bindings;
+}
+
+// out.qasm -> out_3.qasm
+std::string indexed_path(const std::string &path, IdxType index)
+{
+    std::size_t slash = path.find_last_of("/\\");
+    std::size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + "_" + std::to_string(index);
+    return path.substr(0, dot) + "_" + std::to_string(index) + path.substr(dot);
+}
+
 int main(int argc, char **argv)
 {
     bool run_with_limit = false;
     IdxType mode = 0;
     std::string mode_name = "ibmq";
     IdxType debug_level = 0;
+    IdxType seed = -1;
+    SabreOptions sabre;
+    std::vector<std::string> pipeline = default_pipeline();
     std::string output_path = "../data/output/";
     std::map<std::string, IdxType> machineQubits = {
         {"ibmq_toronto", 27},
@@ -74,6 +294,61 @@ int main(int argc, char **argv)
         {
             debug_level = IdxType(std::stoi(getCmdOption(argv, argv + argc, "-v")));
         }
+        if (cmdOptionExists(argv, argv + argc, "-seed"))
+        {
+            seed = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-seed")));
+        }
+        double deadline_ms = -1;
+        try
+        {
+            if (cmdOptionExists(argv, argv + argc, "-deadline"))
+            {
+                deadline_ms = std::stod(getCmdOption(argv, argv + argc, "-deadline"));
+                if (!(deadline_ms >= 0))
+                    throw std::invalid_argument("-deadline must be a non-negative number of milliseconds");
+            }
+            if (cmdOptionExists(argv, argv + argc, "-ext_size"))
+                sabre.extended_size = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-ext_size")));
+            if (cmdOptionExists(argv, argv + argc, "-ext_weight"))
+                sabre.extended_weight = std::stod(getCmdOption(argv, argv + argc, "-ext_weight"));
+            if (cmdOptionExists(argv, argv + argc, "-decay"))
+                sabre.decay = std::stod(getCmdOption(argv, argv + argc, "-decay"));
+            if (cmdOptionExists(argv, argv + argc, "-decay_reset"))
+                sabre.decay_reset = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-decay_reset")));
+            if (cmdOptionExists(argv, argv + argc, "-stagnation"))
+                sabre.stagnation_limit = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-stagnation")));
+            if (cmdOptionExists(argv, argv + argc, "-max_swaps_per_gate"))
+                sabre.max_swaps_per_gate = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-max_swaps_per_gate")));
+            sabre.parallel_swaps = cmdOptionExists(argv, argv + argc, "-parallel_swaps");
+            if (cmdOptionExists(argv, argv + argc, "-commutation_block"))
+                sabre.commutation_block = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-commutation_block")));
+            if (cmdOptionExists(argv, argv + argc, "-router"))
+            {
+                std::string engine = getCmdOption(argv, argv + argc, "-router");
+                if (engine != "sabre" && engine != "beam")
+                    throw std::invalid_argument("Unknown router " + engine + ", use sabre or beam");
+                sabre.beam_search = engine == "beam";
+            }
+            if (cmdOptionExists(argv, argv + argc, "-beam_width"))
+                sabre.beam_width = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-beam_width")));
+            if (cmdOptionExists(argv, argv + argc, "-search_depth"))
+                sabre.search_depth = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-search_depth")));
+            if (cmdOptionExists(argv, argv + argc, "-search_nodes"))
+                sabre.search_nodes = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-search_nodes")));
+            if (cmdOptionExists(argv, argv + argc, "-search_threads"))
+                sabre.search_threads = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-search_threads")));
+            if (cmdOptionExists(argv, argv + argc, "-depth_weight"))
+                sabre.depth_weight = std::stod(getCmdOption(argv, argv + argc, "-depth_weight"));
+            sabre.bridge = cmdOptionExists(argv, argv + argc, "-bridge");
+            if (cmdOptionExists(argv, argv + argc, "-time_slices"))
+                sabre.time_slices = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-time_slices")));
+            sabre.validate();
+        }
+        catch (const std::exception &e)
+        {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
         if (cmdOptionExists(argv, argv + argc, "-o"))
         {
             output_path = std::string(getCmdOption(argv, argv + argc, "-o"));
@@ -98,35 +373,71 @@ int main(int argc, char **argv)
             std::cout << "You can manually add new machine in json file at data/device" << std::endl;
             return 0;
         }
-        if (cmdOptionExists(argv, argv + argc, "-m"))
+        std::string trace_path;
+        if (cmdOptionExists(argv, argv + argc, "-trace"))
         {
-            mode_name = std::string(getCmdOption(argv, argv + argc, "-m"));
-            if (mode_name == "ibmq" || mode_name == "IBMQ")
-            {
-                mode = 0;
-            }
-            else if (mode_name == "ionq" || mode_name == "IonQ")
-            {
-                mode = 1;
-            }
-            else if (mode_name == "Quantinuum" || mode_name == "quantinuum")
-            {
-                mode = 2;
-            }
-            else if (mode_name == "Rigetti" || mode_name == "rigetti")
+            trace_path = getCmdOption(argv, argv + argc, "-trace");
+#ifdef QASMTRANS_TRACE
+            trace_start();
+#else
+            cerr << "Warning: -trace is ignored, QASMTrans was built without QASMTRANS_TRACE" << endl;
+            trace_path.clear();
+#endif
+        }
+        // written when main returns after a transpilation or server run
+        auto write_trace = [&]()
+        {
+#ifdef QASMTRANS_TRACE
+            if (!trace_path.empty() && !trace_write(trace_path))
+                cerr << "Error: could not write trace to " << trace_path << endl;
+#endif
+        };
+        if (cmdOptionExists(argv, argv + argc, "-pass_list"))
+        {
+            PassRegistry &registry = PassRegistry::instance();
+            std::cout << "The available passes are:" << std::endl;
+            for (auto &name : registry.pass_names())
+                std::cout << name << ": " << registry.get_pass(name).description << std::endl;
+            std::cout << "The pipeline presets are:" << std::endl;
+            for (auto &preset : registry.preset_pipelines())
+                std::cout << preset.first << ": " << pipeline_to_string(preset.second) << std::endl;
+            return 0;
+        }
+        if (cmdOptionExists(argv, argv + argc, "-passes"))
+        {
+            try
             {
-                mode = 3;
+                pipeline = parse_pipeline(getCmdOption(argv, argv + argc, "-passes"));
             }
-            else if (mode_name == "Quafu" || mode_name == "quafu")
+            catch (const std::exception &e)
             {
-                mode = 4;
+                cerr << "Error: " << e.what() << endl;
+                return 1;
             }
-            else
+        }
+        if (cmdOptionExists(argv, argv + argc, "-m"))
+        {
+            mode_name = std::string(getCmdOption(argv, argv + argc, "-m"));
+            mode = mode_from_name(mode_name);
+            if (mode < 0)
             {
                 std::cout << "Invalid mode name, please check" << std::endl;
                 return 0;
             }
         }
+        if (cmdOptionExists(argv, argv + argc, "-server"))
+        {
+            std::string socket_path = getCmdOption(argv, argv + argc, "-server");
+            std::string devices_dir = "../data/devices";
+            IdxType n_workers = std::max(1u, std::thread::hardware_concurrency());
+            if (cmdOptionExists(argv, argv + argc, "-devices"))
+                devices_dir = getCmdOption(argv, argv + argc, "-devices");
+            if (cmdOptionExists(argv, argv + argc, "-workers"))
+                n_workers = std::max(1, std::stoi(getCmdOption(argv, argv + argc, "-workers")));
+            run_transpile_server(socket_path, devices_dir, n_workers, debug_level);
+            write_trace();
+            return 0;
+        }
         if (cmdOptionExists(argv, argv + argc, "-i"))
         {
             const char *filename = getCmdOption(argv, argv + argc, "-i");
@@ -136,32 +447,250 @@ int main(int argc, char **argv)
                 return 1;
             }
             string backendpath = string(getCmdOption(argv, argv + argc, "-c"));
+            std::string report_path;
+            if (cmdOptionExists(argv, argv + argc, "-report"))
+                report_path = getCmdOption(argv, argv + argc, "-report");
+            if (cmdOptionExists(argv, argv + argc, "--report"))
+                report_path = getCmdOption(argv, argv + argc, "--report");
+            steady_timer total_timer, stage_timer;
+            total_timer.start_timer();
+            json report;
+            // the deadline counts from here, parsing included
+            RunControl control;
+            control.cancel = &cancel_requested;
+            if (deadline_ms >= 0)
+                control.set_deadline_ms(deadline_ms);
+            if (cmdOptionExists(argv, argv + argc, "-progress"))
+                control.progress = stderr_progress();
+            if (cmdOptionExists(argv, argv + argc, "-stream"))
+            {
+                // the circuit is never held in memory as a whole
+                IdxType window = std::max(2LL, std::stoll(getCmdOption(argv, argv + argc, "-stream")));
+                IdxType sample = window;
+                if (cmdOptionExists(argv, argv + argc, "-stream_sample"))
+                    sample = std::max(1LL, std::stoll(getCmdOption(argv, argv + argc, "-stream_sample")));
+                if (cmdOptionExists(argv, argv + argc, "-bind") || cmdOptionExists(argv, argv + argc, "-cache"))
+                    cerr << "Warning: -bind and -cache are ignored in streaming mode" << endl;
+                if (cmdOptionExists(argv, argv + argc, "-deadline") || cmdOptionExists(argv, argv + argc, "-progress"))
+                    cerr << "Warning: -deadline and -progress are ignored in streaming mode" << endl;
+                bool pipelined = cmdOptionExists(argv, argv + argc, "-pipeline");
+                std::map<std::string, IdxType> gate_counts;
+                StreamingStats stream_stats;
+                IdxType n_qubits = 0;
+                std::string stream_path = output_file_path(filename, output_path, mode);
+                try
+                {
+                    qasm_parser parser(filename, true);
+                    n_qubits = parser.num_qubits();
+                    shared_ptr<Chip> chip = constructChip(n_qubits, backendpath, run_with_limit, debug_level);
+                    if (debug_level > 0)
+                    {
+                        cout << "======== QASMTrans ========" << endl;
+                        cout << "Input circuit: " << filename << " (" << n_qubits << " qubits), streaming with window "
+                             << window << (pipelined ? ", pipelined" : "") << endl;
+                        cout << "Basis gate mode: " << mode_name << endl;
+                        cout << "Backend (topology): " << backendpath << " (" << chip->chip_qubit_num
+                             << " physical qubits)" << endl;
+                        cout << "Passes: " << pipeline_to_string(pipeline) << endl;
+                    }
+                    std::ofstream qasm_file(stream_path);
+                    if (!qasm_file)
+                        throw std::runtime_error("Could not open output file " + stream_path);
+                    stream_stats = stream_transpile(parser, chip, qasm_file, mode, seed, window, sample, pipeline,
+                                                    debug_level, gate_counts, pipelined, sabre);
+                }
+                catch (const std::exception &e)
+                {
+                    cerr << "Error: " << e.what() << endl;
+                    return 1;
+                }
+                total_timer.stop_timer();
+                if (debug_level > 0)
+                {
+                    cout << "In total, " << stream_stats.output_gates << " basis gates in transpiled circuit: ";
+                    for (auto &gate : gate_counts)
+                        cout << gate.first << ":" << gate.second << ", ";
+                    cout << endl;
+                }
+                if (!report_path.empty())
+                {
+                    report["input"] = filename;
+                    report["device"] = backendpath;
+                    report["mode"] = mode_name;
+                    report["limited"] = run_with_limit;
+                    report["seed"] = seed;
+                    report["sabre"] = sabre.to_string();
+                    report["pipeline"] = pipeline;
+                    report["n_qubits"] = n_qubits;
+                    report["stream"] = stream_stats.to_json();
+                    report["input_gates"] = stream_stats.input_gates;
+                    report["output_gates"] = stream_stats.output_gates;
+                    report["output_gate_counts"] = gate_counts;
+                    report["total_ns"] = total_timer.measure_ns();
+                    report["peak_rss_kb"] = peak_rss_kb();
+                    std::ofstream report_file(report_path);
+                    if (report_file)
+                        report_file << report.dump(2) << endl;
+                    else
+                        cerr << "Error: could not write report to " << report_path << endl;
+                }
+                write_trace();
+                cout << "Saving output qasm to: " << stream_path << endl;
+                return 0;
+            }
             //================= Parsing ==================
+            stage_timer.start_timer();
             qasm_parser parser(filename);
             IdxType n_qubits = parser.num_qubits();
             shared_ptr<Circuit> circuit = make_shared<Circuit>(n_qubits);
             parser.loadin_circuit(circuit);
-            shared_ptr<Chip> chip = constructChip(n_qubits, backendpath,
-                                                  run_with_limit, debug_level);
+            circuit->check_operands();
+            stage_timer.stop_timer();
+            report["parse_ns"] = stage_timer.measure_ns();
+            report["input_gates"] = circuit->num_gates();
+            //================= Transpilation ==================
+            if (circuit->is_empty())
+            {
+                cerr << "Error: Circuit from " << filename << " is empty" << endl;
+                return 1;
+            }
+            if (cmdOptionExists(argv, argv + argc, "-bind") && !circuit->is_parametric())
+            {
+                cerr << "Error: -bind is given but " << filename << " has no free parameters" << endl;
+                return 1;
+            }
+            // Parametric circuits are not cached: binding happens after transpilation
+            std::unique_ptr<TranspileCache> cache;
+            std::string cache_key;
+            bool cache_hit = false;
+            if (cmdOptionExists(argv, argv + argc, "-cache") && !circuit->is_parametric())
+            {
+                IdxType cache_mb = 256;
+                if (cmdOptionExists(argv, argv + argc, "-cache_size"))
+                    cache_mb = IdxType(std::stoll(getCmdOption(argv, argv + argc, "-cache_size")));
+                cache.reset(new TranspileCache(getCmdOption(argv, argv + argc, "-cache"), uint64_t(cache_mb) << 20));
+                std::ifstream backend_file(backendpath);
+                std::stringstream backend_config;
+                backend_config << backend_file.rdbuf();
+                circuit->set_creg(parser.get_list_cregs());
+                cache_key = transpile_cache_key(circuit, backend_config.str(), run_with_limit, mode, seed,
+                                                pipeline_to_string(pipeline) + ";" + sabre.to_string());
+                cache_hit = cache->load(cache_key, circuit);
+            }
+            // a cache hit needs neither the chip (distance matrix) nor the passes
+            shared_ptr<Chip> chip;
+            stage_timer.start_timer();
+            if (!cache_hit)
+                chip = constructChip(n_qubits, backendpath, run_with_limit, debug_level);
+            stage_timer.stop_timer();
+            report["chip_ns"] = stage_timer.measure_ns();
             if (debug_level > 0)
             {
                 cout << "======== QASMTrans ========" << endl;
                 cout << "Input circuit: " << filename << " (" << n_qubits << " qubits)" << endl;
                 cout << "Basis gate mode: " << mode_name << endl;
-                cout << "Backend (topology): " << backendpath
-                     << " (" << chip->chip_qubit_num << " physical qubits)" << endl;
+                cout << "Backend (topology): " << backendpath;
+                if (chip)
+                    cout << " (" << chip->chip_qubit_num << " physical qubits)";
+                cout << endl;
                 cout << "Limit mode: " << (run_with_limit ? "True" : "False") << endl;
+                cout << "Passes: " << pipeline_to_string(pipeline) << endl;
+                if (cache)
+                    cout << "Transpile cache " << (cache_hit ? "hit: " : "miss: ") << cache_key << endl;
             }
-            //================= Transpilation ==================
-            if (circuit->is_empty())
+            if (!cache_hit)
             {
-                cerr << "Error: Circuit from " << filename << " is empty" << endl;
-                return 1;
+                vector<PassStats> pass_stats;
+                signal(SIGINT, request_cancel);
+                signal(SIGTERM, request_cancel);
+                try
+                {
+                    pass_stats = transpiler(circuit, chip, parser.get_list_cregs(), debug_level, mode, seed, pipeline, sabre,
+                                            &control);
+                }
+                catch (const std::exception &e)
+                {
+                    cerr << "Error: " << e.what() << endl;
+                    write_trace();
+                    return 1;
+                }
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+                if (debug_level > 0 && control.deadline_hit)
+                    cout << "Deadline reached: routing finished along shortest paths, optional passes skipped" << endl;
+                report["passes"] = json::array();
+                for (auto &stats : pass_stats)
+                    report["passes"].push_back(pass_stats_to_json(stats));
+                // a result cut short by the deadline is not what the key stands for
+                if (cache && !control.deadline_hit)
+                    cache->store(cache_key, circuit);
             }
-            transpiler(circuit, chip, parser.get_list_cregs(),
-                       debug_level, mode);
             //================= Write out ==================
+            auto finish_report = [&]()
+            {
+                total_timer.stop_timer();
+                if (report_path.empty())
+                    return;
+                report["input"] = filename;
+                report["device"] = backendpath;
+                report["mode"] = mode_name;
+                report["limited"] = run_with_limit;
+                report["seed"] = seed;
+                report["sabre"] = sabre.to_string();
+                report["pipeline"] = pipeline;
+                report["cache_hit"] = cache_hit;
+                report["deadline_hit"] = control.deadline_hit;
+                report["n_qubits"] = n_qubits;
+                report["output_gates"] = circuit->num_gates();
+                std::map<std::string, IdxType> output_gate_counts;
+                for (auto &g : *circuit->gates)
+                    output_gate_counts[toLowerCase(OP_NAMES[g.op_name])]++;
+                report["output_gate_counts"] = output_gate_counts;
+                report["total_ns"] = total_timer.measure_ns();
+                report["peak_rss_kb"] = peak_rss_kb();
+                report["allocations"] = allocation_counters().count.load();
+                report["allocated_bytes"] = allocation_counters().bytes.load();
+                // the allocation counts of the report and its passes include other threads
+                report["allocations_scope"] = "process";
+                std::ofstream report_file(report_path);
+                if (!report_file)
+                {
+                    cerr << "Error: could not write report to " << report_path << endl;
+                    return;
+                }
+                report_file << report.dump(2) << endl;
+            };
+            if (cmdOptionExists(argv, argv + argc, "-bind"))
+            {
+                std::vector<std::vector<ValType>> bindings = load_bindings(getCmdOption(argv, argv + argc, "-bind"));
+                cpu_timer bind_timer;
+                double bind_time = 0;
+                for (size_t k = 0; k < bindings.size(); k++)
+                {
+                    bind_timer.start_timer();
+                    circuit->bind(bindings[k]);
+                    bind_timer.stop_timer();
+                    bind_time += bind_timer.measure();
+                    std::string bound_path = indexed_path(output_path, k);
+                    dumpQASM(circuit, filename, bound_path, debug_level, mode);
+                }
+                report["bind_ns"] = (long long)(bind_time * 1e6);
+                finish_report();
+                write_trace();
+                if (debug_level > 0)
+                    cout << "Parameter binding time: " << bind_time << "ms for " << bindings.size() << " bindings" << endl;
+                cout << "Saving " << bindings.size() << " bound circuits to: " << indexed_path(output_path, 0) << " ..." << endl;
+                return 0;
+            }
+            if (circuit->is_parametric())
+                cout << "Circuit has " << circuit->params->num_symbols()
+                     << " free parameters, writing them bound to 0 (use -bind to set values)" << endl;
+            stage_timer.start_timer();
             dumpQASM(circuit, filename, output_path, debug_level, mode);
+            stage_timer.stop_timer();
+            report["dump_ns"] = stage_timer.measure_ns();
+            finish_report();
+            write_trace();
             cout << "Saving output qasm to: " << output_path << endl;
             return 0;
         }
@@ -0,0 +1,437 @@
+#include <memory>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <cstring>
+
+#include "../include/qasmtrans.h"
+#include "../include/QASMTransPrimitives.hpp"
+#include "../include/IR/chip.hpp"
+#include "../include/parser/parser_util.hpp"
+#include "../include/parser/qasm_parser.hpp"
+#include "../include/circuit_passes/routing_options.hpp"
+#include "../include/circuit_passes/transpiler.hpp"
+#include "../include/trace.hpp"
+#include "../include/run_control.hpp"
+
+using namespace QASMTrans;
+
+struct qasmtrans_chip
+{
+    json config;
+    bool limited;
+    // chips are built per circuit width in limited mode, once otherwise
+    mutable std::mutex cache_lock;
+    mutable std::map<IdxType, shared_ptr<Chip>> cache;
+};
+
+struct qasmtrans_circuit
+{
+    shared_ptr<Circuit> circuit;
+    map<string, creg> list_cregs;
+    bool transpiled = false;
+    std::string qasm;
+    // tags the trace spans of this circuit
+    long long trace_id = 0;
+};
+
+struct qasmtrans_cancel_token
+{
+    std::atomic<bool> cancelled{false};
+};
+
+static thread_local std::string last_error;
+
+// qasmtrans_routing_options of the first release with struct_size: later
+// fields are appended, and callers built before them pass a smaller size
+static const size_t ROUTING_OPTIONS_MIN_SIZE = sizeof(qasmtrans_routing_options);
+
+static qasmtrans_status fail(qasmtrans_status status, const std::string &message)
+{
+    last_error = message;
+    return status;
+}
+
+// Run `body`, mapping exceptions to `error_status`
+template <typename Body>
+static qasmtrans_status guarded(qasmtrans_status error_status, Body body)
+{
+    try
+    {
+        body();
+        return QASMTRANS_OK;
+    }
+    catch (const std::bad_alloc &e)
+    {
+        return fail(QASMTRANS_ERR_INTERNAL, "Out of memory");
+    }
+    catch (const TranspileCancelled &e)
+    {
+        return fail(QASMTRANS_ERR_CANCELLED, e.what());
+    }
+    catch (const std::exception &e)
+    {
+        return fail(error_status, e.what());
+    }
+    catch (...)
+    {
+        return fail(QASMTRANS_ERR_INTERNAL, "Unknown error");
+    }
+}
+
+static const char *lower_op_name(IdxType op)
+{
+    static const std::vector<std::string> names = []()
+    {
+        std::vector<std::string> lower;
+        for (IdxType i = 0; i < NUM_OPS; i++)
+            lower.push_back(toLowerCase(OP_NAMES[i]));
+        return lower;
+    }();
+    return names[op].c_str();
+}
+
+static shared_ptr<Chip> chip_for_circuit(const qasmtrans_chip *chip, IdxType n_qubits)
+{
+    IdxType key = chip->limited ? n_qubits : 0;
+    std::lock_guard<std::mutex> guard(chip->cache_lock);
+    auto it = chip->cache.find(key);
+    if (it != chip->cache.end())
+        return it->second;
+    shared_ptr<Chip> built = constructChipFromConfig(n_qubits, chip->config, chip->limited, 0);
+    chip->cache[key] = built;
+    return built;
+}
+
+static qasmtrans_status load_circuit(std::istream *file_input, const char *qasm, size_t len,
+                                     qasmtrans_circuit **circuit)
+{
+    return guarded(QASMTRANS_ERR_PARSE, [&]()
+                   {
+        std::istringstream text_input(file_input ? std::string() : std::string(qasm, len));
+        qasm_parser parser(file_input ? *file_input : text_input);
+        static std::atomic<long long> circuit_count(0);
+        std::unique_ptr<qasmtrans_circuit> handle(new qasmtrans_circuit());
+        handle->trace_id = ++circuit_count;
+        QASMTRANS_TRACE_CIRCUIT(handle->trace_id);
+        if (parser.qasm_version.empty())
+            throw std::runtime_error(!file_input && len == 0 ? "Empty QASM program" : "Missing OPENQASM header");
+        handle->circuit = make_shared<Circuit>(parser.num_qubits());
+        parser.loadin_circuit(handle->circuit);
+        handle->circuit->check_operands();
+        handle->list_cregs = parser.get_list_cregs();
+        handle->circuit->set_creg(handle->list_cregs);
+        *circuit = handle.release(); });
+}
+
+extern "C"
+{
+    const char *qasmtrans_last_error(void)
+    {
+        return last_error.c_str();
+    }
+
+    qasmtrans_status qasmtrans_chip_from_file(const char *path, int limited, qasmtrans_chip **chip)
+    {
+        if (path == NULL || chip == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        std::ifstream f(path);
+        if (f.fail())
+            return fail(QASMTRANS_ERR_IO, std::string("Device config file not found at ") + path);
+        std::stringstream buffer;
+        buffer << f.rdbuf();
+        std::string text = buffer.str();
+        return qasmtrans_chip_from_json(text.c_str(), text.size(), limited, chip);
+    }
+
+    qasmtrans_status qasmtrans_chip_from_json(const char *json_text, size_t len, int limited, qasmtrans_chip **chip)
+    {
+        if (json_text == NULL || chip == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        return guarded(QASMTRANS_ERR_PARSE, [&]()
+                       {
+            std::unique_ptr<qasmtrans_chip> handle(new qasmtrans_chip());
+            handle->config = json::parse(json_text, json_text + len);
+            handle->limited = limited != 0;
+            // validate the configuration up front
+            IdxType n_qubits = handle->config.at("num_qubits").get<IdxType>();
+            shared_ptr<Chip> full = constructChipFromConfig(n_qubits, handle->config, false, 0);
+            if (!handle->limited)
+                handle->cache[0] = full;
+            *chip = handle.release(); });
+    }
+
+    int64_t qasmtrans_chip_num_qubits(const qasmtrans_chip *chip)
+    {
+        if (chip == NULL)
+            return -1;
+        return chip->config.at("num_qubits").get<int64_t>();
+    }
+
+    void qasmtrans_chip_free(qasmtrans_chip *chip)
+    {
+        delete chip;
+    }
+
+    qasmtrans_status qasmtrans_circuit_from_qasm(const char *qasm, size_t len, qasmtrans_circuit **circuit)
+    {
+        if (qasm == NULL || circuit == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        return load_circuit(NULL, qasm, len, circuit);
+    }
+
+    qasmtrans_status qasmtrans_circuit_from_file(const char *path, qasmtrans_circuit **circuit)
+    {
+        if (path == NULL || circuit == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        std::ifstream f(path);
+        if (f.fail())
+            return fail(QASMTRANS_ERR_IO, std::string("Could not open qasm file at:") + path);
+        return load_circuit(&f, NULL, 0, circuit);
+    }
+
+    void qasmtrans_circuit_free(qasmtrans_circuit *circuit)
+    {
+        delete circuit;
+    }
+
+    qasmtrans_status qasmtrans_transpile(qasmtrans_circuit *circuit, const qasmtrans_chip *chip,
+                                         qasmtrans_mode mode, int debug_level)
+    {
+        qasmtrans_routing_options options;
+        qasmtrans_routing_options_default(&options);
+        return qasmtrans_transpile_with_options(circuit, chip, mode, debug_level, &options);
+    }
+
+    void qasmtrans_routing_options_default(qasmtrans_routing_options *options)
+    {
+        if (options == NULL)
+            return;
+        SabreOptions sabre;
+        options->struct_size = sizeof(qasmtrans_routing_options);
+        options->extended_size = sabre.extended_size;
+        options->extended_weight = sabre.extended_weight;
+        options->decay = sabre.decay;
+        options->decay_reset = sabre.decay_reset;
+        options->seed = -1;
+        options->stagnation_limit = sabre.stagnation_limit;
+        options->max_swaps_per_gate = sabre.max_swaps_per_gate;
+        options->parallel_swaps = sabre.parallel_swaps ? 1 : 0;
+        options->depth_weight = sabre.depth_weight;
+        options->commutation_block = sabre.commutation_block;
+        options->beam_search = sabre.beam_search ? 1 : 0;
+        options->beam_width = sabre.beam_width;
+        options->search_depth = sabre.search_depth;
+        options->search_nodes = sabre.search_nodes;
+        options->search_threads = sabre.search_threads;
+        options->bridge = sabre.bridge ? 1 : 0;
+        options->time_slices = sabre.time_slices;
+    }
+
+    qasmtrans_status qasmtrans_transpile_with_options(qasmtrans_circuit *circuit, const qasmtrans_chip *chip,
+                                                      qasmtrans_mode mode, int debug_level,
+                                                      const qasmtrans_routing_options *options)
+    {
+        return qasmtrans_transpile_controlled(circuit, chip, mode, debug_level, options, NULL);
+    }
+
+    qasmtrans_status qasmtrans_cancel_token_create(qasmtrans_cancel_token **token)
+    {
+        if (token == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        *token = new qasmtrans_cancel_token();
+        return QASMTRANS_OK;
+    }
+
+    void qasmtrans_cancel(qasmtrans_cancel_token *token)
+    {
+        if (token != NULL)
+            token->cancelled = true;
+    }
+
+    void qasmtrans_cancel_token_free(qasmtrans_cancel_token *token)
+    {
+        delete token;
+    }
+
+    qasmtrans_status qasmtrans_transpile_controlled(qasmtrans_circuit *circuit, const qasmtrans_chip *chip,
+                                                    qasmtrans_mode mode, int debug_level,
+                                                    const qasmtrans_routing_options *options,
+                                                    qasmtrans_run_control *control)
+    {
+        if (circuit == NULL || chip == NULL || options == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        if (mode < QASMTRANS_MODE_IBMQ || mode > QASMTRANS_MODE_QUAFU)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Unknown mode " + std::to_string(mode));
+        if (circuit->transpiled)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Circuit is already transpiled");
+        if (circuit->circuit->is_empty())
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Circuit is empty");
+        if (options->struct_size < ROUTING_OPTIONS_MIN_SIZE || options->struct_size > sizeof(qasmtrans_routing_options))
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Unsupported qasmtrans_routing_options struct_size " +
+                                                            std::to_string(options->struct_size) +
+                                                            ", use qasmtrans_routing_options_default");
+        // fields beyond the caller's struct keep their default
+        qasmtrans_routing_options given;
+        qasmtrans_routing_options_default(&given);
+        std::memcpy(&given, options, options->struct_size);
+        options = &given;
+        SabreOptions sabre;
+        sabre.extended_size = options->extended_size;
+        sabre.extended_weight = options->extended_weight;
+        sabre.decay = options->decay;
+        sabre.decay_reset = options->decay_reset;
+        sabre.stagnation_limit = options->stagnation_limit;
+        sabre.max_swaps_per_gate = options->max_swaps_per_gate;
+        sabre.parallel_swaps = options->parallel_swaps != 0;
+        sabre.depth_weight = options->depth_weight;
+        sabre.commutation_block = options->commutation_block;
+        sabre.beam_search = options->beam_search != 0;
+        sabre.beam_width = options->beam_width;
+        sabre.search_depth = options->search_depth;
+        sabre.search_nodes = options->search_nodes;
+        sabre.search_threads = options->search_threads;
+        sabre.bridge = options->bridge != 0;
+        sabre.time_slices = options->time_slices;
+        try
+        {
+            sabre.validate();
+        }
+        catch (const std::exception &e)
+        {
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, e.what());
+        }
+        RunControl run_control;
+        if (control != NULL)
+        {
+            if (control->deadline_ms > 0)
+                run_control.set_deadline_ms(control->deadline_ms);
+            if (control->cancel != NULL)
+                run_control.cancel = &control->cancel->cancelled;
+            if (control->progress != NULL)
+            {
+                qasmtrans_progress_fn progress = control->progress;
+                void *user_data = control->user_data;
+                run_control.progress = [progress, user_data](const TranspileProgress &p)
+                { progress(p.stage.c_str(), p.done, p.total, p.elapsed_ms, p.eta_ms, user_data); };
+                run_control.progress_interval_ms = control->progress_interval_ms;
+            }
+            control->deadline_hit = 0;
+        }
+        return guarded(QASMTRANS_ERR_TRANSPILE, [&]()
+                       {
+            QASMTRANS_TRACE_CIRCUIT(circuit->trace_id);
+            shared_ptr<Chip> target = chip_for_circuit(chip, circuit->circuit->num_qubits());
+            transpiler(circuit->circuit, target, circuit->list_cregs, debug_level, mode, options->seed,
+                       default_pipeline(), sabre, &run_control);
+            circuit->transpiled = true;
+            if (control != NULL)
+                control->deadline_hit = run_control.deadline_hit ? 1 : 0; });
+    }
+
+    int64_t qasmtrans_circuit_num_qubits(const qasmtrans_circuit *circuit)
+    {
+        if (circuit == NULL)
+            return -1;
+        return circuit->circuit->num_qubits();
+    }
+
+    size_t qasmtrans_circuit_num_gates(const qasmtrans_circuit *circuit)
+    {
+        if (circuit == NULL)
+            return 0;
+        return circuit->circuit->num_gates();
+    }
+
+    qasmtrans_status qasmtrans_circuit_get_gate(const qasmtrans_circuit *circuit, size_t index, qasmtrans_gate *gate)
+    {
+        if (circuit == NULL || gate == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        const vector<Gate> &gates = *circuit->circuit->gates;
+        if (index >= gates.size())
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Gate index " + std::to_string(index) + " out of range");
+        const Gate &g = gates[index];
+        gate->name = lower_op_name(g.op_name);
+        gate->op = g.op_name;
+        gate->qubit = g.qubit;
+        gate->ctrl = g.ctrl;
+        gate->extra = g.extra;
+        gate->theta = g.theta;
+        gate->phi = g.phi;
+        gate->lam = g.lam;
+        gate->gamma = g.gamma;
+        gate->cbit = g.cbit;
+        return QASMTRANS_OK;
+    }
+
+    size_t qasmtrans_circuit_num_clbits(const qasmtrans_circuit *circuit)
+    {
+        if (circuit == NULL)
+            return 0;
+        size_t n_clbits = 0;
+        for (auto &entry : circuit->list_cregs)
+            n_clbits += entry.second.width;
+        return n_clbits;
+    }
+
+    qasmtrans_status qasmtrans_circuit_measured_qubit(const qasmtrans_circuit *circuit, size_t clbit, int64_t *qubit)
+    {
+        if (circuit == NULL || qubit == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        if (clbit >= qasmtrans_circuit_num_clbits(circuit))
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Classical bit " + std::to_string(clbit) + " out of range");
+        const vector<Gate> &gates = *circuit->circuit->gates;
+        if (has_measurements(gates))
+        {
+            *qubit = -1;
+            for (auto it = gates.rbegin(); it != gates.rend(); ++it)
+            {
+                if (it->op_name == OP::M && it->cbit == IdxType(clbit))
+                {
+                    *qubit = it->qubit;
+                    break;
+                }
+            }
+            return QASMTRANS_OK;
+        }
+        // same rule as dumpQASM: bit i measures the qubit holding logical qubit i
+        const vector<IdxType> &mapping = circuit->circuit->initial_mapping;
+        *qubit = clbit < mapping.size() ? mapping[clbit] : (int64_t)clbit;
+        return QASMTRANS_OK;
+    }
+
+    size_t qasmtrans_circuit_num_params(const qasmtrans_circuit *circuit)
+    {
+        if (circuit == NULL || !circuit->circuit->params)
+            return 0;
+        return circuit->circuit->params->num_symbols();
+    }
+
+    qasmtrans_status qasmtrans_circuit_bind(qasmtrans_circuit *circuit, const double *values, size_t n_values)
+    {
+        if (circuit == NULL || (values == NULL && n_values > 0))
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        return guarded(QASMTRANS_ERR_INVALID_ARGUMENT, [&]()
+                       { circuit->circuit->bind(std::vector<ValType>(values, values + n_values)); });
+    }
+
+    qasmtrans_status qasmtrans_circuit_to_qasm(qasmtrans_circuit *circuit, const char **qasm, size_t *len)
+    {
+        if (circuit == NULL || qasm == NULL)
+            return fail(QASMTRANS_ERR_INVALID_ARGUMENT, "Null argument");
+        return guarded(QASMTRANS_ERR_INTERNAL, [&]()
+                       {
+            std::ostringstream out;
+            std::map<std::string, IdxType> basis_gate_counts;
+            writeQASM(circuit->circuit, out, basis_gate_counts);
+            circuit->qasm = out.str();
+            *qasm = circuit->qasm.c_str();
+            if (len != NULL)
+                *len = circuit->qasm.size(); });
+    }
+}
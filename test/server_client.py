@@ -0,0 +1,53 @@
+import sys
+import json
+import socket
+import argparse
+
+# Minimal client for the QASMTrans server mode (qasmtrans -server <socket>).
+# Example:
+#   ./qasmtrans -server /tmp/qasmtrans.sock -devices ../data/devices &
+#   python3 server_client.py /tmp/qasmtrans.sock circuit.qasm ibmq_toronto -m ibmq -limited
+
+
+def transpile(sock_file, request):
+    sock_file.write((json.dumps(request) + '\n').encode())
+    sock_file.flush()
+    line = sock_file.readline()
+    if not line:
+        raise RuntimeError('server closed the connection')
+    return json.loads(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='QASMTrans server client')
+    parser.add_argument('socket', help='server socket path')
+    parser.add_argument('qasm', nargs='+', help='input qasm files, sent on one connection')
+    parser.add_argument('device', help='device id, i.e., a json file name in the devices directory')
+    parser.add_argument('-m', '--mode', default='ibmq')
+    parser.add_argument('-limited', '--limited', action='store_true')
+    parser.add_argument('-o', '--output', help='write the transpiled qasm of the last circuit here')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(args.socket)
+    sock_file = sock.makefile('rwb')
+    ok = True
+    for i, path in enumerate(args.qasm):
+        with open(path) as f:
+            request = {'id': i, 'qasm': f.read(), 'device': args.device,
+                       'mode': args.mode, 'limited': args.limited}
+        response = transpile(sock_file, request)
+        if response['status'] != 'ok':
+            print(f'{path}: error: {response["error"]}')
+            ok = False
+            continue
+        print(f'{path}: {json.dumps(response["stats"])}')
+        if args.output:
+            with open(args.output, 'w') as out:
+                out.write(response['qasm'])
+    sock.close()
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()